@@ -57,11 +57,137 @@ static u32 crc32c_intel_le_hw_byte(u32 crc, unsigned char const *data, size_t le
 	return crc;
 }
 
+#ifdef CONFIG_X86_64
+/*
+ * The crc32 instruction has a latency of three cycles but can issue one per
+ * cycle, so a single dependent chain leaves two thirds of it idle.  Large
+ * buffers are therefore cut into three equally sized streams that are run
+ * through the instruction interleaved, then folded back together by feeding
+ * the earlier streams through the CRC register as many zero bytes as follow
+ * them (crc32c_shift()) and xoring in the later ones.
+ *
+ * Two stream sizes are used so that the serial tail stays short.
+ */
+#define CRC32C_POLY_LE		0x82F63B78
+#define CRC32C_LONG		8192
+#define CRC32C_SHORT		256
+
+static u32 crc32c_long[4][256] __read_mostly;
+static u32 crc32c_short[4][256] __read_mostly;
+
+static u32 __init gf2_matrix_times(const u32 *mat, u32 vec)
+{
+	u32 sum = 0;
+
+	for (; vec; vec >>= 1, mat++)
+		if (vec & 1)
+			sum ^= *mat;
+
+	return sum;
+}
+
+static void __init gf2_matrix_square(u32 *mat)
+{
+	u32 square[32];
+	int n;
+
+	for (n = 0; n < 32; n++)
+		square[n] = gf2_matrix_times(mat, mat[n]);
+	memcpy(mat, square, sizeof(square));
+}
+
+/*
+ * Build byte indexed tables for the operator that feeds @len zero bytes
+ * through the CRC register, @len must be a power of two.
+ */
+static void __init crc32c_zeros(u32 zeros[][256], size_t len)
+{
+	u32 op[32];
+	int n;
+
+	/* One zero bit: shift right, fold bit 0 back in via the polynomial */
+	op[0] = CRC32C_POLY_LE;
+	for (n = 1; n < 32; n++)
+		op[n] = 1U << (n - 1);
+
+	/* Square up to one zero byte, then up to @len zero bytes */
+	for (n = 0; n < 3; n++)
+		gf2_matrix_square(op);
+	while (len >>= 1)
+		gf2_matrix_square(op);
+
+	for (n = 0; n < 256; n++) {
+		zeros[0][n] = gf2_matrix_times(op, n);
+		zeros[1][n] = gf2_matrix_times(op, n << 8);
+		zeros[2][n] = gf2_matrix_times(op, n << 16);
+		zeros[3][n] = gf2_matrix_times(op, n << 24);
+	}
+}
+
+static inline u32 crc32c_shift(u32 zeros[][256], u32 crc)
+{
+	return zeros[0][crc & 0xff] ^ zeros[1][(crc >> 8) & 0xff] ^
+	       zeros[2][(crc >> 16) & 0xff] ^ zeros[3][crc >> 24];
+}
+
+static inline u32 crc32c_intel_u64(u32 crc, unsigned long data)
+{
+	__asm__(".byte 0xf2, " REX_PRE "0xf, 0x38, 0xf1, 0xf1;"
+		:"=S"(crc)
+		:"0"(crc), "c"(data)
+	);
+	return crc;
+}
+
+static unsigned char const *crc32c_intel_le_hw_3way(u32 *crcp,
+		unsigned char const *p, size_t *lenp, size_t block,
+		u32 zeros[][256])
+{
+	unsigned long const *p0, *p1, *p2, *end;
+	u32 crc0 = *crcp, crc1, crc2;
+
+	while (*lenp >= 3 * block) {
+		p0 = (unsigned long const *)p;
+		p1 = (unsigned long const *)(p + block);
+		p2 = (unsigned long const *)(p + 2 * block);
+		end = p1;
+		crc1 = crc2 = 0;
+
+		do {
+			crc0 = crc32c_intel_u64(crc0, *p0++);
+			crc1 = crc32c_intel_u64(crc1, *p1++);
+			crc2 = crc32c_intel_u64(crc2, *p2++);
+		} while (p0 < end);
+
+		crc0 = crc32c_shift(zeros, crc0) ^ crc1;
+		crc0 = crc32c_shift(zeros, crc0) ^ crc2;
+
+		p += 3 * block;
+		*lenp -= 3 * block;
+	}
+
+	*crcp = crc0;
+	return p;
+}
+#endif
+
 static u32 __pure crc32c_intel_le_hw(u32 crc, unsigned char const *p, size_t len)
 {
-	unsigned int iquotient = len / SCALE_F;
-	unsigned int iremainder = len % SCALE_F;
-	unsigned long *ptmp = (unsigned long *)p;
+	unsigned int iquotient;
+	unsigned int iremainder;
+	unsigned long *ptmp;
+
+#ifdef CONFIG_X86_64
+	if (len >= 3 * CRC32C_SHORT) {
+		p = crc32c_intel_le_hw_3way(&crc, p, &len, CRC32C_LONG,
+					    crc32c_long);
+		p = crc32c_intel_le_hw_3way(&crc, p, &len, CRC32C_SHORT,
+					    crc32c_short);
+	}
+#endif
+	iquotient = len / SCALE_F;
+	iremainder = len % SCALE_F;
+	ptmp = (unsigned long *)p;
 
 	while (iquotient--) {
 		__asm__ __volatile__(
@@ -176,10 +302,14 @@ static struct shash_alg alg = {
 
 static int __init crc32c_intel_mod_init(void)
 {
-	if (cpu_has_xmm4_2)
-		return crypto_register_shash(&alg);
-	else
+	if (!cpu_has_xmm4_2)
 		return -ENODEV;
+
+#ifdef CONFIG_X86_64
+	crc32c_zeros(crc32c_long, CRC32C_LONG);
+	crc32c_zeros(crc32c_short, CRC32C_SHORT);
+#endif
+	return crypto_register_shash(&alg);
 }
 
 static void __exit crc32c_intel_mod_fini(void)
@@ -135,10 +135,12 @@ struct aoetgt {
 	struct aoeif ifs[NAOEIFS];
 	struct aoeif *ifp;	/* current aoeif in use */
 	ushort nout;
-	ushort maxout;
+	ushort maxout;		/* congestion window, in frames */
+	ushort ssthresh;	/* slow start threshold of the window */
+	ushort ackcnt;		/* responses towards the next window increase */
 	u16 lasttag;		/* last tag sent */
 	u16 useme;
-	ulong lastwadj;		/* last window adjustment */
+	ulong lastwadj;		/* last window decrease */
 	int wpkts, rpkts;
 	int dataref;
 };
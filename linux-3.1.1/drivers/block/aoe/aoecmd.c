@@ -128,76 +128,103 @@ skb_pool_get(struct aoedev *d)
 	return NULL;
 }
 
-/* freeframe is where we do our load balancing so it's a little hairy. */
+/* get a free frame of target t, or NULL if the network layer
+ * still holds all of them and the skb pool is exhausted, too. */
 static struct frame *
-freeframe(struct aoedev *d)
+tgtframe(struct aoedev *d, struct aoetgt *t)
 {
 	struct frame *f, *e, *rf;
-	struct aoetgt **t;
 	struct sk_buff *skb;
 
+	rf = NULL;
+	f = t->frames;
+	e = f + t->nframes;
+	for (; f < e; f++) {
+		if (f->tag != FREETAG)
+			continue;
+		skb = f->skb;
+		if (!skb
+		&& !(f->skb = skb = new_skb(ETH_ZLEN)))
+			continue;
+		if (atomic_read(&skb_shinfo(skb)->dataref)
+			!= 1) {
+			if (!rf)
+				rf = f;
+			continue;
+		}
+gotone:		skb_shinfo(skb)->nr_frags = skb->data_len = 0;
+		skb_trim(skb, 0);
+		return f;
+	}
+	/* Work can be done, but the network layer is
+	   holding our precious packets.  Try to grab
+	   one from the pool. */
+	f = rf;
+	if (f == NULL) {	/* more paranoia */
+		printk(KERN_ERR
+			"aoe: freeframe: %s.\n",
+			"unexpected null rf");
+		d->flags |= DEVFL_KICKME;
+		return NULL;
+	}
+	skb = skb_pool_get(d);
+	if (skb) {
+		skb_pool_put(d, f->skb);
+		f->skb = skb;
+		goto gotone;
+	}
+	t->dataref++;
+	if (t->nout == 0)
+		d->flags |= DEVFL_KICKME;
+	return NULL;
+}
+
+/* freeframe is where we do our load balancing so it's a little hairy.
+ *
+ * Frames are striped over all targets (that is, all interfaces of the
+ * shelf), each time to the one with the most room left in its
+ * congestion window, rotating among equals.  A fast path thus gets
+ * more frames than a congested one, instead of strict turns.
+ */
+static struct frame *
+freeframe(struct aoedev *d)
+{
+	struct frame *f;
+	struct aoetgt **t, **best;
+	ulong tried = 0;
+	int n, bestn;
+
 	if (d->targets[0] == NULL) {	/* shouldn't happen, but I'm paranoid */
 		printk(KERN_ERR "aoe: NULL TARGETS!\n");
 		return NULL;
 	}
-	t = d->tgt;
-	t++;
-	if (t >= &d->targets[NTARGETS] || !*t)
-		t = d->targets;
 	for (;;) {
-		if ((*t)->nout < (*t)->maxout
-		&& t != d->htgt
-		&& (*t)->ifp->nd) {
-			rf = NULL;
-			f = (*t)->frames;
-			e = f + (*t)->nframes;
-			for (; f < e; f++) {
-				if (f->tag != FREETAG)
-					continue;
-				skb = f->skb;
-				if (!skb
-				&& !(f->skb = skb = new_skb(ETH_ZLEN)))
-					continue;
-				if (atomic_read(&skb_shinfo(skb)->dataref)
-					!= 1) {
-					if (!rf)
-						rf = f;
-					continue;
-				}
-gotone:				skb_shinfo(skb)->nr_frags = skb->data_len = 0;
-				skb_trim(skb, 0);
-				d->tgt = t;
-				ifrotate(*t);
-				return f;
+		best = NULL;
+		bestn = 0;
+		t = d->tgt;
+		do {
+			t++;
+			if (t >= &d->targets[NTARGETS] || !*t)
+				t = d->targets;
+			n = (*t)->maxout - (*t)->nout;
+			if (n > bestn
+			&& t != d->htgt
+			&& (*t)->ifp->nd
+			&& !(tried & 1UL << (t - d->targets))) {
+				best = t;
+				bestn = n;
 			}
-			/* Work can be done, but the network layer is
-			   holding our precious packets.  Try to grab
-			   one from the pool. */
-			f = rf;
-			if (f == NULL) {	/* more paranoia */
-				printk(KERN_ERR
-					"aoe: freeframe: %s.\n",
-					"unexpected null rf");
-				d->flags |= DEVFL_KICKME;
-				return NULL;
-			}
-			skb = skb_pool_get(d);
-			if (skb) {
-				skb_pool_put(d, f->skb);
-				f->skb = skb;
-				goto gotone;
-			}
-			(*t)->dataref++;
-			if ((*t)->nout == 0)
-				d->flags |= DEVFL_KICKME;
+		} while (t != d->tgt);
+		if (best == NULL)	/* we've looked and found nada */
+			return NULL;
+		f = tgtframe(d, *best);
+		if (f) {
+			d->tgt = best;
+			ifrotate(*best);
+			return f;
 		}
-		if (t == d->tgt)	/* we've looped and found nada */
-			break;
-		t++;
-		if (t >= &d->targets[NTARGETS] || !*t)
-			t = d->targets;
+		tried |= 1UL << (best - d->targets);
 	}
-	return NULL;
 }
 
 static int
@@ -518,9 +545,11 @@ rexmit_timer(ulong vp)
 			&& (tt != d->targets || d->targets[1]))
 				d->htgt = tt;
 
-			if (t->nout == t->maxout) {
-				if (t->maxout > 1)
-					t->maxout--;
+			/* multiplicative decrease, once per round trip */
+			if (jiffies - t->lastwadj > timeout) {
+				t->ssthresh = t->maxout >> 1 ?: 1;
+				t->maxout = t->ssthresh;
+				t->ackcnt = 0;
 				t->lastwadj = jiffies;
 			}
 
@@ -546,14 +575,6 @@ rexmit_timer(ulong vp)
 			}
 			resend(d, t, f);
 		}
-
-		/* window check */
-		if (t->nout == t->maxout
-		&& t->maxout < t->nframes
-		&& (jiffies - t->lastwadj)/HZ > 10) {
-			t->maxout++;
-			t->lastwadj = jiffies;
-		}
 	}
 
 	if (!skb_queue_empty(&d->sendq)) {
@@ -704,6 +725,22 @@ calc_rttavg(struct aoedev *d, int rtt)
 	d->rttavg += n >> 2;
 }
 
+/* A frame was answered: open the window of its target again, by one
+ * frame per response below ssthresh (slow start), else by one frame per
+ * window's worth of responses (additive increase). */
+static void
+cwnd_ack(struct aoetgt *t)
+{
+	if (t->maxout >= t->nframes)
+		return;
+	if (t->maxout < t->ssthresh)
+		t->maxout++;
+	else if (++t->ackcnt >= t->maxout) {
+		t->maxout++;
+		t->ackcnt = 0;
+	}
+}
+
 static struct aoetgt *
 gettgt(struct aoedev *d, char *addr)
 {
@@ -866,6 +903,7 @@ aoecmd_ata_rsp(struct sk_buff *skb)
 	f->buf = NULL;
 	f->tag = FREETAG;
 	t->nout--;
+	cwnd_ack(t);
 
 	aoecmd_work(d);
 xmit:
@@ -957,6 +995,7 @@ addtgt(struct aoedev *d, char *addr, ulong nframes)
 	memcpy(t->addr, addr, sizeof t->addr);
 	t->ifp = t->ifs;
 	t->maxout = t->nframes;
+	t->ssthresh = t->nframes;
 	return *tt = t;
 }
 
@@ -1072,6 +1111,8 @@ aoecmd_cleanslate(struct aoedev *d)
 	te = t + NTARGETS;
 	for (; t < te && *t; t++) {
 		(*t)->maxout = (*t)->nframes;
+		(*t)->ssthresh = (*t)->nframes;
+		(*t)->ackcnt = 0;
 		p = (*t)->ifs;
 		e = p + NAOEIFS;
 		for (; p < e; p++) {
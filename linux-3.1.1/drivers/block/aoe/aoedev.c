@@ -72,6 +72,8 @@ aoedev_downdev(struct aoedev *d)
 			}
 		}
 		(*t)->maxout = (*t)->nframes;
+		(*t)->ssthresh = (*t)->nframes;
+		(*t)->ackcnt = 0;
 		(*t)->nout = 0;
 	}
 	buf = d->inprocess;
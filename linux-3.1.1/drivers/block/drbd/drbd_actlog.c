@@ -214,6 +214,23 @@ void drbd_al_begin_io(struct drbd_conf *mdev, sector_t sector)
 
 	D_ASSERT(atomic_read(&mdev->local_cnt) > 0);
 
+	/* Fast path: the extent is already hot, just take another reference,
+	 * without the al_lock.  While resync holds extents locked, always go
+	 * through _al_get(), which gives resync priority (BME_PRIORITY). */
+	if (!ACCESS_ONCE(mdev->resync_locked)) {
+		al_ext = lc_try_get_active(mdev->act_log, enr);
+		if (al_ext) {
+			if (likely(al_ext->lc_number == enr))
+				return;
+			/* recycled while we looked, give the stray reference
+			 * back the way lc_try_get_active() asks us to */
+			spin_lock_irq(&mdev->al_lock);
+			lc_put(mdev->act_log, al_ext);
+			spin_unlock_irq(&mdev->al_lock);
+			wake_up(&mdev->al_wait);
+		}
+	}
+
 	wait_event(mdev->al_wait, (al_ext = _al_get(mdev, enr)));
 
 	if (al_ext->lc_number != enr) {
@@ -246,6 +263,10 @@ void drbd_al_complete_io(struct drbd_conf *mdev, sector_t sector)
 	struct lc_element *extent;
 	unsigned long flags;
 
+	/* not the last reference: nobody to wake up, nothing to move */
+	if (lc_try_put_active(mdev->act_log, enr))
+		return;
+
 	spin_lock_irqsave(&mdev->al_lock, flags);
 
 	extent = lc_find(mdev->act_log, enr);
@@ -576,7 +597,7 @@ static int _try_lc_del(struct drbd_conf *mdev, struct lc_element *al_ext)
 	int rv;
 
 	spin_lock_irq(&mdev->al_lock);
-	rv = (al_ext->refcnt == 0);
+	rv = (lc_refcnt(al_ext) == 0);
 	if (likely(rv))
 		lc_del(mdev->act_log, al_ext);
 	spin_unlock_irq(&mdev->al_lock);
@@ -888,7 +909,7 @@ struct bm_extent *_bme_get(struct drbd_conf *mdev, unsigned int enr)
 			lc_changed(mdev->resync, &bm_ext->lce);
 			wakeup = 1;
 		}
-		if (bm_ext->lce.refcnt == 1)
+		if (lc_refcnt(&bm_ext->lce) == 1)
 			mdev->resync_locked++;
 		set_bit(BME_NO_WRITES, &bm_ext->flags);
 	}
@@ -918,7 +939,7 @@ static int _is_in_al(struct drbd_conf *mdev, unsigned int enr)
 	else {
 		al_ext = lc_find(mdev->act_log, enr);
 		if (al_ext) {
-			if (al_ext->refcnt)
+			if (lc_refcnt(al_ext))
 				rv = 1;
 		}
 	}
@@ -1042,8 +1063,8 @@ int drbd_try_rs_begin_io(struct drbd_conf *mdev, sector_t sector)
 			 * but then could not set BME_LOCKED,
 			 * so we tried again.
 			 * drop the extra reference. */
-			bm_ext->lce.refcnt--;
-			D_ASSERT(bm_ext->lce.refcnt > 0);
+			atomic_dec(&bm_ext->lce.refcnt);
+			D_ASSERT(lc_refcnt(&bm_ext->lce) > 0);
 		}
 		goto check_al;
 	} else {
@@ -1069,7 +1090,7 @@ int drbd_try_rs_begin_io(struct drbd_conf *mdev, sector_t sector)
 			D_ASSERT(test_bit(BME_LOCKED, &bm_ext->flags) == 0);
 		}
 		set_bit(BME_NO_WRITES, &bm_ext->flags);
-		D_ASSERT(bm_ext->lce.refcnt == 1);
+		D_ASSERT(lc_refcnt(&bm_ext->lce) == 1);
 		mdev->resync_locked++;
 		goto check_al;
 	}
@@ -1110,7 +1131,7 @@ void drbd_rs_complete_io(struct drbd_conf *mdev, sector_t sector)
 		return;
 	}
 
-	if (bm_ext->lce.refcnt == 0) {
+	if (lc_refcnt(&bm_ext->lce) == 0) {
 		spin_unlock_irqrestore(&mdev->al_lock, flags);
 		dev_err(DEV, "drbd_rs_complete_io(,%llu [=%u]) called, "
 		    "but refcnt is 0!?\n",
@@ -1177,9 +1198,9 @@ int drbd_rs_del_all(struct drbd_conf *mdev)
 				mdev->resync_wenr = LC_FREE;
 				lc_put(mdev->resync, &bm_ext->lce);
 			}
-			if (bm_ext->lce.refcnt != 0) {
+			if (lc_refcnt(&bm_ext->lce) != 0) {
 				dev_info(DEV, "Retrying drbd_rs_del_all() later. "
-				     "refcnt=%d\n", bm_ext->lce.refcnt);
+				     "refcnt=%d\n", lc_refcnt(&bm_ext->lce));
 				put_ldev(mdev);
 				spin_unlock_irq(&mdev->al_lock);
 				return -EAGAIN;
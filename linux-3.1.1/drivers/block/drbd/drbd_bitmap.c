@@ -1227,6 +1227,46 @@ unsigned long drbd_bm_find_next(struct drbd_conf *mdev, unsigned long bm_fo)
 	return bm_find_next(mdev, bm_fo, 0);
 }
 
+/* returns the first bit in [s, e) which is NOT set,
+ * or e, if the whole range is set.
+ * Scans word wise, so the resync request generator can find the extent of
+ * a dirty run with one call instead of testing bit by bit. */
+unsigned long drbd_bm_find_run_end(struct drbd_conf *mdev,
+	unsigned long s, unsigned long e)
+{
+	struct drbd_bitmap *b = mdev->bitmap;
+	unsigned long *p_addr;
+	unsigned long bit_offset;
+	unsigned long last;
+	unsigned i;
+
+	ERR_IF(!b) return s;
+	ERR_IF(!b->bm_pages) return s;
+
+	spin_lock_irq(&b->bm_lock);
+	if (BM_DONT_TEST & b->bm_flags)
+		bm_print_lock_info(mdev);
+
+	if (e > b->bm_bits)
+		e = b->bm_bits;
+	while (s < e) {
+		/* bit offset of the first bit in the page */
+		bit_offset = s & ~BITS_PER_PAGE_MASK;
+		last = min_t(unsigned long, e - bit_offset, BITS_PER_PAGE);
+
+		p_addr = bm_map_pidx(b, bm_bit_to_page_idx(b, s));
+		i = find_next_zero_bit_le(p_addr, last, s & BITS_PER_PAGE_MASK);
+		bm_unmap(p_addr);
+
+		s = bit_offset + i;
+		if (i < last)
+			break;
+	}
+
+	spin_unlock_irq(&b->bm_lock);
+	return s;
+}
+
 #if 0
 /* not yet needed for anything. */
 unsigned long drbd_bm_find_next_zero(struct drbd_conf *mdev, unsigned long bm_fo)
@@ -764,6 +764,13 @@ struct digest_info {
 	void *digest;
 };
 
+/* one instance of csums_tfm per cpu, for drbd_csum_wq.  The tfm holds
+ * the hash state, so it may only be used by one csum work at a time. */
+struct drbd_csum_tfm {
+	struct crypto_hash *tfm;
+	struct mutex mutex;
+};
+
 struct drbd_epoch_entry {
 	struct drbd_work w;
 	struct hlist_node collision;
@@ -779,6 +786,10 @@ struct drbd_epoch_entry {
 		u64 block_id;
 		struct digest_info *digest;
 	};
+	/* local checksum of the data, computed on drbd_csum_wq
+	 * before the ee is handed to the worker (EE_NEED_CSUM) */
+	void *csum;
+	struct work_struct csum_work;
 };
 
 /* ee flag bits.
@@ -802,12 +813,17 @@ enum {
 
 	/* This ee has a pointer to a digest instead of a block id */
 	__EE_HAS_DIGEST,
+
+	/* Hash the data on drbd_csum_wq once the read completed,
+	 * so the worker only has to send or compare the result */
+	__EE_NEED_CSUM,
 };
 #define EE_CALL_AL_COMPLETE_IO (1<<__EE_CALL_AL_COMPLETE_IO)
 #define EE_MAY_SET_IN_SYNC     (1<<__EE_MAY_SET_IN_SYNC)
 #define	EE_RESUBMITTED         (1<<__EE_RESUBMITTED)
 #define EE_WAS_ERROR           (1<<__EE_WAS_ERROR)
 #define EE_HAS_DIGEST          (1<<__EE_HAS_DIGEST)
+#define EE_NEED_CSUM           (1<<__EE_NEED_CSUM)
 
 /* global flag bits */
 enum {
@@ -1055,6 +1071,7 @@ struct drbd_conf {
 	sector_t ov_last_oos_size;
 	unsigned long ov_left; /* in bits */
 	struct crypto_hash *csums_tfm;
+	struct drbd_csum_tfm __percpu *csums_tfm_pcpu;
 	struct crypto_hash *verify_tfm;
 
 	struct drbd_thread receiver;
@@ -1096,7 +1113,7 @@ struct drbd_conf {
 	struct page *md_io_page;	/* one page buffer for md_io */
 	struct page *md_io_tmpp;	/* for logical_block_size != 512 */
 	struct mutex md_io_mutex;	/* protects the md_io_buffer */
-	spinlock_t al_lock;
+	spinlock_t al_lock;		/* act_log and resync set changes; see drbd_al_begin_io() */
 	wait_queue_head_t al_wait;
 	struct lru_cache *act_log;	/* activity log */
 	unsigned int al_tr_number;
@@ -1128,6 +1145,10 @@ struct drbd_conf {
 	struct fifo_buffer rs_plan_s; /* correction values of resync planer */
 	int rs_in_flight; /* resync sectors in flight (to proxy, in proxy and from proxy) */
 	int rs_planed;    /* resync sectors already planned */
+	/* the rs_rtt and rs_srtt members are protected by peer_seq_lock */
+	sector_t rs_rtt_sector; /* resync request sampled for its round trip */
+	ktime_t rs_rtt_start;
+	unsigned int rs_srtt;   /* smoothed resync round trip time, in usec */
 	atomic_t ap_in_flight; /* App sectors in flight (waiting for ack) */
 	int peer_max_bio_size;
 	int local_max_bio_size;
@@ -1470,6 +1491,8 @@ extern sector_t      drbd_bm_capacity(struct drbd_conf *mdev);
 
 #define DRBD_END_OF_BITMAP	(~(unsigned long)0)
 extern unsigned long drbd_bm_find_next(struct drbd_conf *mdev, unsigned long bm_fo);
+extern unsigned long drbd_bm_find_run_end(struct drbd_conf *mdev,
+		unsigned long s, unsigned long e);
 /* bm_find_next variants for use while you hold drbd_bm_lock() */
 extern unsigned long _drbd_bm_find_next(struct drbd_conf *mdev, unsigned long bm_fo);
 extern unsigned long _drbd_bm_find_next_zero(struct drbd_conf *mdev, unsigned long bm_fo);
@@ -1493,6 +1516,7 @@ extern struct kmem_cache *drbd_bm_ext_cache;	/* bitmap extents */
 extern struct kmem_cache *drbd_al_ext_cache;	/* activity log extents */
 extern mempool_t *drbd_request_mempool;
 extern mempool_t *drbd_ee_mempool;
+extern struct workqueue_struct *drbd_csum_wq;
 
 extern struct page *drbd_pp_pool; /* drbd's page pool */
 extern spinlock_t   drbd_pp_lock;
@@ -1541,6 +1565,7 @@ extern int drbd_md_sync_page_io(struct drbd_conf *mdev,
 		struct drbd_backing_dev *bdev, sector_t sector, int rw);
 extern void drbd_ov_oos_found(struct drbd_conf*, sector_t, int);
 extern void drbd_rs_controller_reset(struct drbd_conf *mdev);
+extern void drbd_rs_rtt_sample(struct drbd_conf *mdev, sector_t sector);
 
 static inline void ov_oos_print(struct drbd_conf *mdev)
 {
@@ -1555,6 +1580,7 @@ static inline void ov_oos_print(struct drbd_conf *mdev)
 
 extern void drbd_csum_bio(struct drbd_conf *, struct crypto_hash *, struct bio *, void *);
 extern void drbd_csum_ee(struct drbd_conf *, struct crypto_hash *, struct drbd_epoch_entry *, void *);
+extern void drbd_set_csums_tfm(struct drbd_conf *, struct crypto_hash *);
 /* worker callbacks */
 extern int w_req_cancel_conflict(struct drbd_conf *, struct drbd_work *, int);
 extern int w_read_retry_remote(struct drbd_conf *, struct drbd_work *, int);
@@ -139,6 +139,7 @@ struct kmem_cache *drbd_bm_ext_cache;	/* bitmap extents */
 struct kmem_cache *drbd_al_ext_cache;	/* activity log extents */
 mempool_t *drbd_request_mempool;
 mempool_t *drbd_ee_mempool;
+struct workqueue_struct *drbd_csum_wq;	/* resync checksums, unbound */
 
 /* I do not use a standard mempool, because:
    1) I want to hand out the pre-allocated objects first.
@@ -3126,6 +3127,8 @@ static void drbd_destroy_mempools(void)
 
 	/* D_ASSERT(atomic_read(&drbd_pp_vacant)==0); */
 
+	if (drbd_csum_wq)
+		destroy_workqueue(drbd_csum_wq);
 	if (drbd_ee_mempool)
 		mempool_destroy(drbd_ee_mempool);
 	if (drbd_request_mempool)
@@ -3139,6 +3142,7 @@ static void drbd_destroy_mempools(void)
 	if (drbd_al_ext_cache)
 		kmem_cache_destroy(drbd_al_ext_cache);
 
+	drbd_csum_wq         = NULL;
 	drbd_ee_mempool      = NULL;
 	drbd_request_mempool = NULL;
 	drbd_ee_cache        = NULL;
@@ -3156,6 +3160,7 @@ static int drbd_create_mempools(void)
 	int i;
 
 	/* prepare our caches and mempools */
+	drbd_csum_wq         = NULL;
 	drbd_request_mempool = NULL;
 	drbd_ee_cache        = NULL;
 	drbd_request_cache   = NULL;
@@ -3195,6 +3200,12 @@ static int drbd_create_mempools(void)
 	if (drbd_ee_mempool == NULL)
 		goto Enomem;
 
+	/* resync checksums may be computed on any cpu, but they are
+	 * needed to make progress in memory reclaim */
+	drbd_csum_wq = alloc_workqueue("drbd_csum", WQ_UNBOUND | WQ_MEM_RECLAIM, 0);
+	if (drbd_csum_wq == NULL)
+		goto Enomem;
+
 	/* drbd's page pool */
 	spin_lock_init(&drbd_pp_lock);
 
@@ -3608,8 +3619,7 @@ void drbd_free_sock(struct drbd_conf *mdev)
 
 void drbd_free_resources(struct drbd_conf *mdev)
 {
-	crypto_free_hash(mdev->csums_tfm);
-	mdev->csums_tfm = NULL;
+	drbd_set_csums_tfm(mdev, NULL);
 	crypto_free_hash(mdev->verify_tfm);
 	mdev->verify_tfm = NULL;
 	crypto_free_hash(mdev->cram_hmac_tfm);
@@ -771,10 +771,10 @@ static int drbd_check_al_size(struct drbd_conf *mdev)
 	if (t) {
 		for (i = 0; i < t->nr_elements; i++) {
 			e = lc_element_by_index(t, i);
-			if (e->refcnt)
+			if (lc_refcnt(e))
 				dev_err(DEV, "refcnt(%d)==%d\n",
-				    e->lc_number, e->refcnt);
-			in_use += e->refcnt;
+				    e->lc_number, lc_refcnt(e));
+			in_use += lc_refcnt(e);
 		}
 	}
 	if (!in_use)
@@ -785,6 +785,9 @@ static int drbd_check_al_size(struct drbd_conf *mdev)
 		lc_destroy(n);
 		return -EBUSY;
 	} else {
+		/* drbd_al_begin_io() may still be looking at the old
+		 * act_log without holding the al_lock */
+		synchronize_rcu();
 		if (t)
 			lc_destroy(t);
 	}
@@ -1875,12 +1878,6 @@ static int drbd_nl_syncer_conf(struct drbd_conf *mdev, struct drbd_nl_cfg_req *n
 	spin_lock(&mdev->peer_seq_lock);
 	mdev->sync_conf = sc;
 
-	if (!rsr) {
-		crypto_free_hash(mdev->csums_tfm);
-		mdev->csums_tfm = csums_tfm;
-		csums_tfm = NULL;
-	}
-
 	if (!ovr) {
 		crypto_free_hash(mdev->verify_tfm);
 		mdev->verify_tfm = verify_tfm;
@@ -1897,6 +1894,11 @@ static int drbd_nl_syncer_conf(struct drbd_conf *mdev, struct drbd_nl_cfg_req *n
 
 	spin_unlock(&mdev->peer_seq_lock);
 
+	if (!rsr) {
+		drbd_set_csums_tfm(mdev, csums_tfm);
+		csums_tfm = NULL;
+	}
+
 	if (get_ldev(mdev)) {
 		wait_event(mdev->al_wait, lc_try_lock(mdev->act_log));
 		drbd_al_shrink(mdev);
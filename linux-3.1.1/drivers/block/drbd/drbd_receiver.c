@@ -342,6 +342,7 @@ struct drbd_epoch_entry *drbd_alloc_ee(struct drbd_conf *mdev,
 	e->flags = 0;
 	e->sector = sector;
 	e->block_id = id;
+	e->csum = NULL;
 
 	return e;
 
@@ -354,6 +355,7 @@ void drbd_free_some_ee(struct drbd_conf *mdev, struct drbd_epoch_entry *e, int i
 {
 	if (e->flags & EE_HAS_DIGEST)
 		kfree(e->digest);
+	kfree(e->csum);
 	drbd_pp_free(mdev, e->pages, is_net);
 	D_ASSERT(atomic_read(&e->pending_bios) == 0);
 	D_ASSERT(hlist_unhashed(&e->collision));
@@ -1519,6 +1521,7 @@ static int receive_RSDataReply(struct drbd_conf *mdev, enum drbd_packets cmd, un
 		drbd_send_ack_dp(mdev, P_NEG_ACK, p, data_size);
 	}
 
+	drbd_rs_rtt_sample(mdev, sector);
 	atomic_add(data_size >> 9, &mdev->rs_sect_in);
 
 	return ok;
@@ -2030,6 +2033,7 @@ static int receive_DataRequest(struct drbd_conf *mdev, enum drbd_packets cmd, un
 		if (cmd == P_CSUM_RS_REQUEST) {
 			D_ASSERT(mdev->agreed_pro_version >= 89);
 			e->w.cb = w_e_end_csum_rs_req;
+			e->flags |= EE_NEED_CSUM;
 			/* used in the sector offset progress display */
 			mdev->bm_resync_fo = BM_SECT_TO_BIT(sector);
 		} else if (cmd == P_OV_REPLY) {
@@ -2887,9 +2891,6 @@ static int receive_SyncParam(struct drbd_conf *mdev, enum drbd_packets cmd, unsi
 		if (csums_tfm) {
 			strcpy(mdev->sync_conf.csums_alg, p->csums_alg);
 			mdev->sync_conf.csums_alg_len = strlen(p->csums_alg) + 1;
-			crypto_free_hash(mdev->csums_tfm);
-			mdev->csums_tfm = csums_tfm;
-			dev_info(DEV, "using csums-alg: \"%s\"\n", p->csums_alg);
 		}
 		if (fifo_size != mdev->rs_plan_s.size) {
 			kfree(mdev->rs_plan_s.values);
@@ -2898,6 +2899,12 @@ static int receive_SyncParam(struct drbd_conf *mdev, enum drbd_packets cmd, unsi
 			mdev->rs_planed = 0;
 		}
 		spin_unlock(&mdev->peer_seq_lock);
+
+		/* may sleep, do it outside of peer_seq_lock */
+		if (csums_tfm) {
+			drbd_set_csums_tfm(mdev, csums_tfm);
+			dev_info(DEV, "using csums-alg: \"%s\"\n", p->csums_alg);
+		}
 	}
 
 	return ok;
@@ -4241,6 +4248,7 @@ static int got_IsInSync(struct drbd_conf *mdev, struct p_header80 *h)
 		put_ldev(mdev);
 	}
 	dec_rs_pending(mdev);
+	drbd_rs_rtt_sample(mdev, sector);
 	atomic_add(blksize >> 9, &mdev->rs_sect_in);
 
 	return true;
@@ -4406,6 +4414,8 @@ static int got_NegRSDReply(struct drbd_conf *mdev, struct p_header80 *h)
 	update_peer_seq(mdev, be32_to_cpu(p->seq_num));
 
 	dec_rs_pending(mdev);
+	/* a sample nevertheless, or the probe would never be released */
+	drbd_rs_rtt_sample(mdev, sector);
 
 	if (get_ldev_if_state(mdev, D_FAILED)) {
 		drbd_rs_complete_io(mdev, sector);
@@ -77,16 +77,122 @@ void drbd_md_io_complete(struct bio *bio, int error)
 	complete(&md_io->event);
 }
 
+/* checksums of resync data are computed here, on drbd_csum_wq,
+ * instead of on the single per device worker thread.  This way several
+ * blocks are hashed in parallel, while the worker keeps sending. */
+static void __drbd_endio_read_sec_final(struct drbd_epoch_entry *e) __releases(local);
+
+static void drbd_csum_work_fn(struct work_struct *ws)
+{
+	struct drbd_epoch_entry *e = container_of(ws, struct drbd_epoch_entry, csum_work);
+	struct drbd_conf *mdev = e->mdev;
+	struct drbd_csum_tfm __percpu *tfms = ACCESS_ONCE(mdev->csums_tfm_pcpu);
+	struct drbd_csum_tfm *ct;
+	void *digest;
+
+	/* no per cpu instances (any more): leave it to the worker */
+	if (tfms) {
+		/* any instance will do, the one of this cpu is most
+		 * likely idle.  Hashing may take long, so it happens
+		 * with preemption enabled, under the instance's mutex. */
+		ct = per_cpu_ptr(tfms, raw_smp_processor_id());
+		digest = kmalloc(crypto_hash_digestsize(ct->tfm), GFP_NOIO);
+		if (digest) {
+			mutex_lock(&ct->mutex);
+			drbd_csum_ee(mdev, ct->tfm, e, digest);
+			mutex_unlock(&ct->mutex);
+			e->csum = digest;
+		}
+	}
+
+	__drbd_endio_read_sec_final(e);
+}
+
+static void drbd_free_csum_tfms(struct drbd_csum_tfm __percpu *tfms)
+{
+	int cpu;
+
+	if (!tfms)
+		return;
+	for_each_possible_cpu(cpu)
+		crypto_free_hash(per_cpu_ptr(tfms, cpu)->tfm);
+	free_percpu(tfms);
+}
+
+static struct drbd_csum_tfm __percpu *drbd_alloc_csum_tfms(struct crypto_hash *tfm)
+{
+	struct drbd_csum_tfm __percpu *tfms;
+	struct drbd_csum_tfm *ct;
+	struct crypto_hash *ptfm;
+	int cpu;
+
+	tfms = alloc_percpu(struct drbd_csum_tfm);
+	if (!tfms)
+		return NULL;
+	for_each_possible_cpu(cpu) {
+		ct = per_cpu_ptr(tfms, cpu);
+		mutex_init(&ct->mutex);
+		ptfm = crypto_alloc_hash(crypto_tfm_alg_name(crypto_hash_tfm(tfm)),
+					 0, CRYPTO_ALG_ASYNC);
+		if (IS_ERR(ptfm)) {
+			drbd_free_csum_tfms(tfms);
+			return NULL;
+		}
+		ct->tfm = ptfm;
+	}
+	return tfms;
+}
+
+/* install a new csums_tfm, and per cpu instances of the same algorithm
+ * for drbd_csum_work_fn().  The receiver and drbdsetup may both get
+ * here, so the pointers are swapped under peer_seq_lock, and each caller
+ * frees only what it took out, once no csum work may still be using it.
+ * tfm may be NULL. */
+void drbd_set_csums_tfm(struct drbd_conf *mdev, struct crypto_hash *tfm)
+{
+	struct drbd_csum_tfm __percpu *tfms = NULL;
+	struct crypto_hash *old_tfm;
+
+	/* failing here is not fatal, the worker will do the hashing then */
+	if (tfm)
+		tfms = drbd_alloc_csum_tfms(tfm);
+
+	spin_lock(&mdev->peer_seq_lock);
+	old_tfm = mdev->csums_tfm;
+	mdev->csums_tfm = tfm;
+	swap(tfms, mdev->csums_tfm_pcpu);
+	spin_unlock(&mdev->peer_seq_lock);
+
+	if (tfms) {
+		flush_workqueue(drbd_csum_wq);
+		drbd_free_csum_tfms(tfms);
+	}
+	crypto_free_hash(old_tfm);
+}
+
 /* reads on behalf of the partner,
  * "submitted" by the receiver
  */
 void drbd_endio_read_sec_final(struct drbd_epoch_entry *e) __releases(local)
+{
+	D_ASSERT(e->block_id != ID_VACANT);
+
+	/* the ee stays on read_ee until it is hashed,
+	 * so drbd_disconnect() still waits for it. */
+	if ((e->flags & (EE_NEED_CSUM | EE_WAS_ERROR)) == EE_NEED_CSUM) {
+		INIT_WORK(&e->csum_work, drbd_csum_work_fn);
+		queue_work(drbd_csum_wq, &e->csum_work);
+		return;
+	}
+
+	__drbd_endio_read_sec_final(e);
+}
+
+static void __drbd_endio_read_sec_final(struct drbd_epoch_entry *e) __releases(local)
 {
 	unsigned long flags = 0;
 	struct drbd_conf *mdev = e->mdev;
 
-	D_ASSERT(e->block_id != ID_VACANT);
-
 	spin_lock_irqsave(&mdev->req_lock, flags);
 	mdev->read_cnt += e->size >> 9;
 	list_del(&e->w.list);
@@ -314,11 +420,17 @@ int w_e_send_csum(struct drbd_conf *mdev, struct drbd_work *w, int cancel)
 		goto out;
 
 	digest_size = crypto_hash_digestsize(mdev->csums_tfm);
-	digest = kmalloc(digest_size, GFP_NOIO);
+	/* usually already done by drbd_csum_work_fn() */
+	digest = e->csum;
+	e->csum = NULL;
+	if (!digest) {
+		digest = kmalloc(digest_size, GFP_NOIO);
+		if (digest)
+			drbd_csum_ee(mdev, mdev->csums_tfm, e, digest);
+	}
 	if (digest) {
 		sector_t sector = e->sector;
 		unsigned int size = e->size;
-		drbd_csum_ee(mdev, mdev->csums_tfm, e, digest);
 		/* Free e and pages before send.
 		 * In case we block on congestion, we could otherwise run into
 		 * some distributed deadlock, if the other side blocks on
@@ -364,6 +476,7 @@ static int read_for_csum(struct drbd_conf *mdev, sector_t sector, int size)
 		goto defer;
 
 	e->w.cb = w_e_send_csum;
+	e->flags |= EE_NEED_CSUM;
 	spin_lock_irq(&mdev->req_lock);
 	list_add(&e->w.list, &mdev->read_ee);
 	spin_unlock_irq(&mdev->req_lock);
@@ -460,6 +573,15 @@ static int drbd_rs_controller(struct drbd_conf *mdev)
 	} else { /* normal path */
 		want = mdev->sync_conf.c_fill_target ? mdev->sync_conf.c_fill_target :
 			sect_in * mdev->sync_conf.c_delay_target * HZ / (SLEEP_TIME * 10);
+		/* Never keep less than twice the observed bandwidth delay
+		 * product in flight, or a peer with a round trip longer than
+		 * c_delay_target starves the pipe and the rate collapses. */
+		if (!mdev->sync_conf.c_fill_target && mdev->rs_srtt) {
+			u64 bdp = div_u64((u64)sect_in * mdev->rs_srtt * 2,
+					  jiffies_to_usecs(SLEEP_TIME));
+			if (bdp > want)
+				want = min_t(u64, bdp, INT_MAX);
+		}
 	}
 
 	correction = want - mdev->rs_in_flight - mdev->rs_planed;
@@ -491,6 +613,35 @@ static int drbd_rs_controller(struct drbd_conf *mdev)
 	return req_sect;
 }
 
+/* One resync request at a time is timed, from when w_make_resync_request()
+ * issued it until its reply arrives, in the receiver or the asender.
+ * That includes the peer's disk latency, which is what the controller
+ * has to cover with requests in flight. */
+static void drbd_rs_rtt_probe(struct drbd_conf *mdev, sector_t sector)
+{
+	spin_lock(&mdev->peer_seq_lock);
+	if (mdev->rs_rtt_sector == ~(sector_t)0) {
+		mdev->rs_rtt_start = ktime_get();
+		mdev->rs_rtt_sector = sector;
+	}
+	spin_unlock(&mdev->peer_seq_lock);
+}
+
+/* called by both the receiver and the asender */
+void drbd_rs_rtt_sample(struct drbd_conf *mdev, sector_t sector)
+{
+	unsigned int rtt;
+
+	spin_lock(&mdev->peer_seq_lock);
+	if (mdev->rs_rtt_sector == sector) {
+		rtt = ktime_us_delta(ktime_get(), mdev->rs_rtt_start);
+		/* same smoothing as TCP's srtt, gain 1/8 */
+		mdev->rs_srtt = mdev->rs_srtt ? mdev->rs_srtt - (mdev->rs_srtt >> 3) + (rtt >> 3) : rtt;
+		mdev->rs_rtt_sector = ~(sector_t)0;
+	}
+	spin_unlock(&mdev->peer_seq_lock);
+}
+
 static int drbd_rs_number_requests(struct drbd_conf *mdev)
 {
 	int number;
@@ -514,6 +665,7 @@ static int w_make_resync_request(struct drbd_conf *mdev,
 	sector_t sector;
 	const sector_t capacity = drbd_get_capacity(mdev->this_bdev);
 	int max_bio_size;
+	unsigned long run_end;
 	int number, rollback_i, size;
 	int align, queued, sndbuf;
 	int i = 0;
@@ -574,13 +726,25 @@ next_sector:
 		}
 		mdev->bm_resync_fo = bit + 1;
 
-		if (unlikely(drbd_bm_test_bit(mdev, bit) == 0)) {
+		/* find the run of dirty bits starting at bit in one go,
+		 * without crossing the extent boundary, and not longer
+		 * than one maximum sized request */
+#if DRBD_MAX_BIO_SIZE > BM_BLOCK_SIZE
+		run_end = min((bit | BM_BLOCKS_PER_BM_EXT_MASK) + 1,
+			      bit + DIV_ROUND_UP(max_bio_size, BM_BLOCK_SIZE));
+#else
+		run_end = bit + 1;
+#endif
+		run_end = drbd_bm_find_run_end(mdev, bit, run_end);
+
+		/* now, is it actually dirty, after all? */
+		if (unlikely(run_end == bit)) {
 			drbd_rs_complete_io(mdev, sector);
 			goto next_sector;
 		}
 
 #if DRBD_MAX_BIO_SIZE > BM_BLOCK_SIZE
-		/* try to find some adjacent bits.
+		/* try to merge the adjacent bits.
 		 * we stop if we have already the maximum req size.
 		 *
 		 * Additionally always align bigger requests, in order to
@@ -596,15 +760,7 @@ next_sector:
 			if (sector & ((1<<(align+3))-1))
 				break;
 
-			/* do not cross extent boundaries */
-			if (((bit+1) & BM_BLOCKS_PER_BM_EXT_MASK) == 0)
-				break;
-			/* now, is it actually dirty, after all?
-			 * caution, drbd_bm_test_bit is tri-state for some
-			 * obscure reason; ( b == 0 ) would get the out-of-band
-			 * only accidentally right because of the "oddly sized"
-			 * adjustment below */
-			if (drbd_bm_test_bit(mdev, bit+1) != 1)
+			if (bit + 1 >= run_end)
 				break;
 			bit++;
 			size += BM_BLOCK_SIZE;
@@ -633,12 +789,14 @@ next_sector:
 				goto requeue;
 			case 0:
 				/* everything ok */
+				drbd_rs_rtt_probe(mdev, sector);
 				break;
 			default:
 				BUG();
 			}
 		} else {
 			inc_rs_pending(mdev);
+			drbd_rs_rtt_probe(mdev, sector);
 			if (!drbd_send_drequest(mdev, P_RS_DATA_REQUEST,
 					       sector, size, ID_SYNCER)) {
 				dev_err(DEV, "drbd_send_drequest() failed, aborting...\n");
@@ -1038,10 +1196,16 @@ int w_e_end_csum_rs_req(struct drbd_conf *mdev, struct drbd_work *w, int cancel)
 		if (mdev->csums_tfm) {
 			digest_size = crypto_hash_digestsize(mdev->csums_tfm);
 			D_ASSERT(digest_size == di->digest_size);
-			digest = kmalloc(digest_size, GFP_NOIO);
+			/* usually already done by drbd_csum_work_fn() */
+			digest = e->csum;
+			e->csum = NULL;
+			if (!digest) {
+				digest = kmalloc(digest_size, GFP_NOIO);
+				if (digest)
+					drbd_csum_ee(mdev, mdev->csums_tfm, e, digest);
+			}
 		}
 		if (digest) {
-			drbd_csum_ee(mdev, mdev->csums_tfm, e, digest);
 			eq = !memcmp(digest, di->digest, digest_size);
 			kfree(digest);
 		}
@@ -1460,6 +1624,8 @@ void drbd_rs_controller_reset(struct drbd_conf *mdev)
 	mdev->rs_in_flight = 0;
 	mdev->rs_planed = 0;
 	spin_lock(&mdev->peer_seq_lock);
+	mdev->rs_rtt_sector = ~(sector_t)0;
+	mdev->rs_srtt = 0;
 	fifo_set(&mdev->rs_plan_s, 0);
 	spin_unlock(&mdev->peer_seq_lock);
 }
@@ -60,6 +60,26 @@ static int xen_blkif_reqs = 64;
 module_param_named(reqs, xen_blkif_reqs, int, 0);
 MODULE_PARM_DESC(reqs, "Number of blkback requests to allocate");
 
+/*
+ * Upper bound of request rings a frontend may open per device, each of
+ * them served by its own thread.  Defaults to the number of online cpus.
+ */
+unsigned int xen_blkif_max_queues;
+module_param_named(max_queues, xen_blkif_max_queues, uint, 0444);
+MODULE_PARM_DESC(max_queues, "Maximum number of request rings per device");
+
+/*
+ * Maximum number of frontend pages a ring keeps mapped with
+ * "feature-persistent".  The default covers a full ring of
+ * maximum sized requests; beyond it, the least recently used
+ * grants are unmapped and reused.
+ */
+static unsigned int xen_blkif_max_pgrants =
+	__CONST_RING_SIZE(blkif, PAGE_SIZE) * BLKIF_MAX_SEGMENTS_PER_REQUEST;
+module_param_named(max_persistent_grants, xen_blkif_max_pgrants, uint, 0644);
+MODULE_PARM_DESC(max_persistent_grants,
+		 "Maximum number of grants to keep mapped per ring");
+
 /* Run-time switchable: /sys/module/blkback/parameters/ */
 static unsigned int log_stats;
 module_param(log_stats, int, 0644);
@@ -71,13 +91,16 @@ module_param(log_stats, int, 0644);
  * response queued for it, with the saved 'id' passed back.
  */
 struct pending_req {
-	struct xen_blkif	*blkif;
+	struct xen_blkif_ring	*ring;
 	u64			id;
 	int			nr_pages;
 	atomic_t		pendcnt;
 	unsigned short		operation;
 	int			status;
 	struct list_head	free_list;
+	/* The pages under I/O; persistent ones are not unmapped at the end. */
+	struct page		*pages[BLKIF_MAX_SEGMENTS_PER_REQUEST];
+	struct persistent_gnt	*persistent_gnts[BLKIF_MAX_SEGMENTS_PER_REQUEST];
 };
 
 #define BLKBACK_INVALID_HANDLE (~0)
@@ -121,11 +144,11 @@ static inline unsigned long vaddr(struct pending_req *req, int seg)
 	(blkbk->pending_grant_handles[vaddr_pagenr(_req, _seg)])
 
 
-static int do_block_io_op(struct xen_blkif *blkif);
-static int dispatch_rw_block_io(struct xen_blkif *blkif,
+static int do_block_io_op(struct xen_blkif_ring *ring);
+static int dispatch_rw_block_io(struct xen_blkif_ring *ring,
 				struct blkif_request *req,
 				struct pending_req *pending_req);
-static void make_response(struct xen_blkif *blkif, u64 id,
+static void make_response(struct xen_blkif_ring *ring, u64 id,
 			  unsigned short op, int st);
 
 /*
@@ -240,10 +263,10 @@ abort:
 /*
  * Notification from the guest OS.
  */
-static void blkif_notify_work(struct xen_blkif *blkif)
+static void blkif_notify_work(struct xen_blkif_ring *ring)
 {
-	blkif->waiting_reqs = 1;
-	wake_up(&blkif->wq);
+	ring->waiting_reqs = 1;
+	wake_up(&ring->wq);
 }
 
 irqreturn_t xen_blkif_be_int(int irq, void *dev_id)
@@ -269,39 +292,42 @@ static void print_stats(struct xen_blkif *blkif)
 
 int xen_blkif_schedule(void *arg)
 {
-	struct xen_blkif *blkif = arg;
+	struct xen_blkif_ring *ring = arg;
+	struct xen_blkif *blkif = ring->blkif;
 	struct xen_vbd *vbd = &blkif->vbd;
+	/* resize and statistics are per device, the first ring does them */
+	bool first = ring == &blkif->rings[0];
 
 	xen_blkif_get(blkif);
 
 	while (!kthread_should_stop()) {
 		if (try_to_freeze())
 			continue;
-		if (unlikely(vbd->size != vbd_sz(vbd)))
+		if (unlikely(first && vbd->size != vbd_sz(vbd)))
 			xen_vbd_resize(blkif);
 
 		wait_event_interruptible(
-			blkif->wq,
-			blkif->waiting_reqs || kthread_should_stop());
+			ring->wq,
+			ring->waiting_reqs || kthread_should_stop());
 		wait_event_interruptible(
 			blkbk->pending_free_wq,
 			!list_empty(&blkbk->pending_free) ||
 			kthread_should_stop());
 
-		blkif->waiting_reqs = 0;
+		ring->waiting_reqs = 0;
 		smp_mb(); /* clear flag *before* checking for work */
 
-		if (do_block_io_op(blkif))
-			blkif->waiting_reqs = 1;
+		if (do_block_io_op(ring))
+			ring->waiting_reqs = 1;
 
-		if (log_stats && time_after(jiffies, blkif->st_print))
+		if (first && log_stats && time_after(jiffies, blkif->st_print))
 			print_stats(blkif);
 	}
 
-	if (log_stats)
+	if (first && log_stats)
 		print_stats(blkif);
 
-	blkif->xenblkd = NULL;
+	ring->xenblkd = NULL;
 	xen_blkif_put(blkif);
 
 	return 0;
@@ -311,9 +337,151 @@ struct seg_buf {
 	unsigned long buf;
 	unsigned int nsec;
 };
+
+/*
+ * Persistent grants.  The tree, the LRU list and the counter are only
+ * modified by the ring's thread; completions merely drop the ACTIVE bit.
+ */
+static struct persistent_gnt *lookup_persistent_gnt(struct xen_blkif_ring *ring,
+						    grant_ref_t gref)
+{
+	struct rb_node *node = ring->persistent_gnts.rb_node;
+	struct persistent_gnt *pgnt;
+
+	while (node) {
+		pgnt = rb_entry(node, struct persistent_gnt, node);
+		if (gref < pgnt->gnt)
+			node = node->rb_left;
+		else if (gref > pgnt->gnt)
+			node = node->rb_right;
+		else
+			return pgnt;
+	}
+	return NULL;
+}
+
+static void add_persistent_gnt(struct xen_blkif_ring *ring,
+			       struct persistent_gnt *pgnt)
+{
+	struct rb_node **new = &ring->persistent_gnts.rb_node;
+	struct rb_node *parent = NULL;
+	struct persistent_gnt *this;
+
+	while (*new) {
+		this = rb_entry(*new, struct persistent_gnt, node);
+		parent = *new;
+		/* lookup_persistent_gnt() failed for it just before */
+		BUG_ON(pgnt->gnt == this->gnt);
+		if (pgnt->gnt < this->gnt)
+			new = &((*new)->rb_left);
+		else
+			new = &((*new)->rb_right);
+	}
+	rb_link_node(&pgnt->node, parent, new);
+	rb_insert_color(&pgnt->node, &ring->persistent_gnts);
+	list_add(&pgnt->lru, &ring->persistent_lru);
+}
+
+static void remove_persistent_gnt(struct xen_blkif_ring *ring,
+				  struct persistent_gnt *pgnt)
+{
+	rb_erase(&pgnt->node, &ring->persistent_gnts);
+	list_del(&pgnt->lru);
+}
+
+static void unmap_persistent_gnts(struct persistent_gnt **pgnts, int n)
+{
+	struct gnttab_unmap_grant_ref unmap[BLKIF_MAX_SEGMENTS_PER_REQUEST];
+	int i, ret;
+
+	for (i = 0; i < n; i++)
+		gnttab_set_unmap_op(&unmap[i],
+			(unsigned long)pfn_to_kaddr(page_to_pfn(pgnts[i]->page)),
+			GNTMAP_host_map, pgnts[i]->handle);
+
+	ret = HYPERVISOR_grant_table_op(GNTTABOP_unmap_grant_ref, unmap, n);
+	BUG_ON(ret);
+
+	for (i = 0; i < n; i++) {
+		if (m2p_remove_override(pgnts[i]->page, false))
+			pr_alert(DRV_PFX "Failed to remove M2P override for %lx\n",
+				 (unsigned long)unmap[i].host_addr);
+	}
+}
+
+static void free_persistent_gnt(struct xen_blkif_ring *ring,
+				struct persistent_gnt *pgnt)
+{
+	__free_page(pgnt->page);
+	kfree(pgnt);
+	ring->persistent_gnt_c--;
+}
+
+/*
+ * Get an unmapped persistent grant, ACTIVE already: a new one while the
+ * ring is below max_persistent_grants, else the least recently used one
+ * which is not under I/O.  NULL means: map this segment per request.
+ */
+static struct persistent_gnt *get_free_persistent_gnt(struct xen_blkif_ring *ring)
+{
+	struct persistent_gnt *pgnt;
+
+	if (ring->persistent_gnt_c < xen_blkif_max_pgrants) {
+		pgnt = kmalloc(sizeof(*pgnt), GFP_KERNEL);
+		if (!pgnt)
+			return NULL;
+		pgnt->page = alloc_page(GFP_KERNEL);
+		if (!pgnt->page) {
+			kfree(pgnt);
+			return NULL;
+		}
+		ring->persistent_gnt_c++;
+		goto out;
+	}
+
+	list_for_each_entry_reverse(pgnt, &ring->persistent_lru, lru) {
+		if (test_bit(PERSISTENT_GNT_ACTIVE, &pgnt->flags))
+			continue;
+		remove_persistent_gnt(ring, pgnt);
+		unmap_persistent_gnts(&pgnt, 1);
+		goto out;
+	}
+	return NULL;
+
+ out:
+	pgnt->flags = 1 << PERSISTENT_GNT_ACTIVE;
+	return pgnt;
+}
+
+/*
+ * Unmap and free all persistent grants of a ring.  No request may
+ * be in flight any more, see xen_blkif_disconnect().
+ */
+void xen_blkbk_free_persistent_gnts(struct xen_blkif_ring *ring)
+{
+	struct persistent_gnt *pgnts[BLKIF_MAX_SEGMENTS_PER_REQUEST];
+	struct persistent_gnt *pgnt, *tmp;
+	int i, n = 0;
+
+	list_for_each_entry_safe(pgnt, tmp, &ring->persistent_lru, lru) {
+		BUG_ON(test_bit(PERSISTENT_GNT_ACTIVE, &pgnt->flags));
+		remove_persistent_gnt(ring, pgnt);
+		pgnts[n++] = pgnt;
+		if (n == BLKIF_MAX_SEGMENTS_PER_REQUEST ||
+		    list_empty(&ring->persistent_lru)) {
+			unmap_persistent_gnts(pgnts, n);
+			for (i = 0; i < n; i++)
+				free_persistent_gnt(ring, pgnts[i]);
+			n = 0;
+		}
+	}
+	BUG_ON(ring->persistent_gnt_c != 0);
+}
+
 /*
  * Unmap the grant references, and also remove the M2P over-rides
- * used in the 'pending_req'.
+ * used in the 'pending_req'.  Persistent grants stay mapped, they
+ * are only released for reuse.
  */
 static void xen_blkbk_unmap(struct pending_req *req)
 {
@@ -323,6 +491,12 @@ static void xen_blkbk_unmap(struct pending_req *req)
 	int ret;
 
 	for (i = 0; i < req->nr_pages; i++) {
+		if (req->persistent_gnts[i]) {
+			clear_bit(PERSISTENT_GNT_ACTIVE,
+				  &req->persistent_gnts[i]->flags);
+			req->persistent_gnts[i] = NULL;
+			continue;
+		}
 		handle = pending_handle(req, i);
 		if (handle == BLKBACK_INVALID_HANDLE)
 			continue;
@@ -332,6 +506,9 @@ static void xen_blkbk_unmap(struct pending_req *req)
 		invcount++;
 	}
 
+	if (!invcount)
+		return;
+
 	ret = HYPERVISOR_grant_table_op(
 		GNTTABOP_unmap_grant_ref, unmap, invcount);
 	BUG_ON(ret);
@@ -355,56 +532,119 @@ static int xen_blkbk_map(struct blkif_request *req,
 			 struct seg_buf seg[])
 {
 	struct gnttab_map_grant_ref map[BLKIF_MAX_SEGMENTS_PER_REQUEST];
-	int i;
+	/* segment number of each map[] entry */
+	int map_seg[BLKIF_MAX_SEGMENTS_PER_REQUEST];
+	struct xen_blkif_ring *ring = pending_req->ring;
+	struct persistent_gnt *pgnt;
+	struct page *page;
+	int i, j, nmap = 0;
 	int nseg = req->nr_segments;
-	int ret = 0;
+	int ret = 0, err;
 
 	/*
 	 * Fill out preq.nr_sects with proper amount of sectors, and setup
 	 * assign map[..] with the PFN of the page in our domain with the
-	 * corresponding grant reference for each page.
+	 * corresponding grant reference for each page.  Segments whose
+	 * grant is still mapped persistently need no hypercall at all.
 	 */
 	for (i = 0; i < nseg; i++) {
 		uint32_t flags;
+		grant_ref_t gref = req->u.rw.seg[i].gref;
+
+		pgnt = NULL;
+		pending_handle(pending_req, i) = BLKBACK_INVALID_HANDLE;
+		if (ring->blkif->vbd.feature_gnt_persistent) {
+			pgnt = lookup_persistent_gnt(ring, gref);
+			if (pgnt) {
+				/* the same grant twice in flight?  Then
+				 * map it once more, for this request only */
+				if (test_and_set_bit(PERSISTENT_GNT_ACTIVE,
+						     &pgnt->flags)) {
+					pgnt = NULL;
+				} else {
+					list_move(&pgnt->lru, &ring->persistent_lru);
+					pending_req->persistent_gnts[i] = pgnt;
+					pending_req->pages[i] = pgnt->page;
+					seg[i].buf = pgnt->dev_bus_addr |
+						(req->u.rw.seg[i].first_sect << 9);
+					continue;
+				}
+			} else {
+				pgnt = get_free_persistent_gnt(ring);
+				if (pgnt) {
+					pgnt->gnt = gref;
+					add_persistent_gnt(ring, pgnt);
+				}
+			}
+		}
+		pending_req->persistent_gnts[i] = pgnt;
 
+		/* persistent grants serve reads and writes alike */
 		flags = GNTMAP_host_map;
-		if (pending_req->operation != BLKIF_OP_READ)
-			flags |= GNTMAP_readonly;
-		gnttab_set_map_op(&map[i], vaddr(pending_req, i), flags,
-				  req->u.rw.seg[i].gref,
-				  pending_req->blkif->domid);
+		if (pgnt) {
+			page = pgnt->page;
+		} else {
+			page = blkbk->pending_page(pending_req, i);
+			if (pending_req->operation != BLKIF_OP_READ)
+				flags |= GNTMAP_readonly;
+		}
+		pending_req->pages[i] = page;
+		gnttab_set_map_op(&map[nmap],
+				  (unsigned long)pfn_to_kaddr(page_to_pfn(page)),
+				  flags, gref, ring->blkif->domid);
+		map_seg[nmap++] = i;
 	}
 
-	ret = HYPERVISOR_grant_table_op(GNTTABOP_map_grant_ref, map, nseg);
-	BUG_ON(ret);
+	if (!nmap)
+		return 0;
+
+	err = HYPERVISOR_grant_table_op(GNTTABOP_map_grant_ref, map, nmap);
+	BUG_ON(err);
 
 	/*
 	 * Now swizzle the MFN in our domain with the MFN from the other domain
-	 * so that when we access vaddr(pending_req,i) it has the contents of
-	 * the page from the other domain.
+	 * so that when we access the page it has the contents of the page
+	 * from the other domain.
 	 */
-	for (i = 0; i < nseg; i++) {
-		if (unlikely(map[i].status != 0)) {
+	for (j = 0; j < nmap; j++) {
+		i = map_seg[j];
+		pgnt = pending_req->persistent_gnts[i];
+
+		if (unlikely(map[j].status != 0)) {
 			pr_debug(DRV_PFX "invalid buffer -- could not remap it\n");
-			map[i].handle = BLKBACK_INVALID_HANDLE;
+			if (pgnt) {
+				remove_persistent_gnt(ring, pgnt);
+				free_persistent_gnt(ring, pgnt);
+				pending_req->persistent_gnts[i] = NULL;
+			}
 			ret |= 1;
+			continue;
 		}
 
-		pending_handle(pending_req, i) = map[i].handle;
-
-		if (ret)
-			continue;
+		if (pgnt) {
+			pgnt->handle = map[j].handle;
+			pgnt->dev_bus_addr = map[j].dev_bus_addr;
+		} else {
+			pending_handle(pending_req, i) = map[j].handle;
+		}
 
-		ret = m2p_add_override(PFN_DOWN(map[i].dev_bus_addr),
-			blkbk->pending_page(pending_req, i), false);
-		if (ret) {
+		err = m2p_add_override(PFN_DOWN(map[j].dev_bus_addr),
+				       pending_req->pages[i], false);
+		if (err) {
 			pr_alert(DRV_PFX "Failed to install M2P override for %lx (ret: %d)\n",
-				 (unsigned long)map[i].dev_bus_addr, ret);
+				 (unsigned long)map[j].dev_bus_addr, err);
 			/* We could switch over to GNTTABOP_copy */
+			if (pgnt) {
+				remove_persistent_gnt(ring, pgnt);
+				unmap_persistent_gnts(&pgnt, 1);
+				free_persistent_gnt(ring, pgnt);
+				pending_req->persistent_gnts[i] = NULL;
+			}
+			ret |= 1;
 			continue;
 		}
 
-		seg[i].buf  = map[i].dev_bus_addr |
+		seg[i].buf  = map[j].dev_bus_addr |
 			(req->u.rw.seg[i].first_sect << 9);
 	}
 	return ret;
@@ -420,7 +660,7 @@ static void __end_block_io_op(struct pending_req *pending_req, int error)
 	if ((pending_req->operation == BLKIF_OP_FLUSH_DISKCACHE) &&
 	    (error == -EOPNOTSUPP)) {
 		pr_debug(DRV_PFX "flush diskcache op failed, not supported\n");
-		xen_blkbk_flush_diskcache(XBT_NIL, pending_req->blkif->be, 0);
+		xen_blkbk_flush_diskcache(XBT_NIL, pending_req->ring->blkif->be, 0);
 		pending_req->status = BLKIF_RSP_EOPNOTSUPP;
 	} else if (error) {
 		pr_debug(DRV_PFX "Buffer not up-to-date at end of operation,"
@@ -434,10 +674,12 @@ static void __end_block_io_op(struct pending_req *pending_req, int error)
 	 * the proper response on the ring.
 	 */
 	if (atomic_dec_and_test(&pending_req->pendcnt)) {
+		struct xen_blkif *blkif = pending_req->ring->blkif;
+
 		xen_blkbk_unmap(pending_req);
-		make_response(pending_req->blkif, pending_req->id,
+		make_response(pending_req->ring, pending_req->id,
 			      pending_req->operation, pending_req->status);
-		xen_blkif_put(pending_req->blkif);
+		xen_blkif_put(blkif);
 		free_req(pending_req);
 	}
 }
@@ -459,9 +701,10 @@ static void end_block_io_op(struct bio *bio, int error)
  * and transmute  it to the block API to hand it over to the proper block disk.
  */
 static int
-__do_block_io_op(struct xen_blkif *blkif)
+__do_block_io_op(struct xen_blkif_ring *ring)
 {
-	union blkif_back_rings *blk_rings = &blkif->blk_rings;
+	struct xen_blkif *blkif = ring->blkif;
+	union blkif_back_rings *blk_rings = &ring->blk_rings;
 	struct blkif_request req;
 	struct pending_req *pending_req;
 	RING_IDX rc, rp;
@@ -506,7 +749,7 @@ __do_block_io_op(struct xen_blkif *blkif)
 		/* Apply all sanity checks to /private copy/ of request. */
 		barrier();
 
-		if (dispatch_rw_block_io(blkif, &req, pending_req))
+		if (dispatch_rw_block_io(ring, &req, pending_req))
 			break;
 
 		/* Yield point for this unbounded loop. */
@@ -517,13 +760,13 @@ __do_block_io_op(struct xen_blkif *blkif)
 }
 
 static int
-do_block_io_op(struct xen_blkif *blkif)
+do_block_io_op(struct xen_blkif_ring *ring)
 {
-	union blkif_back_rings *blk_rings = &blkif->blk_rings;
+	union blkif_back_rings *blk_rings = &ring->blk_rings;
 	int more_to_do;
 
 	do {
-		more_to_do = __do_block_io_op(blkif);
+		more_to_do = __do_block_io_op(ring);
 		if (more_to_do)
 			break;
 
@@ -537,10 +780,11 @@ do_block_io_op(struct xen_blkif *blkif)
  * Transmutation of the 'struct blkif_request' to a proper 'struct bio'
  * and call the 'submit_bio' to pass it to the underlying storage.
  */
-static int dispatch_rw_block_io(struct xen_blkif *blkif,
+static int dispatch_rw_block_io(struct xen_blkif_ring *ring,
 				struct blkif_request *req,
 				struct pending_req *pending_req)
 {
+	struct xen_blkif *blkif = ring->blkif;
 	struct phys_req preq;
 	struct seg_buf seg[BLKIF_MAX_SEGMENTS_PER_REQUEST];
 	unsigned int nseg;
@@ -584,7 +828,7 @@ static int dispatch_rw_block_io(struct xen_blkif *blkif,
 	preq.sector_number = req->u.rw.sector_number;
 	preq.nr_sects      = 0;
 
-	pending_req->blkif     = blkif;
+	pending_req->ring      = ring;
 	pending_req->id        = req->id;
 	pending_req->operation = req->operation;
 	pending_req->status    = BLKIF_RSP_OKAY;
@@ -636,7 +880,7 @@ static int dispatch_rw_block_io(struct xen_blkif *blkif,
 	for (i = 0; i < nseg; i++) {
 		while ((bio == NULL) ||
 		       (bio_add_page(bio,
-				     blkbk->pending_page(pending_req, i),
+				     pending_req->pages[i],
 				     seg[i].nsec << 9,
 				     seg[i].buf & ~PAGE_MASK) == 0)) {
 
@@ -694,7 +938,7 @@ static int dispatch_rw_block_io(struct xen_blkif *blkif,
 	xen_blkbk_unmap(pending_req);
  fail_response:
 	/* Haven't submitted any bio's yet. */
-	make_response(blkif, req->id, req->operation, BLKIF_RSP_ERROR);
+	make_response(ring, req->id, req->operation, BLKIF_RSP_ERROR);
 	free_req(pending_req);
 	msleep(1); /* back off a bit */
 	return -EIO;
@@ -712,21 +956,21 @@ static int dispatch_rw_block_io(struct xen_blkif *blkif,
 /*
  * Put a response on the ring on how the operation fared.
  */
-static void make_response(struct xen_blkif *blkif, u64 id,
+static void make_response(struct xen_blkif_ring *ring, u64 id,
 			  unsigned short op, int st)
 {
 	struct blkif_response  resp;
 	unsigned long     flags;
-	union blkif_back_rings *blk_rings = &blkif->blk_rings;
+	union blkif_back_rings *blk_rings = &ring->blk_rings;
 	int notify;
 
 	resp.id        = id;
 	resp.operation = op;
 	resp.status    = st;
 
-	spin_lock_irqsave(&blkif->blk_ring_lock, flags);
+	spin_lock_irqsave(&ring->blk_ring_lock, flags);
 	/* Place on the response ring for the relevant domain. */
-	switch (blkif->blk_protocol) {
+	switch (ring->blkif->blk_protocol) {
 	case BLKIF_PROTOCOL_NATIVE:
 		memcpy(RING_GET_RESPONSE(&blk_rings->native, blk_rings->native.rsp_prod_pvt),
 		       &resp, sizeof(resp));
@@ -744,9 +988,9 @@ static void make_response(struct xen_blkif *blkif, u64 id,
 	}
 	blk_rings->common.rsp_prod_pvt++;
 	RING_PUSH_RESPONSES_AND_CHECK_NOTIFY(&blk_rings->common, notify);
-	spin_unlock_irqrestore(&blkif->blk_ring_lock, flags);
+	spin_unlock_irqrestore(&ring->blk_ring_lock, flags);
 	if (notify)
-		notify_remote_via_irq(blkif->irq);
+		notify_remote_via_irq(ring->irq);
 }
 
 static int __init xen_blkif_init(void)
@@ -757,6 +1001,9 @@ static int __init xen_blkif_init(void)
 	if (!xen_pv_domain())
 		return -ENODEV;
 
+	if (!xen_blkif_max_queues)
+		xen_blkif_max_queues = num_online_cpus();
+
 	blkbk = kzalloc(sizeof(struct xen_blkbk), GFP_KERNEL);
 	if (!blkbk) {
 		pr_alert(DRV_PFX "%s: out of memory!\n", __func__);
@@ -35,6 +35,7 @@
 #include <linux/vmalloc.h>
 #include <linux/wait.h>
 #include <linux/io.h>
+#include <linux/rbtree.h>
 #include <asm/setup.h>
 #include <asm/pgalloc.h>
 #include <asm/hypervisor.h>
@@ -126,34 +127,73 @@ struct xen_vbd {
 	/* Cached size parameter. */
 	sector_t		size;
 	bool			flush_support;
+	/* The frontend keeps its grants stable, we may keep them mapped. */
+	bool			feature_gnt_persistent;
 };
 
 struct backend_info;
 
+/*
+ * A frontend page which stays mapped across requests, see
+ * "feature-persistent".  Looked up by grant reference in the ring's
+ * rb-tree, and recycled in least recently used order once the ring
+ * holds max_persistent_grants of them.
+ */
+struct persistent_gnt {
+	struct page		*page;
+	grant_ref_t		gnt;
+	grant_handle_t		handle;
+	uint64_t		dev_bus_addr;
+	/* PERSISTENT_GNT_ACTIVE while a request has the page under I/O. */
+	unsigned long		flags;
+	struct rb_node		node;
+	struct list_head	lru;
+};
+
+#define PERSISTENT_GNT_ACTIVE	0
+
+/* One request ring of a blkif, and the thread serving it. */
+struct xen_blkif_ring {
+	/* Physical parameters of the comms window. */
+	unsigned int		irq;
+	union blkif_back_rings	blk_rings;
+	struct vm_struct	*blk_ring_area;
+	spinlock_t		blk_ring_lock;
+
+	wait_queue_head_t	wq;
+	/* One thread per ring. */
+	struct task_struct	*xenblkd;
+	unsigned int		waiting_reqs;
+
+	/* Only touched by xenblkd, except for the ACTIVE bits. */
+	struct rb_root		persistent_gnts;
+	struct list_head	persistent_lru;
+	unsigned int		persistent_gnt_c;
+
+	grant_handle_t		shmem_handle;
+	grant_ref_t		shmem_ref;
+
+	/* Back pointer to the blkif. */
+	struct xen_blkif	*blkif;
+};
+
 struct xen_blkif {
 	/* Unique identifier for this interface. */
 	domid_t			domid;
 	unsigned int		handle;
-	/* Physical parameters of the comms window. */
-	unsigned int		irq;
 	/* Comms information. */
 	enum blkif_protocol	blk_protocol;
-	union blkif_back_rings	blk_rings;
-	struct vm_struct	*blk_ring_area;
+	/* Request rings, xen_blkif_max_queues allocated, nr_rings in use. */
+	struct xen_blkif_ring	*rings;
+	unsigned int		nr_rings;
 	/* The VBD attached to this interface. */
 	struct xen_vbd		vbd;
 	/* Back pointer to the backend_info. */
 	struct backend_info	*be;
 	/* Private fields. */
-	spinlock_t		blk_ring_lock;
 	atomic_t		refcnt;
 
-	wait_queue_head_t	wq;
-	/* One thread per one blkif. */
-	struct task_struct	*xenblkd;
-	unsigned int		waiting_reqs;
-
-	/* statistics */
+	/* statistics, updated by all ring threads without locking */
 	unsigned long		st_print;
 	int			st_rd_req;
 	int			st_wr_req;
@@ -163,9 +203,6 @@ struct xen_blkif {
 	int			st_wr_sect;
 
 	wait_queue_head_t	waiting_to_free;
-
-	grant_handle_t		shmem_handle;
-	grant_ref_t		shmem_ref;
 };
 
 
@@ -186,12 +223,15 @@ struct phys_req {
 	struct block_device	*bdev;
 	blkif_sector_t		sector_number;
 };
+extern unsigned int xen_blkif_max_queues;
+
 int xen_blkif_interface_init(void);
 
 int xen_blkif_xenbus_init(void);
 
 irqreturn_t xen_blkif_be_int(int irq, void *dev_id);
 int xen_blkif_schedule(void *arg);
+void xen_blkbk_free_persistent_gnts(struct xen_blkif_ring *ring);
 
 int xen_blkbk_flush_diskcache(struct xenbus_transaction xbt,
 			      struct backend_info *be, int state);
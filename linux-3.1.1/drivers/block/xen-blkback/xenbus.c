@@ -64,11 +64,13 @@ static int blkback_name(struct xen_blkif *blkif, char *buf)
 
 static void xen_update_blkif_status(struct xen_blkif *blkif)
 {
+	struct xen_blkif_ring *ring;
+	unsigned int i;
 	int err;
 	char name[TASK_COMM_LEN];
 
 	/* Not ready to connect? */
-	if (!blkif->irq || !blkif->vbd.bdev)
+	if (!blkif->nr_rings || !blkif->rings[0].irq || !blkif->vbd.bdev)
 		return;
 
 	/* Already connected? */
@@ -93,39 +95,63 @@ static void xen_update_blkif_status(struct xen_blkif *blkif)
 	}
 	invalidate_inode_pages2(blkif->vbd.bdev->bd_inode->i_mapping);
 
-	blkif->xenblkd = kthread_run(xen_blkif_schedule, blkif, name);
-	if (IS_ERR(blkif->xenblkd)) {
-		err = PTR_ERR(blkif->xenblkd);
-		blkif->xenblkd = NULL;
-		xenbus_dev_error(blkif->be->dev, err, "start xenblkd");
+	for (i = 0; i < blkif->nr_rings; i++) {
+		ring = &blkif->rings[i];
+		if (blkif->nr_rings == 1)
+			ring->xenblkd = kthread_run(xen_blkif_schedule, ring,
+						    "%s", name);
+		else
+			ring->xenblkd = kthread_run(xen_blkif_schedule, ring,
+						    "%s-%u", name, i);
+		if (IS_ERR(ring->xenblkd)) {
+			err = PTR_ERR(ring->xenblkd);
+			ring->xenblkd = NULL;
+			xenbus_dev_error(blkif->be->dev, err, "start xenblkd");
+			return;
+		}
 	}
 }
 
 static struct xen_blkif *xen_blkif_alloc(domid_t domid)
 {
 	struct xen_blkif *blkif;
+	struct xen_blkif_ring *ring;
+	unsigned int i;
 
 	blkif = kmem_cache_alloc(xen_blkif_cachep, GFP_KERNEL);
 	if (!blkif)
 		return ERR_PTR(-ENOMEM);
 
 	memset(blkif, 0, sizeof(*blkif));
+	blkif->rings = kcalloc(xen_blkif_max_queues, sizeof(*blkif->rings),
+			       GFP_KERNEL);
+	if (!blkif->rings) {
+		kmem_cache_free(xen_blkif_cachep, blkif);
+		return ERR_PTR(-ENOMEM);
+	}
+	for (i = 0; i < xen_blkif_max_queues; i++) {
+		ring = &blkif->rings[i];
+		spin_lock_init(&ring->blk_ring_lock);
+		init_waitqueue_head(&ring->wq);
+		ring->persistent_gnts = RB_ROOT;
+		INIT_LIST_HEAD(&ring->persistent_lru);
+		ring->blkif = blkif;
+	}
 	blkif->domid = domid;
-	spin_lock_init(&blkif->blk_ring_lock);
 	atomic_set(&blkif->refcnt, 1);
-	init_waitqueue_head(&blkif->wq);
 	blkif->st_print = jiffies;
 	init_waitqueue_head(&blkif->waiting_to_free);
 
 	return blkif;
 }
 
-static int map_frontend_page(struct xen_blkif *blkif, unsigned long shared_page)
+static int map_frontend_page(struct xen_blkif_ring *ring,
+			     unsigned long shared_page)
 {
 	struct gnttab_map_grant_ref op;
 
-	gnttab_set_map_op(&op, (unsigned long)blkif->blk_ring_area->addr,
-			  GNTMAP_host_map, shared_page, blkif->domid);
+	gnttab_set_map_op(&op, (unsigned long)ring->blk_ring_area->addr,
+			  GNTMAP_host_map, shared_page, ring->blkif->domid);
 
 	if (HYPERVISOR_grant_table_op(GNTTABOP_map_grant_ref, &op, 1))
 		BUG();
@@ -135,39 +161,40 @@ static int map_frontend_page(struct xen_blkif *blkif, unsigned long shared_page)
 		return op.status;
 	}
 
-	blkif->shmem_ref = shared_page;
-	blkif->shmem_handle = op.handle;
+	ring->shmem_ref = shared_page;
+	ring->shmem_handle = op.handle;
 
 	return 0;
 }
 
-static void unmap_frontend_page(struct xen_blkif *blkif)
+static void unmap_frontend_page(struct xen_blkif_ring *ring)
 {
 	struct gnttab_unmap_grant_ref op;
 
-	gnttab_set_unmap_op(&op, (unsigned long)blkif->blk_ring_area->addr,
-			    GNTMAP_host_map, blkif->shmem_handle);
+	gnttab_set_unmap_op(&op, (unsigned long)ring->blk_ring_area->addr,
+			    GNTMAP_host_map, ring->shmem_handle);
 
 	if (HYPERVISOR_grant_table_op(GNTTABOP_unmap_grant_ref, &op, 1))
 		BUG();
 }
 
-static int xen_blkif_map(struct xen_blkif *blkif, unsigned long shared_page,
+static int xen_blkif_map(struct xen_blkif_ring *ring, unsigned long shared_page,
 			 unsigned int evtchn)
 {
+	struct xen_blkif *blkif = ring->blkif;
 	int err;
 
 	/* Already connected through? */
-	if (blkif->irq)
+	if (ring->irq)
 		return 0;
 
-	blkif->blk_ring_area = alloc_vm_area(PAGE_SIZE);
-	if (!blkif->blk_ring_area)
+	ring->blk_ring_area = alloc_vm_area(PAGE_SIZE);
+	if (!ring->blk_ring_area)
 		return -ENOMEM;
 
-	err = map_frontend_page(blkif, shared_page);
+	err = map_frontend_page(ring, shared_page);
 	if (err) {
-		free_vm_area(blkif->blk_ring_area);
+		free_vm_area(ring->blk_ring_area);
 		return err;
 	}
 
@@ -175,22 +202,22 @@ static int xen_blkif_map(struct xen_blkif *blkif, unsigned long shared_page,
 	case BLKIF_PROTOCOL_NATIVE:
 	{
 		struct blkif_sring *sring;
-		sring = (struct blkif_sring *)blkif->blk_ring_area->addr;
-		BACK_RING_INIT(&blkif->blk_rings.native, sring, PAGE_SIZE);
+		sring = (struct blkif_sring *)ring->blk_ring_area->addr;
+		BACK_RING_INIT(&ring->blk_rings.native, sring, PAGE_SIZE);
 		break;
 	}
 	case BLKIF_PROTOCOL_X86_32:
 	{
 		struct blkif_x86_32_sring *sring_x86_32;
-		sring_x86_32 = (struct blkif_x86_32_sring *)blkif->blk_ring_area->addr;
-		BACK_RING_INIT(&blkif->blk_rings.x86_32, sring_x86_32, PAGE_SIZE);
+		sring_x86_32 = (struct blkif_x86_32_sring *)ring->blk_ring_area->addr;
+		BACK_RING_INIT(&ring->blk_rings.x86_32, sring_x86_32, PAGE_SIZE);
 		break;
 	}
 	case BLKIF_PROTOCOL_X86_64:
 	{
 		struct blkif_x86_64_sring *sring_x86_64;
-		sring_x86_64 = (struct blkif_x86_64_sring *)blkif->blk_ring_area->addr;
-		BACK_RING_INIT(&blkif->blk_rings.x86_64, sring_x86_64, PAGE_SIZE);
+		sring_x86_64 = (struct blkif_x86_64_sring *)ring->blk_ring_area->addr;
+		BACK_RING_INIT(&ring->blk_rings.x86_64, sring_x86_64, PAGE_SIZE);
 		break;
 	}
 	default:
@@ -199,45 +226,60 @@ static int xen_blkif_map(struct xen_blkif *blkif, unsigned long shared_page,
 
 	err = bind_interdomain_evtchn_to_irqhandler(blkif->domid, evtchn,
 						    xen_blkif_be_int, 0,
-						    "blkif-backend", blkif);
+						    "blkif-backend", ring);
 	if (err < 0) {
-		unmap_frontend_page(blkif);
-		free_vm_area(blkif->blk_ring_area);
-		blkif->blk_rings.common.sring = NULL;
+		unmap_frontend_page(ring);
+		free_vm_area(ring->blk_ring_area);
+		ring->blk_rings.common.sring = NULL;
 		return err;
 	}
-	blkif->irq = err;
+	ring->irq = err;
 
 	return 0;
 }
 
 static void xen_blkif_disconnect(struct xen_blkif *blkif)
 {
-	if (blkif->xenblkd) {
-		kthread_stop(blkif->xenblkd);
-		blkif->xenblkd = NULL;
+	struct xen_blkif_ring *ring;
+	unsigned int i;
+
+	for (i = 0; i < blkif->nr_rings; i++) {
+		ring = &blkif->rings[i];
+		if (ring->xenblkd) {
+			kthread_stop(ring->xenblkd);
+			ring->xenblkd = NULL;
+		}
 	}
 
 	atomic_dec(&blkif->refcnt);
 	wait_event(blkif->waiting_to_free, atomic_read(&blkif->refcnt) == 0);
 	atomic_inc(&blkif->refcnt);
 
-	if (blkif->irq) {
-		unbind_from_irqhandler(blkif->irq, blkif);
-		blkif->irq = 0;
-	}
+	for (i = 0; i < blkif->nr_rings; i++) {
+		ring = &blkif->rings[i];
 
-	if (blkif->blk_rings.common.sring) {
-		unmap_frontend_page(blkif);
-		free_vm_area(blkif->blk_ring_area);
-		blkif->blk_rings.common.sring = NULL;
+		if (ring->irq) {
+			unbind_from_irqhandler(ring->irq, ring);
+			ring->irq = 0;
+		}
+
+		if (ring->blk_rings.common.sring) {
+			unmap_frontend_page(ring);
+			free_vm_area(ring->blk_ring_area);
+			ring->blk_rings.common.sring = NULL;
+		}
+
+		/* no request in flight any more */
+		xen_blkbk_free_persistent_gnts(ring);
 	}
+	blkif->nr_rings = 0;
 }
 
 void xen_blkif_free(struct xen_blkif *blkif)
 {
 	if (!atomic_dec_and_test(&blkif->refcnt))
 		BUG();
+	kfree(blkif->rings);
 	kmem_cache_free(xen_blkif_cachep, blkif);
 }
 
@@ -454,6 +496,12 @@ static int xen_blkbk_probe(struct xenbus_device *dev,
 	if (err)
 		goto fail;
 
+	/* Frontends look for this before they set up their rings. */
+	err = xenbus_printf(XBT_NIL, dev->nodename, "multi-queue-max-queues",
+			    "%u", xen_blkif_max_queues);
+	if (err)
+		pr_warn(DRV_PFX "Error writing multi-queue-max-queues\n");
+
 	err = xenbus_switch_state(dev, XenbusStateInitWait);
 	if (err)
 		goto fail;
@@ -650,6 +698,13 @@ again:
 	if (err)
 		goto abort;
 
+	err = xenbus_printf(xbt, dev->nodename, "feature-persistent", "%u", 1);
+	if (err) {
+		xenbus_dev_fatal(dev, err, "writing %s/feature-persistent",
+				 dev->nodename);
+		goto abort;
+	}
+
 	err = xenbus_printf(xbt, dev->nodename, "sectors", "%llu",
 			    (unsigned long long)vbd_sz(&be->blkif->vbd));
 	if (err) {
@@ -693,25 +748,52 @@ again:
 }
 
 
-static int connect_ring(struct backend_info *be)
+/*
+ * Map one request ring.  A single ring is described directly in the
+ * frontend's directory, several rings in its queue-N subdirectories.
+ */
+static int connect_one_ring(struct backend_info *be, const char *dir,
+			    unsigned int i)
 {
 	struct xenbus_device *dev = be->dev;
 	unsigned long ring_ref;
 	unsigned int evtchn;
-	char protocol[64] = "";
 	int err;
 
-	DPRINTK("%s", dev->otherend);
-
-	err = xenbus_gather(XBT_NIL, dev->otherend, "ring-ref", "%lu",
+	err = xenbus_gather(XBT_NIL, dir, "ring-ref", "%lu",
 			    &ring_ref, "event-channel", "%u", &evtchn, NULL);
 	if (err) {
 		xenbus_dev_fatal(dev, err,
 				 "reading %s/ring-ref and event-channel",
-				 dev->otherend);
+				 dir);
+		return err;
+	}
+
+	pr_info(DRV_PFX "ring %u: ring-ref %ld, event-channel %d\n",
+		i, ring_ref, evtchn);
+
+	/* Map the shared frame, irq etc. */
+	err = xen_blkif_map(&be->blkif->rings[i], ring_ref, evtchn);
+	if (err) {
+		xenbus_dev_fatal(dev, err, "mapping ring-ref %lu port %u",
+				 ring_ref, evtchn);
 		return err;
 	}
 
+	return 0;
+}
+
+static int connect_ring(struct backend_info *be)
+{
+	struct xenbus_device *dev = be->dev;
+	unsigned int nr_rings, persistent;
+	unsigned int i;
+	char protocol[64] = "";
+	char *dir;
+	int err;
+
+	DPRINTK("%s", dev->otherend);
+
 	be->blkif->blk_protocol = BLKIF_PROTOCOL_NATIVE;
 	err = xenbus_gather(XBT_NIL, dev->otherend, "protocol",
 			    "%63s", protocol, NULL);
@@ -727,15 +809,39 @@ static int connect_ring(struct backend_info *be)
 		xenbus_dev_fatal(dev, err, "unknown fe protocol %s", protocol);
 		return -1;
 	}
-	pr_info(DRV_PFX "ring-ref %ld, event-channel %d, protocol %d (%s)\n",
-		ring_ref, evtchn, be->blkif->blk_protocol, protocol);
 
-	/* Map the shared frame, irq etc. */
-	err = xen_blkif_map(be->blkif, ring_ref, evtchn);
-	if (err) {
-		xenbus_dev_fatal(dev, err, "mapping ring-ref %lu port %u",
-				 ring_ref, evtchn);
-		return err;
+	err = xenbus_gather(XBT_NIL, dev->otherend, "feature-persistent",
+			    "%u", &persistent, NULL);
+	if (err)
+		persistent = 0;
+	be->blkif->vbd.feature_gnt_persistent = persistent;
+
+	err = xenbus_gather(XBT_NIL, dev->otherend, "multi-queue-num-queues",
+			    "%u", &nr_rings, NULL);
+	if (err)
+		nr_rings = 1;
+	if (nr_rings == 0 || nr_rings > xen_blkif_max_queues) {
+		xenbus_dev_fatal(dev, -EINVAL, "frontend asks for %u rings, max %u",
+				 nr_rings, xen_blkif_max_queues);
+		return -EINVAL;
+	}
+
+	pr_info(DRV_PFX "%u ring(s), protocol %d (%s)%s\n",
+		nr_rings, be->blkif->blk_protocol, protocol,
+		persistent ? ", persistent grants" : "");
+
+	be->blkif->nr_rings = nr_rings;
+	if (nr_rings == 1)
+		return connect_one_ring(be, dev->otherend, 0);
+
+	for (i = 0; i < nr_rings; i++) {
+		dir = kasprintf(GFP_KERNEL, "%s/queue-%u", dev->otherend, i);
+		if (!dir)
+			return -ENOMEM;
+		err = connect_one_ring(be, dir, i);
+		kfree(dir);
+		if (err)
+			return err;
 	}
 
 	return 0;
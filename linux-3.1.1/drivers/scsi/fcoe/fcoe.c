@@ -1638,6 +1638,29 @@ static inline int fcoe_filter_frames(struct fc_lport *lport,
 	return -EINVAL;
 }
 
+/**
+ * fcoe_frame_frags_ok() - Check if a received frame may stay non-linear
+ * @fp: The received frame
+ *
+ * Solicited FCP data for an exchange we originated is copied straight
+ * from the skb page fragments into the SCSI buffer by libfc, with the
+ * CRC computed during the copy, so there is no need to linearize it
+ * first. Frames with fill bytes stay linear because fc_exch_recv() trims
+ * the fill off the skb and libfc then reads it back from the head buffer
+ * for the CRC. Everything else is parsed in place and must be linear.
+ */
+static inline bool fcoe_frame_frags_ok(struct fc_frame *fp)
+{
+	struct sk_buff *skb = fp_skb(fp);
+	struct fc_frame_header *fh = fc_frame_header_get(fp);
+	u32 f_ctl = ntoh24(fh->fh_f_ctl);
+
+	return fh->fh_r_ctl == FC_RCTL_DD_SOL_DATA &&
+	       fh->fh_type == FC_TYPE_FCP &&
+	       (f_ctl & FC_FC_EX_CTX) && !FC_FC_FILL(f_ctl) &&
+	       !skb_has_frag_list(skb);
+}
+
 /**
  * fcoe_recv_frame() - process a single received frame
  * @skb: frame to process
@@ -1670,8 +1693,6 @@ static void fcoe_recv_frame(struct sk_buff *skb)
 			skb->dev ? skb->dev->name : "<NULL>");
 
 	port = lport_priv(lport);
-	if (skb_is_nonlinear(skb))
-		skb_linearize(skb);	/* not ideal */
 
 	/*
 	 * Frame length checks and setting up the header pointers
@@ -1709,6 +1730,9 @@ static void fcoe_recv_frame(struct sk_buff *skb)
 	fr_crc(fp) = crc_eof.fcoe_crc32;
 	if (pskb_trim(skb, fr_len))
 		goto drop;
+	if (skb_is_nonlinear(skb) && !fcoe_frame_frags_ok(fp) &&
+	    skb_linearize(skb))
+		goto drop;
 
 	if (!fcoe_filter_frames(lport, fp)) {
 		put_cpu();
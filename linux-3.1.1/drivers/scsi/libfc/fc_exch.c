@@ -40,6 +40,9 @@ static u16	fc_cpu_order;	/* 2's power to represent total possible cpus */
 static struct kmem_cache *fc_em_cachep;	       /* cache for exchanges */
 static struct workqueue_struct *fc_exch_workqueue;
 
+/* tag of a free exch pool slot, which holds the next free index instead */
+#define FC_EXCH_SLOT_FREE	1UL
+
 /*
  * Structure and function definitions for managing Fibre Channel Exchanges
  * and Sequences.
@@ -55,23 +58,21 @@ static struct workqueue_struct *fc_exch_workqueue;
 
 /**
  * struct fc_exch_pool - Per cpu exchange pool
- * @next_index:	  Next possible free exchange index
+ * @free_index:	  First slot on the free slot list
  * @total_exches: Total allocated exchanges
  * @lock:	  Exch pool lock
  * @ex_list:	  List of exchanges
  *
  * This structure manages per cpu exchanges in array of exchange pointers.
  * This array is allocated followed by struct fc_exch_pool memory for
- * assigned range of exchanges to per cpu pool.
+ * assigned range of exchanges to per cpu pool. Free slots in the array
+ * are chained into a LIFO list through the slots themselves, so that
+ * allocating an exchange never has to scan the array.
  */
 struct fc_exch_pool {
-	u16		 next_index;
+	u16		 free_index;
 	u16		 total_exches;
 
-	/* two cache of free slot in exch array */
-	u16		 left;
-	u16		 right;
-
 	spinlock_t	 lock;
 	struct list_head ex_list;
 };
@@ -83,7 +84,6 @@ struct fc_exch_pool {
  * @min_xid:	    Minimum exchange ID
  * @max_xid:	    Maximum exchange ID
  * @ep_pool:	    Reserved exchange pointers
- * @pool_max_index: Max exch array index in exch pool
  * @pool:	    Per cpu exch pool
  * @stats:	    Statistics structure
  *
@@ -96,7 +96,6 @@ struct fc_exch_mgr {
 	u16		min_xid;
 	u16		max_xid;
 	mempool_t	*ep_pool;
-	u16		pool_max_index;
 	struct fc_exch_pool *pool;
 
 	/*
@@ -379,7 +378,9 @@ static inline struct fc_exch *fc_exch_ptr_get(struct fc_exch_pool *pool,
 					      u16 index)
 {
 	struct fc_exch **exches = (struct fc_exch **)(pool + 1);
-	return exches[index];
+	unsigned long slot = (unsigned long)exches[index];
+
+	return slot & FC_EXCH_SLOT_FREE ? NULL : (struct fc_exch *)slot;
 }
 
 /**
@@ -394,6 +395,41 @@ static inline void fc_exch_ptr_set(struct fc_exch_pool *pool, u16 index,
 	((struct fc_exch **)(pool + 1))[index] = ep;
 }
 
+/**
+ * fc_exch_slot_put() - Put a slot on the free slot list of an exchange pool
+ * @pool:  The pool the slot belongs to
+ * @index: The index of the free slot
+ *
+ * A free slot holds the index of the next free slot, tagged with
+ * FC_EXCH_SLOT_FREE so fc_exch_ptr_get() reads it as empty.
+ */
+static inline void fc_exch_slot_put(struct fc_exch_pool *pool, u16 index)
+{
+	unsigned long slot = (unsigned long)pool->free_index << 1;
+
+	slot |= FC_EXCH_SLOT_FREE;
+	fc_exch_ptr_set(pool, index, (struct fc_exch *)slot);
+	pool->free_index = index;
+}
+
+/**
+ * fc_exch_slot_get() - Take a slot off the free slot list of an exchange pool
+ * @pool: The pool to take the slot from
+ *
+ * Returns FC_XID_UNKNOWN if the pool has no free slot left.
+ */
+static inline u16 fc_exch_slot_get(struct fc_exch_pool *pool)
+{
+	u16 index = pool->free_index;
+	unsigned long slot;
+
+	if (index != FC_XID_UNKNOWN) {
+		slot = (unsigned long)((struct fc_exch **)(pool + 1))[index];
+		pool->free_index = slot >> 1;
+	}
+	return index;
+}
+
 /**
  * fc_exch_delete() - Delete an exchange
  * @ep: The exchange to be deleted
@@ -408,16 +444,8 @@ static void fc_exch_delete(struct fc_exch *ep)
 	WARN_ON(pool->total_exches <= 0);
 	pool->total_exches--;
 
-	/* update cache of free slot */
 	index = (ep->xid - ep->em->min_xid) >> fc_cpu_order;
-	if (pool->left == FC_XID_UNKNOWN)
-		pool->left = index;
-	else if (pool->right == FC_XID_UNKNOWN)
-		pool->right = index;
-	else
-		pool->next_index = index;
-
-	fc_exch_ptr_set(pool, index, NULL);
+	fc_exch_slot_put(pool, index);
 	list_del(&ep->ex_list);
 	spin_unlock_bh(&pool->lock);
 	fc_exch_release(ep);	/* drop hold for exch in mp */
@@ -728,27 +756,11 @@ static struct fc_exch *fc_exch_em_alloc(struct fc_lport *lport,
 	spin_lock_bh(&pool->lock);
 	put_cpu();
 
-	/* peek cache of free slot */
-	if (pool->left != FC_XID_UNKNOWN) {
-		index = pool->left;
-		pool->left = FC_XID_UNKNOWN;
-		goto hit;
-	}
-	if (pool->right != FC_XID_UNKNOWN) {
-		index = pool->right;
-		pool->right = FC_XID_UNKNOWN;
-		goto hit;
-	}
+	/* most recently freed slot first, it is likely still cache hot */
+	index = fc_exch_slot_get(pool);
+	if (index == FC_XID_UNKNOWN)
+		goto err;
 
-	index = pool->next_index;
-	/* allocate new exch from pool */
-	while (fc_exch_ptr_get(pool, index)) {
-		index = index == mp->pool_max_index ? 0 : index + 1;
-		if (index == pool->next_index)
-			goto err;
-	}
-	pool->next_index = index == mp->pool_max_index ? 0 : index + 1;
-hit:
 	fc_exch_hold(ep);	/* hold for exch in mp */
 	spin_lock_init(&ep->ex_lock);
 	/*
@@ -2240,6 +2252,7 @@ struct fc_exch_mgr *fc_exch_mgr_alloc(struct fc_lport *lport,
 	size_t pool_size;
 	unsigned int cpu;
 	struct fc_exch_pool *pool;
+	u16 index;
 
 	if (max_xid <= min_xid || max_xid == FC_XID_UNKNOWN ||
 	    (min_xid & fc_cpu_mask) != 0) {
@@ -2270,7 +2283,6 @@ struct fc_exch_mgr *fc_exch_mgr_alloc(struct fc_lport *lport,
 	 * allocated for exch range per pool.
 	 */
 	pool_exch_range = (mp->max_xid - mp->min_xid + 1) / (fc_cpu_mask + 1);
-	mp->pool_max_index = pool_exch_range - 1;
 
 	/*
 	 * Allocate and initialize per cpu exch pool
@@ -2281,8 +2293,10 @@ struct fc_exch_mgr *fc_exch_mgr_alloc(struct fc_lport *lport,
 		goto free_mempool;
 	for_each_possible_cpu(cpu) {
 		pool = per_cpu_ptr(mp->pool, cpu);
-		pool->left = FC_XID_UNKNOWN;
-		pool->right = FC_XID_UNKNOWN;
+		/* chain all slots, lowest index at the head */
+		pool->free_index = FC_XID_UNKNOWN;
+		for (index = pool_exch_range; index-- > 0; )
+			fc_exch_slot_put(pool, index);
 		spin_lock_init(&pool->lock);
 		INIT_LIST_HEAD(&pool->ex_list);
 	}
@@ -483,13 +483,16 @@ static void fc_fcp_recv_data(struct fc_fcp_pkt *fsp, struct fc_frame *fp)
 	nents = scsi_sg_count(sc);
 
 	if (!(fr_flags(fp) & FCPHF_CRC_UNCHECKED)) {
-		copy_len = fc_copy_buffer_to_sglist(buf, len, sg, &nents,
-						    &offset, KM_SOFTIRQ0, NULL);
+		copy_len = fc_copy_frame_to_sglist(fp, len, sg, &nents,
+						   &offset, KM_SOFTIRQ0, NULL);
 	} else {
 		crc = crc32(~0, (u8 *) fh, sizeof(*fh));
-		copy_len = fc_copy_buffer_to_sglist(buf, len, sg, &nents,
-						    &offset, KM_SOFTIRQ0, &crc);
-		buf = fc_frame_payload_get(fp, 0);
+		copy_len = fc_copy_frame_to_sglist(fp, len, sg, &nents,
+						   &offset, KM_SOFTIRQ0, &crc);
+		/*
+		 * fc_exch_recv() trimmed the fill bytes off fr_len(), they
+		 * are still in the head buffer as fcoe linearizes such frames
+		 */
 		if (len % 4)
 			crc = crc32(crc, buf + len, 4 - (len % 4));
 
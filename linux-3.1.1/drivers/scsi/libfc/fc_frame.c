@@ -25,6 +25,7 @@
 #include <linux/skbuff.h>
 #include <linux/crc32.h>
 #include <linux/gfp.h>
+#include <linux/highmem.h>
 
 #include <scsi/fc_frame.h>
 
@@ -33,16 +34,34 @@
  */
 u32 fc_frame_crc_check(struct fc_frame *fp)
 {
+	struct sk_buff *skb = fp_skb(fp);
+	skb_frag_t *frag;
 	u32 crc;
 	u32 error;
 	const u8 *bp;
 	unsigned int len;
+	int i;
 
-	WARN_ON(!fc_frame_is_linear(fp));
 	fr_flags(fp) &= ~FCPHF_CRC_UNCHECKED;
-	len = (fr_len(fp) + 3) & ~3;	/* round up length to include fill */
 	bp = (const u8 *) fr_hdr(fp);
-	crc = ~crc32(~0, bp, len);
+	if (fc_frame_is_linear(fp)) {
+		/* round up length to include fill */
+		len = (fr_len(fp) + 3) & ~3;
+		crc = ~crc32(~0, bp, len);
+	} else {
+		/* fcoe only passes up non-linear frames without fill */
+		WARN_ON(fr_len(fp) % 4);
+		crc = crc32(~0, bp, skb_headlen(skb));
+		for (i = 0; i < skb_shinfo(skb)->nr_frags; i++) {
+			frag = &skb_shinfo(skb)->frags[i];
+			local_bh_disable();
+			bp = kmap_atomic(frag->page, KM_SKB_DATA_SOFTIRQ);
+			crc = crc32(crc, bp + frag->page_offset, frag->size);
+			kunmap_atomic((void *)bp, KM_SKB_DATA_SOFTIRQ);
+			local_bh_enable();
+		}
+		crc = ~crc;
+	}
 	error = crc ^ fr_crc(fp);
 	return error;
 }
@@ -21,6 +21,7 @@
 #include <linux/types.h>
 #include <linux/scatterlist.h>
 #include <linux/crc32.h>
+#include <linux/highmem.h>
 
 #include <scsi/libfc.h>
 #include <scsi/fc_encode.h>
@@ -95,24 +96,16 @@ static void __exit libfc_exit(void)
 }
 module_exit(libfc_exit);
 
-/**
- * fc_copy_buffer_to_sglist() - This routine copies the data of a buffer
- *				into a scatter-gather list (SG list).
- *
- * @buf: pointer to the data buffer.
- * @len: the byte-length of the data buffer.
- * @sg: pointer to the pointer of the SG list.
- * @nents: pointer to the remaining number of entries in the SG list.
- * @offset: pointer to the current offset in the SG list.
- * @km_type: dedicated page table slot type for kmap_atomic.
- * @crc: pointer to the 32-bit crc value.
- *	 If crc is NULL, CRC is not calculated.
+/*
+ * Copies a buffer into an sg list, advancing *sgp along with *offset and
+ * *nents so that the copy can be continued by a later call.
  */
-u32 fc_copy_buffer_to_sglist(void *buf, size_t len,
-			     struct scatterlist *sg,
-			     u32 *nents, size_t *offset,
-			     enum km_type km_type, u32 *crc)
+static u32 __fc_copy_buffer_to_sglist(void *buf, size_t len,
+				      struct scatterlist **sgp,
+				      u32 *nents, size_t *offset,
+				      enum km_type km_type, u32 *crc)
 {
+	struct scatterlist *sg = *sgp;
 	size_t remaining = len;
 	u32 copy_len = 0;
 
@@ -152,6 +145,82 @@ u32 fc_copy_buffer_to_sglist(void *buf, size_t len,
 		remaining -= sg_bytes;
 		copy_len += sg_bytes;
 	}
+	*sgp = sg;
+	return copy_len;
+}
+
+/**
+ * fc_copy_buffer_to_sglist() - This routine copies the data of a buffer
+ *				into a scatter-gather list (SG list).
+ *
+ * @buf: pointer to the data buffer.
+ * @len: the byte-length of the data buffer.
+ * @sg: pointer to the SG list.
+ * @nents: pointer to the remaining number of entries in the SG list.
+ * @offset: pointer to the current offset in the SG list.
+ * @km_type: dedicated page table slot type for kmap_atomic.
+ * @crc: pointer to the 32-bit crc value.
+ *	 If crc is NULL, CRC is not calculated.
+ */
+u32 fc_copy_buffer_to_sglist(void *buf, size_t len,
+			     struct scatterlist *sg,
+			     u32 *nents, size_t *offset,
+			     enum km_type km_type, u32 *crc)
+{
+	return __fc_copy_buffer_to_sglist(buf, len, &sg, nents, offset,
+					  km_type, crc);
+}
+
+/**
+ * fc_copy_frame_to_sglist() - This routine copies the payload of a frame
+ *			       into a scatter-gather list (SG list).
+ *
+ * @fp: the frame, whose payload may be held in skb page fragments.
+ * @len: the byte-length of the payload to copy.
+ * @sg: pointer to the SG list.
+ * @nents: pointer to the remaining number of entries in the SG list.
+ * @offset: pointer to the current offset in the SG list.
+ * @km_type: dedicated page table slot type for kmap_atomic.
+ * @crc: pointer to the 32-bit crc value.
+ *	 If crc is NULL, CRC is not calculated.
+ *
+ * The CRC of each piece is computed right before it is copied, while
+ * it is still cache hot, so a non-linear frame is only read once on
+ * its way into the SG list.
+ */
+u32 fc_copy_frame_to_sglist(struct fc_frame *fp, size_t len,
+			    struct scatterlist *sg,
+			    u32 *nents, size_t *offset,
+			    enum km_type km_type, u32 *crc)
+{
+	struct sk_buff *skb = fp_skb(fp);
+	skb_frag_t *frag;
+	size_t frag_len;
+	void *vaddr;
+	u32 copy_len;
+	int i;
+
+	frag_len = min_t(size_t, len,
+			 skb_headlen(skb) - sizeof(struct fc_frame_header));
+	copy_len = __fc_copy_buffer_to_sglist(fc_frame_payload_get(fp, 0),
+					      frag_len, &sg, nents, offset,
+					      km_type, crc);
+	len -= frag_len;
+
+	for (i = 0; len && i < skb_shinfo(skb)->nr_frags; i++) {
+		frag = &skb_shinfo(skb)->frags[i];
+		frag_len = min_t(size_t, len, frag->size);
+
+		local_bh_disable();
+		vaddr = kmap_atomic(frag->page, KM_SKB_DATA_SOFTIRQ);
+		copy_len += __fc_copy_buffer_to_sglist(vaddr +
+						       frag->page_offset,
+						       frag_len, &sg, nents,
+						       offset, km_type, crc);
+		kunmap_atomic(vaddr, KM_SKB_DATA_SOFTIRQ);
+		local_bh_enable();
+		len -= frag_len;
+	}
 	return copy_len;
 }
 
@@ -135,5 +135,9 @@ u32 fc_copy_buffer_to_sglist(void *buf, size_t len,
 			     struct scatterlist *sg,
 			     u32 *nents, size_t *offset,
 			     enum km_type km_type, u32 *crc);
+u32 fc_copy_frame_to_sglist(struct fc_frame *fp, size_t len,
+			    struct scatterlist *sg,
+			    u32 *nents, size_t *offset,
+			    enum km_type km_type, u32 *crc);
 
 #endif /* _FC_LIBFC_H_ */
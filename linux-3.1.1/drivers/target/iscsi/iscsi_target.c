@@ -1241,9 +1241,9 @@ static void iscsit_do_crypto_hash_buf(
 
 static int iscsit_handle_data_out(struct iscsi_conn *conn, unsigned char *buf)
 {
-	int iov_ret, ooo_cmdsn = 0, ret;
+	int iov_ret, ooo_cmdsn = 0, ret, rx_pipeline;
 	u8 data_crc_failed = 0;
-	u32 checksum, iov_count = 0, padding = 0, rx_got = 0;
+	u32 checksum, data_crc = 0, iov_count = 0, padding = 0, rx_got = 0;
 	u32 rx_size = 0, payload_length;
 	struct iscsi_cmd *cmd = NULL;
 	struct se_cmd *se_cmd;
@@ -1412,7 +1412,13 @@ static int iscsit_handle_data_out(struct iscsi_conn *conn, unsigned char *buf)
 		rx_size += ISCSI_CRC_LEN;
 	}
 
-	rx_got = rx_data(conn, &cmd->iov_data[0], iov_count, rx_size);
+	rx_pipeline = (conn->conn_ops->DataDigest &&
+		       ISCSI_TPG_ATTRIB(conn->tpg)->rx_digest_pipeline);
+	if (rx_pipeline)
+		rx_got = rx_data_hash(conn, &cmd->iov_data[0], iov_count,
+				rx_size, payload_length + padding, &data_crc);
+	else
+		rx_got = rx_data(conn, &cmd->iov_data[0], iov_count, rx_size);
 
 	iscsit_unmap_iovec(cmd);
 
@@ -1420,11 +1426,10 @@ static int iscsit_handle_data_out(struct iscsi_conn *conn, unsigned char *buf)
 		return -1;
 
 	if (conn->conn_ops->DataDigest) {
-		u32 data_crc;
-
-		data_crc = iscsit_do_crypto_hash_sg(&conn->conn_rx_hash, cmd,
-						    hdr->offset, payload_length, padding,
-						    cmd->pad_bytes);
+		if (!rx_pipeline)
+			data_crc = iscsit_do_crypto_hash_sg(&conn->conn_rx_hash,
+					cmd, hdr->offset, payload_length,
+					padding, cmd->pad_bytes);
 
 		if (checksum != data_crc) {
 			pr_err("ITT: 0x%08x, Offset: %u, Length: %u,"
@@ -1461,7 +1466,7 @@ static int iscsit_handle_data_out(struct iscsi_conn *conn, unsigned char *buf)
 		spin_unlock_bh(&cmd->istate_lock);
 
 		iscsit_stop_dataout_timer(cmd);
-		return (!ooo_cmdsn) ? transport_generic_handle_data(
+		return (!ooo_cmdsn) ? transport_generic_handle_data_direct(
 					&cmd->se_cmd) : 0;
 	} else /* DATAOUT_CANNOT_RECOVER */
 		return -1;
@@ -2280,8 +2285,8 @@ static int iscsit_handle_immediate_data(
 	unsigned char *buf,
 	u32 length)
 {
-	int iov_ret, rx_got = 0, rx_size = 0;
-	u32 checksum, iov_count = 0, padding = 0;
+	int iov_ret, rx_got = 0, rx_size = 0, rx_pipeline;
+	u32 checksum, data_crc = 0, iov_count = 0, padding = 0;
 	struct iscsi_conn *conn = cmd->conn;
 	struct kvec *iov;
 
@@ -2306,7 +2311,13 @@ static int iscsit_handle_immediate_data(
 		rx_size += ISCSI_CRC_LEN;
 	}
 
-	rx_got = rx_data(conn, &cmd->iov_data[0], iov_count, rx_size);
+	rx_pipeline = (conn->conn_ops->DataDigest &&
+		       ISCSI_TPG_ATTRIB(conn->tpg)->rx_digest_pipeline);
+	if (rx_pipeline)
+		rx_got = rx_data_hash(conn, &cmd->iov_data[0], iov_count,
+				rx_size, length + padding, &data_crc);
+	else
+		rx_got = rx_data(conn, &cmd->iov_data[0], iov_count, rx_size);
 
 	iscsit_unmap_iovec(cmd);
 
@@ -2316,11 +2327,10 @@ static int iscsit_handle_immediate_data(
 	}
 
 	if (conn->conn_ops->DataDigest) {
-		u32 data_crc;
-
-		data_crc = iscsit_do_crypto_hash_sg(&conn->conn_rx_hash, cmd,
-						    cmd->write_data_done, length, padding,
-						    cmd->pad_bytes);
+		if (!rx_pipeline)
+			data_crc = iscsit_do_crypto_hash_sg(&conn->conn_rx_hash,
+					cmd, cmd->write_data_done, length,
+					padding, cmd->pad_bytes);
 
 		if (checksum != data_crc) {
 			pr_err("ImmediateData CRC32C DataDigest 0x%08x"
@@ -3440,17 +3450,20 @@ static inline void iscsit_thread_check_cpumask(
 	int mode)
 {
 	char buf[128];
+	int *thread_cpu, rx_cpu;
 	/*
 	 * mode == 1 signals iscsi_target_tx_thread() usage.
 	 * mode == 0 signals iscsi_target_rx_thread() usage.
 	 */
 	if (mode == 1) {
+		thread_cpu = &conn->conn_tx_thread_cpu;
 		if (!conn->conn_tx_reset_cpumask)
-			return;
+			goto check_rx_cpu;
 		conn->conn_tx_reset_cpumask = 0;
 	} else {
+		thread_cpu = &conn->conn_rx_thread_cpu;
 		if (!conn->conn_rx_reset_cpumask)
-			return;
+			goto check_rx_cpu;
 		conn->conn_rx_reset_cpumask = 0;
 	}
 	/*
@@ -3465,6 +3478,73 @@ static inline void iscsit_thread_check_cpumask(
 			" %s for %s\n", buf, p->comm);
 #endif
 	set_cpus_allowed_ptr(p, conn->conn_cpumask);
+	*thread_cpu = -1;
+
+check_rx_cpu:
+	/*
+	 * Once iscsit_sk_data_ready() has seen which CPU the NIC steers
+	 * this connection's receive processing to, move both kthreads
+	 * there so that payload is consumed where the softirq left it.
+	 */
+	rx_cpu = ACCESS_ONCE(conn->conn_rx_cpu);
+	if (rx_cpu < 0 || rx_cpu == *thread_cpu || !cpu_online(rx_cpu))
+		return;
+
+	*thread_cpu = rx_cpu;
+	set_cpus_allowed_ptr(p, cpumask_of(rx_cpu));
+}
+
+static void iscsit_sk_data_ready(struct sock *sk, int count)
+{
+	struct iscsi_conn *conn;
+	int cpu = smp_processor_id();
+
+	read_lock(&sk->sk_callback_lock);
+	conn = sk->sk_user_data;
+	if (!conn) {
+		/*
+		 * iscsit_detach_sk_data_ready() ran while this softirq was
+		 * waiting for the lock, and has already put the original
+		 * callback back in place.
+		 */
+		if (sk->sk_data_ready != iscsit_sk_data_ready)
+			sk->sk_data_ready(sk, count);
+		read_unlock(&sk->sk_callback_lock);
+		return;
+	}
+	if (conn->conn_rx_cpu != cpu)
+		conn->conn_rx_cpu = cpu;
+	conn->orig_sk_data_ready(sk, count);
+	read_unlock(&sk->sk_callback_lock);
+}
+
+/*
+ * Called once a connection is fully logged in to start tracking the CPU
+ * that receive processing for its socket lands on, which is what RSS,
+ * RPS and RFS decide for the flow.
+ */
+void iscsit_attach_sk_data_ready(struct iscsi_conn *conn)
+{
+	struct sock *sk = conn->sock->sk;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	sk->sk_user_data = conn;
+	conn->orig_sk_data_ready = sk->sk_data_ready;
+	sk->sk_data_ready = iscsit_sk_data_ready;
+	write_unlock_bh(&sk->sk_callback_lock);
+}
+
+void iscsit_detach_sk_data_ready(struct iscsi_conn *conn)
+{
+	struct sock *sk = conn->sock->sk;
+
+	write_lock_bh(&sk->sk_callback_lock);
+	if (conn->orig_sk_data_ready) {
+		sk->sk_data_ready = conn->orig_sk_data_ready;
+		sk->sk_user_data = NULL;
+		conn->orig_sk_data_ready = NULL;
+	}
+	write_unlock_bh(&sk->sk_callback_lock);
 }
 
 #else
@@ -3474,6 +3554,16 @@ void iscsit_thread_get_cpumask(struct iscsi_conn *conn)
 	return;
 }
 
+void iscsit_attach_sk_data_ready(struct iscsi_conn *conn)
+{
+	return;
+}
+
+void iscsit_detach_sk_data_ready(struct iscsi_conn *conn)
+{
+	return;
+}
+
 #define iscsit_thread_check_cpumask(X, Y, Z) ({})
 #endif /* CONFIG_SMP */
 
@@ -3614,6 +3704,12 @@ get_response:
 			cmd = qr->cmd;
 			state = qr->state;
 			kmem_cache_free(lio_qr_cache, qr);
+			/*
+			 * With more responses queued behind this one, let
+			 * them share TCP segments until the queue drains.
+			 */
+			if (iscsit_response_queue_pending(conn))
+				iscsit_tx_cork(conn, 1);
 
 			spin_lock_bh(&cmd->istate_lock);
 check_rsp_state:
@@ -3744,6 +3840,11 @@ check_rsp_state:
 				break;
 			case ISTATE_SEND_LOGOUTRSP:
 				spin_unlock_bh(&cmd->istate_lock);
+				/*
+				 * Push the logout response out before the
+				 * post handler may tear down the connection.
+				 */
+				iscsit_tx_cork(conn, 0);
 				if (!iscsit_logout_post_handler(cmd, conn))
 					goto restart;
 				spin_lock_bh(&cmd->istate_lock);
@@ -3769,8 +3870,10 @@ check_rsp_state:
 				goto get_immediate;
 
 			goto get_response;
-		} else
+		} else {
 			conn->tx_response_queue = 0;
+			iscsit_tx_cork(conn, 0);
+		}
 	}
 
 transport_err:
@@ -4113,6 +4216,7 @@ int iscsit_close_connection(
 	conn->conn_ops = NULL;
 
 	if (conn->sock) {
+		iscsit_detach_sk_data_ready(conn);
 		if (conn->conn_flags & CONNFLAG_SCTP_STRUCT_FILE) {
 			kfree(conn->sock->file);
 			conn->sock->file = NULL;
@@ -3,6 +3,7 @@
 
 #include <linux/in.h>
 #include <linux/configfs.h>
+#include <linux/llist.h>
 #include <net/sock.h>
 #include <net/tcp.h>
 #include <scsi/scsi_cmnd.h>
@@ -56,6 +57,8 @@
 /* Disabled by default in production mode w/ explict ACLs */
 #define TA_PROD_MODE_WRITE_PROTECT	0
 #define TA_CACHE_CORE_NPS		0
+/* Hash DataDigest payloads piecewise as they are received */
+#define TA_RX_DIGEST_PIPELINE		1
 
 enum tpg_np_network_transport_table {
 	ISCSI_TCP				= 0,
@@ -268,11 +271,14 @@ struct iscsi_queue_req {
 	int			state;
 	struct iscsi_cmd	*cmd;
 	struct list_head	qr_list;
+	/* Used while on the lockless conn->*_queue_llist */
+	struct llist_node	qr_llnode;
 };
 
 struct iscsi_data_count {
 	int			data_length;
 	int			sync_and_steering;
+	int			msg_flags;
 	enum data_count_type	type;
 	u32			iov_count;
 	u32			ss_iov_count;
@@ -501,6 +507,8 @@ struct iscsi_conn {
 	enum iscsi_timer_flags_table nopin_response_timer_flags;
 	u8			tx_immediate_queue;
 	u8			tx_response_queue;
+	/* TCP_CORK set while the TX thread has a backlog of responses */
+	u8			tx_corked;
 	/* Used to know what thread encountered a transport failure */
 	u8			which_thread;
 	/* connection id assigned by the Initiator */
@@ -563,9 +571,21 @@ struct iscsi_conn {
 	cpumask_var_t		conn_cpumask;
 	int			conn_rx_reset_cpumask:1;
 	int			conn_tx_reset_cpumask:1;
+	/* CPU running the socket's receive softirq, from sk_data_ready */
+	int			conn_rx_cpu;
+	/* CPU the RX and TX kthreads were last bound to from conn_rx_cpu */
+	int			conn_rx_thread_cpu;
+	int			conn_tx_thread_cpu;
+	void			(*orig_sk_data_ready)(struct sock *, int);
 	/* list_head of struct iscsi_cmd for this connection */
 	struct list_head	conn_cmd_list;
+	/*
+	 * Queue producers only ever llist_add() to the *_llist heads, the
+	 * *_lock protected lists are refilled from them by the consumer.
+	 */
+	struct llist_head	immed_queue_llist;
 	struct list_head	immed_queue_list;
+	struct llist_head	response_queue_llist;
 	struct list_head	response_queue_list;
 	struct iscsi_conn_ops	*conn_ops;
 	struct iscsi_param_list	*param_list;
@@ -740,6 +760,7 @@ struct iscsi_tpg_attrib {
 	u32			default_cmdsn_depth;
 	u32			demo_mode_write_protect;
 	u32			prod_mode_write_protect;
+	u32			rx_digest_pipeline;
 	struct iscsi_portal_group *tpg;
 };
 
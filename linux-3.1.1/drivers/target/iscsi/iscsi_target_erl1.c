@@ -971,6 +971,10 @@ int iscsit_execute_cmd(struct iscsi_cmd *cmd, int ooo)
 		if (cmd->immediate_data) {
 			if (cmd->cmd_flags & ICF_GOT_LAST_DATAOUT) {
 				spin_unlock_bh(&cmd->istate_lock);
+				/*
+				 * sess->cmdsn_mutex may be held here, so
+				 * go through the device queue.
+				 */
 				return transport_generic_handle_data(
 						&cmd->se_cmd);
 			}
@@ -46,7 +46,9 @@ static int iscsi_login_init_conn(struct iscsi_conn *conn)
 {
 	INIT_LIST_HEAD(&conn->conn_list);
 	INIT_LIST_HEAD(&conn->conn_cmd_list);
+	init_llist_head(&conn->immed_queue_llist);
 	INIT_LIST_HEAD(&conn->immed_queue_list);
+	init_llist_head(&conn->response_queue_llist);
 	INIT_LIST_HEAD(&conn->response_queue_list);
 	init_completion(&conn->conn_post_wait_comp);
 	init_completion(&conn->conn_wait_comp);
@@ -61,6 +63,9 @@ static int iscsi_login_init_conn(struct iscsi_conn *conn)
 	spin_lock_init(&conn->nopin_timer_lock);
 	spin_lock_init(&conn->response_queue_lock);
 	spin_lock_init(&conn->state_lock);
+	conn->conn_rx_cpu = -1;
+	conn->conn_rx_thread_cpu = -1;
+	conn->conn_tx_thread_cpu = -1;
 
 	if (!zalloc_cpumask_var(&conn->conn_cpumask, GFP_KERNEL)) {
 		pr_err("Unable to allocate conn->conn_cpumask\n");
@@ -632,6 +637,7 @@ static int iscsi_post_login_handler(
 		iscsit_thread_get_cpumask(conn);
 		conn->conn_rx_reset_cpumask = 1;
 		conn->conn_tx_reset_cpumask = 1;
+		iscsit_attach_sk_data_ready(conn);
 
 		iscsit_dec_conn_usage_count(conn);
 		if (stop_timer) {
@@ -689,6 +695,7 @@ static int iscsi_post_login_handler(
 	iscsit_thread_get_cpumask(conn);
 	conn->conn_rx_reset_cpumask = 1;
 	conn->conn_tx_reset_cpumask = 1;
+	iscsit_attach_sk_data_ready(conn);
 
 	iscsit_dec_conn_usage_count(conn);
 
@@ -19,6 +19,8 @@
  ******************************************************************************/
 
 #include <linux/list.h>
+#include <linux/crypto.h>
+#include <linux/scatterlist.h>
 #include <scsi/scsi_tcq.h>
 #include <scsi/iscsi_proto.h>
 #include <target/target_core_base.h>
@@ -39,6 +41,8 @@
 #include "iscsi_target_util.h"
 #include "iscsi_target.h"
 
+static int __tx_data(struct iscsi_conn *, struct kvec *, int, int, int);
+
 #define PRINT_BUFF(buff, len)					\
 {								\
 	int zzz;						\
@@ -635,9 +639,35 @@ int iscsit_find_cmd_for_recovery(
 	return -1;
 }
 
-void iscsit_add_cmd_to_immediate_queue(
+/*
+ *	The immediate and response queues are fed from the RX thread, target
+ *	core completion context, TMR handling and timers, but only drained by
+ *	the connection's TX thread.  Producers push onto a lockless llist and
+ *	never touch the queue lock, so it stays local to the TX thread's CPU.
+ *	The consumer, and the rare removal paths, move whatever has been
+ *	pushed onto the lock protected list in arrival order.
+ */
+static void iscsit_splice_queue(
+	struct llist_head *llist,
+	struct list_head *list)
+{
+	struct llist_node *node = llist_del_all(llist);
+	struct iscsi_queue_req *qr;
+	LIST_HEAD(batch);
+
+	/*
+	 * llist_del_all() returns the most recently added entry first.
+	 */
+	while (node) {
+		qr = llist_entry(node, struct iscsi_queue_req, qr_llnode);
+		node = node->next;
+		list_add(&qr->qr_list, &batch);
+	}
+	list_splice_tail(&batch, list);
+}
+
+static struct iscsi_queue_req *iscsit_alloc_queue_req(
 	struct iscsi_cmd *cmd,
-	struct iscsi_conn *conn,
 	u8 state)
 {
 	struct iscsi_queue_req *qr;
@@ -646,17 +676,35 @@ void iscsit_add_cmd_to_immediate_queue(
 	if (!qr) {
 		pr_err("Unable to allocate memory for"
 				" struct iscsi_queue_req\n");
-		return;
+		return NULL;
 	}
 	INIT_LIST_HEAD(&qr->qr_list);
 	qr->cmd = cmd;
 	qr->state = state;
 
-	spin_lock_bh(&conn->immed_queue_lock);
-	list_add_tail(&qr->qr_list, &conn->immed_queue_list);
+	return qr;
+}
+
+void iscsit_add_cmd_to_immediate_queue(
+	struct iscsi_cmd *cmd,
+	struct iscsi_conn *conn,
+	u8 state)
+{
+	struct iscsi_queue_req *qr;
+
+	qr = iscsit_alloc_queue_req(cmd, state);
+	if (!qr)
+		return;
+
+	/*
+	 * Link the request before counting it, so the removal path never
+	 * sees a count for a request it cannot splice yet.  llist_add()
+	 * is a full barrier, and the removal path reads the count under
+	 * the queue lock after any earlier splice.
+	 */
+	llist_add(&qr->qr_llnode, &conn->immed_queue_llist);
 	atomic_inc(&cmd->immed_queue_count);
 	atomic_set(&conn->check_immediate_queue, 1);
-	spin_unlock_bh(&conn->immed_queue_lock);
 
 	wake_up_process(conn->thread_set->tx_thread);
 }
@@ -666,6 +714,9 @@ struct iscsi_queue_req *iscsit_get_cmd_from_immediate_queue(struct iscsi_conn *c
 	struct iscsi_queue_req *qr;
 
 	spin_lock_bh(&conn->immed_queue_lock);
+	if (list_empty(&conn->immed_queue_list))
+		iscsit_splice_queue(&conn->immed_queue_llist,
+				&conn->immed_queue_list);
 	if (list_empty(&conn->immed_queue_list)) {
 		spin_unlock_bh(&conn->immed_queue_lock);
 		return NULL;
@@ -692,6 +743,7 @@ static void iscsit_remove_cmd_from_immediate_queue(
 		spin_unlock_bh(&conn->immed_queue_lock);
 		return;
 	}
+	iscsit_splice_queue(&conn->immed_queue_llist, &conn->immed_queue_list);
 
 	list_for_each_entry_safe(qr, qr_tmp, &conn->immed_queue_list, qr_list) {
 		if (qr->cmd != cmd)
@@ -717,20 +769,18 @@ void iscsit_add_cmd_to_response_queue(
 {
 	struct iscsi_queue_req *qr;
 
-	qr = kmem_cache_zalloc(lio_qr_cache, GFP_ATOMIC);
-	if (!qr) {
-		pr_err("Unable to allocate memory for"
-			" struct iscsi_queue_req\n");
+	qr = iscsit_alloc_queue_req(cmd, state);
+	if (!qr)
 		return;
-	}
-	INIT_LIST_HEAD(&qr->qr_list);
-	qr->cmd = cmd;
-	qr->state = state;
 
-	spin_lock_bh(&conn->response_queue_lock);
-	list_add_tail(&qr->qr_list, &conn->response_queue_list);
+	/*
+	 * Link the request before counting it, so the removal path never
+	 * sees a count for a request it cannot splice yet.  llist_add()
+	 * is a full barrier, and the removal path reads the count under
+	 * the queue lock after any earlier splice.
+	 */
+	llist_add(&qr->qr_llnode, &conn->response_queue_llist);
 	atomic_inc(&cmd->response_queue_count);
-	spin_unlock_bh(&conn->response_queue_lock);
 
 	wake_up_process(conn->thread_set->tx_thread);
 }
@@ -740,6 +790,9 @@ struct iscsi_queue_req *iscsit_get_cmd_from_response_queue(struct iscsi_conn *co
 	struct iscsi_queue_req *qr;
 
 	spin_lock_bh(&conn->response_queue_lock);
+	if (list_empty(&conn->response_queue_list))
+		iscsit_splice_queue(&conn->response_queue_llist,
+				&conn->response_queue_list);
 	if (list_empty(&conn->response_queue_list)) {
 		spin_unlock_bh(&conn->response_queue_lock);
 		return NULL;
@@ -756,6 +809,16 @@ struct iscsi_queue_req *iscsit_get_cmd_from_response_queue(struct iscsi_conn *co
 	return qr;
 }
 
+/*
+ *	Used by the TX thread to decide whether more responses are about to
+ *	follow the current one, no locking as this is only a hint.
+ */
+int iscsit_response_queue_pending(struct iscsi_conn *conn)
+{
+	return !list_empty(&conn->response_queue_list) ||
+	       !llist_empty(&conn->response_queue_llist);
+}
+
 static void iscsit_remove_cmd_from_response_queue(
 	struct iscsi_cmd *cmd,
 	struct iscsi_conn *conn)
@@ -767,6 +830,8 @@ static void iscsit_remove_cmd_from_response_queue(
 		spin_unlock_bh(&conn->response_queue_lock);
 		return;
 	}
+	iscsit_splice_queue(&conn->response_queue_llist,
+			&conn->response_queue_list);
 
 	list_for_each_entry_safe(qr, qr_tmp, &conn->response_queue_list,
 				qr_list) {
@@ -791,6 +856,7 @@ void iscsit_free_queue_reqs_for_conn(struct iscsi_conn *conn)
 	struct iscsi_queue_req *qr, *qr_tmp;
 
 	spin_lock_bh(&conn->immed_queue_lock);
+	iscsit_splice_queue(&conn->immed_queue_llist, &conn->immed_queue_list);
 	list_for_each_entry_safe(qr, qr_tmp, &conn->immed_queue_list, qr_list) {
 		list_del(&qr->qr_list);
 		if (qr->cmd)
@@ -801,6 +867,8 @@ void iscsit_free_queue_reqs_for_conn(struct iscsi_conn *conn)
 	spin_unlock_bh(&conn->immed_queue_lock);
 
 	spin_lock_bh(&conn->response_queue_lock);
+	iscsit_splice_queue(&conn->response_queue_llist,
+			&conn->response_queue_list);
 	list_for_each_entry_safe(qr, qr_tmp, &conn->response_queue_list,
 			qr_list) {
 		list_del(&qr->qr_list);
@@ -1256,7 +1324,7 @@ int iscsit_fe_sendpage_sg(
 	struct kvec iov;
 	u32 tx_hdr_size, data_len;
 	u32 offset = cmd->first_data_sg_off;
-	int tx_sent, iov_off;
+	int tx_sent, iov_off, trailer, flags;
 
 send_hdr:
 	tx_hdr_size = ISCSI_HDR_LEN;
@@ -1265,8 +1333,12 @@ send_hdr:
 
 	iov.iov_base = cmd->pdu;
 	iov.iov_len = tx_hdr_size;
-
-	tx_sent = tx_data(conn, &iov, 1, tx_hdr_size);
+	/*
+	 * Use MSG_MORE for every piece of the PDU but the last, so that TCP
+	 * does not push the header, or a partial segment per page, out on
+	 * its own with TCP_NODELAY set.
+	 */
+	tx_sent = __tx_data(conn, &iov, 1, tx_hdr_size, MSG_MORE);
 	if (tx_hdr_size != tx_sent) {
 		if (tx_sent == -EAGAIN) {
 			pr_err("tx_data() returned -EAGAIN\n");
@@ -1289,15 +1361,19 @@ send_hdr:
 	} else {
 		iov_off = (cmd->iov_data_count - 1);
 	}
+	trailer = (cmd->padding || conn->conn_ops->DataDigest);
 	/*
 	 * Perform sendpage() for each page in the scatterlist
 	 */
 	while (data_len) {
 		u32 space = (sg->length - offset);
 		u32 sub_len = min_t(u32, data_len, space);
+
+		flags = (data_len > sub_len || trailer) ? MSG_MORE : 0;
 send_pg:
 		tx_sent = conn->sock->ops->sendpage(conn->sock,
-					sg_page(sg), sg->offset + offset, sub_len, 0);
+					sg_page(sg), sg->offset + offset, sub_len,
+					flags);
 		if (tx_sent != sub_len) {
 			if (tx_sent == -EAGAIN) {
 				pr_err("tcp_sendpage() returned"
@@ -1319,7 +1395,8 @@ send_padding:
 	if (cmd->padding) {
 		struct kvec *iov_p = &cmd->iov_data[iov_off++];
 
-		tx_sent = tx_data(conn, iov_p, 1, cmd->padding);
+		flags = (conn->conn_ops->DataDigest) ? MSG_MORE : 0;
+		tx_sent = __tx_data(conn, iov_p, 1, cmd->padding, flags);
 		if (cmd->padding != tx_sent) {
 			if (tx_sent == -EAGAIN) {
 				pr_err("tx_data() returned -EAGAIN\n");
@@ -1449,6 +1526,7 @@ static int iscsit_do_tx_data(
 	}
 
 	memset(&msg, 0, sizeof(struct msghdr));
+	msg.msg_flags = count->msg_flags;
 
 	iov_p = count->iov;
 	iov_len = count->iov_count;
@@ -1489,11 +1567,74 @@ int rx_data(
 	return iscsit_do_rx_data(conn, &c);
 }
 
-int tx_data(
+/*
+ *	Receive @data bytes into @iov like rx_data(), computing the CRC32C
+ *	DataDigest of the first @hash_len bytes along the way.  The payload
+ *	is pulled off the socket ISCSI_RX_HASH_SEGS iovecs at a time and each
+ *	piece is hashed right after it has been copied out of the socket
+ *	buffers, while it is still cache hot and while the remainder of the
+ *	PDU keeps arriving, instead of making a second pass over the whole
+ *	payload once it has been received.
+ *
+ *	Every iovec must map lowmem, which holds for the t_mem_sg pages from
+ *	iscsit_alloc_buffs() and the per command pad and digest buffers.
+ */
+#define ISCSI_RX_HASH_SEGS	16
+
+int rx_data_hash(
 	struct iscsi_conn *conn,
 	struct kvec *iov,
 	int iov_count,
-	int data)
+	int data,
+	u32 hash_len,
+	u32 *data_crc)
+{
+	struct hash_desc *hash = &conn->conn_rx_hash;
+	struct kvec rx_iov[ISCSI_RX_HASH_SEGS];
+	struct scatterlist sg;
+	int i, nsegs, rx_size, rx_got, total_rx = 0;
+
+	crypto_hash_init(hash);
+
+	while (iov_count && total_rx < data) {
+		nsegs = min_t(int, iov_count, ISCSI_RX_HASH_SEGS);
+		rx_size = 0;
+		for (i = 0; i < nsegs; i++)
+			rx_size += iov[i].iov_len;
+		rx_size = min_t(int, rx_size, data - total_rx);
+		/*
+		 * kernel_recvmsg() consumes the iovecs it is handed, so pass a
+		 * copy and keep @iov intact for hashing below.
+		 */
+		memcpy(rx_iov, iov, nsegs * sizeof(struct kvec));
+
+		rx_got = rx_data(conn, rx_iov, nsegs, rx_size);
+		if (rx_got != rx_size)
+			return (rx_got < 0) ? rx_got : total_rx + rx_got;
+
+		for (i = 0; i < nsegs && hash_len; i++) {
+			u32 len = min_t(u32, hash_len, iov[i].iov_len);
+
+			sg_init_one(&sg, iov[i].iov_base, len);
+			crypto_hash_update(hash, &sg, len);
+			hash_len -= len;
+		}
+
+		total_rx += rx_got;
+		iov += nsegs;
+		iov_count -= nsegs;
+	}
+	crypto_hash_final(hash, (u8 *)data_crc);
+
+	return total_rx;
+}
+
+static int __tx_data(
+	struct iscsi_conn *conn,
+	struct kvec *iov,
+	int iov_count,
+	int data,
+	int msg_flags)
 {
 	struct iscsi_data_count c;
 
@@ -1504,11 +1645,38 @@ int tx_data(
 	c.iov = iov;
 	c.iov_count = iov_count;
 	c.data_length = data;
+	c.msg_flags = msg_flags;
 	c.type = ISCSI_TX_DATA;
 
 	return iscsit_do_tx_data(conn, &c);
 }
 
+int tx_data(
+	struct iscsi_conn *conn,
+	struct kvec *iov,
+	int iov_count,
+	int data)
+{
+	return __tx_data(conn, iov, iov_count, data, 0);
+}
+
+/*
+ *	Hold back partial TCP segments while the TX thread has more responses
+ *	queued, so that back to back PDUs share segments instead of each one
+ *	being pushed out on its own.  Clearing TCP_CORK pushes what is left.
+ */
+void iscsit_tx_cork(struct iscsi_conn *conn, int cork)
+{
+	if (conn->network_transport != ISCSI_TCP)
+		return;
+	if (conn->tx_corked == cork)
+		return;
+
+	conn->tx_corked = cork;
+	kernel_setsockopt(conn->sock, IPPROTO_TCP, TCP_CORK,
+			(char *)&cork, sizeof(cork));
+}
+
 void iscsit_collect_login_stats(
 	struct iscsi_conn *conn,
 	u8 status_class,
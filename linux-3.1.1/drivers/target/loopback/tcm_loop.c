@@ -24,6 +24,7 @@
 #include <linux/moduleparam.h>
 #include <linux/init.h>
 #include <linux/slab.h>
+#include <linux/workqueue.h>
 #include <linux/types.h>
 #include <linux/configfs.h>
 #include <scsi/scsi.h>
@@ -51,6 +52,22 @@ static struct target_fabric_configfs *tcm_loop_fabric_configfs;
 
 static struct kmem_cache *tcm_loop_cmd_cache;
 
+/*
+ * Per-CPU submission context for tcm_loop_queuecommand(), which may be
+ * called from atomic context.
+ */
+static struct workqueue_struct *tcm_loop_workqueue;
+
+/*
+ * With direct_submit=0 commands go through the per se_device processing
+ * thread like the other fabric modules did before, which makes for an
+ * easy A/B comparison of the target core submission paths.
+ */
+static bool tcm_loop_direct_submit = true;
+module_param_named(direct_submit, tcm_loop_direct_submit, bool, 0644);
+MODULE_PARM_DESC(direct_submit, "Submit commands from the receiving CPU"
+		 " instead of the se_device processing thread (default: Y)");
+
 static int tcm_loop_hba_no_cnt;
 
 /*
@@ -202,6 +219,14 @@ static int tcm_loop_new_cmd_map(struct se_cmd *se_cmd)
 	return 0;
 }
 
+static void tcm_loop_submission_work(struct work_struct *work)
+{
+	struct tcm_loop_cmd *tl_cmd =
+		container_of(work, struct tcm_loop_cmd, work);
+
+	transport_generic_handle_cdb_map_direct(&tl_cmd->tl_se_cmd);
+}
+
 /*
  * Called from struct target_core_fabric_ops->check_stop_free()
  */
@@ -319,9 +344,18 @@ static int tcm_loop_queuecommand(
 		return 0;
 	}
 	/*
-	 * Queue up the newly allocated to be processed in TCM thread context.
-	*/
-	transport_generic_handle_cdb_map(se_cmd);
+	 * Queue up the newly allocated to be processed in TCM thread context,
+	 * or by default in tcm_loop_workqueue on this CPU, from where it is
+	 * submitted straight to the backend.
+	 */
+	if (tcm_loop_direct_submit) {
+		struct tcm_loop_cmd *tl_cmd = container_of(se_cmd,
+					struct tcm_loop_cmd, tl_se_cmd);
+
+		INIT_WORK(&tl_cmd->work, tcm_loop_submission_work);
+		queue_work(tcm_loop_workqueue, &tl_cmd->work);
+	} else
+		transport_generic_handle_cdb_map(se_cmd);
 	return 0;
 }
 
@@ -1509,7 +1543,11 @@ static void tcm_loop_deregister_configfs(void)
 
 static int __init tcm_loop_fabric_init(void)
 {
-	int ret;
+	int ret = -ENOMEM;
+
+	tcm_loop_workqueue = alloc_workqueue("tcm_loop", WQ_MEM_RECLAIM, 0);
+	if (!tcm_loop_workqueue)
+		goto out;
 
 	tcm_loop_cmd_cache = kmem_cache_create("tcm_loop_cmd_cache",
 				sizeof(struct tcm_loop_cmd),
@@ -1518,20 +1556,27 @@ static int __init tcm_loop_fabric_init(void)
 	if (!tcm_loop_cmd_cache) {
 		pr_debug("kmem_cache_create() for"
 			" tcm_loop_cmd_cache failed\n");
-		return -ENOMEM;
+		goto out_destroy_workqueue;
 	}
 
 	ret = tcm_loop_alloc_core_bus();
 	if (ret)
-		return ret;
+		goto out_destroy_cache;
 
 	ret = tcm_loop_register_configfs();
-	if (ret) {
-		tcm_loop_release_core_bus();
-		return ret;
-	}
+	if (ret)
+		goto out_release_core_bus;
 
 	return 0;
+
+out_release_core_bus:
+	tcm_loop_release_core_bus();
+out_destroy_cache:
+	kmem_cache_destroy(tcm_loop_cmd_cache);
+out_destroy_workqueue:
+	destroy_workqueue(tcm_loop_workqueue);
+out:
+	return ret;
 }
 
 static void __exit tcm_loop_fabric_exit(void)
@@ -1539,6 +1584,7 @@ static void __exit tcm_loop_fabric_exit(void)
 	tcm_loop_deregister_configfs();
 	tcm_loop_release_core_bus();
 	kmem_cache_destroy(tcm_loop_cmd_cache);
+	destroy_workqueue(tcm_loop_workqueue);
 }
 
 MODULE_DESCRIPTION("TCM loopback virtual Linux/SCSI fabric module");
@@ -26,6 +26,8 @@ struct tcm_loop_cmd {
 	struct se_cmd tl_se_cmd;
 	/* Sense buffer that will be mapped into outgoing status */
 	unsigned char tl_sense_buf[TRANSPORT_SENSE_BUFFER];
+	/* Used for submission in tcm_loop_workqueue */
+	struct work_struct work;
 };
 
 struct tcm_loop_tmr {
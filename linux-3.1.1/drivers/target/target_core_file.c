@@ -44,6 +44,13 @@
 
 static struct se_subsystem_api fileio_template;
 
+/*
+ * Unbound workqueue executing READs, WRITEs and SYNCHRONIZE_CACHE for
+ * fd_async_io=1 devices, so that up to the device queue depth of them
+ * are in flight at a time instead of one per processing thread.
+ */
+static struct workqueue_struct *fd_async_wq;
+
 /*	fd_attach_hba(): (Part of se_subsystem_api_t template)
  *
  *
@@ -145,9 +152,11 @@ static struct se_device *fd_create_virtdevice(
 /*	flags |= O_DIRECT; */
 	/*
 	 * If fd_buffered_io=1 has not been set explicitly (the default),
-	 * use O_SYNC to force FILEIO writes to disk.
+	 * use O_SYNC to force FILEIO writes to disk.  fd_async_io=1 syncs
+	 * just the range of each write-through or FUA WRITE instead, see
+	 * fd_async_work().
 	 */
-	if (!(fd_dev->fbd_flags & FDBD_USE_BUFFERED_IO))
+	if (!(fd_dev->fbd_flags & (FDBD_USE_BUFFERED_IO | FDBD_USE_ASYNC_IO)))
 		flags |= O_SYNC;
 
 	file = filp_open(dev_p, flags, 0600);
@@ -360,7 +369,7 @@ static int fd_do_writev(struct se_task *task)
 	return 1;
 }
 
-static void fd_emulate_sync_cache(struct se_task *task)
+static void __fd_emulate_sync_cache(struct se_task *task)
 {
 	struct se_cmd *cmd = task->task_se_cmd;
 	struct se_device *dev = cmd->se_dev;
@@ -398,6 +407,22 @@ static void fd_emulate_sync_cache(struct se_task *task)
 		transport_complete_sync_cache(cmd, ret == 0);
 }
 
+static void fd_async_work(struct work_struct *work);
+
+static void fd_emulate_sync_cache(struct se_task *task)
+{
+	struct fd_request *req = FILE_REQ(task);
+	struct fd_dev *fd_dev = task->se_dev->dev_ptr;
+
+	if (fd_dev->fbd_flags & FDBD_USE_ASYNC_IO) {
+		INIT_WORK(&req->fd_work, fd_async_work);
+		queue_work(fd_async_wq, &req->fd_work);
+		return;
+	}
+
+	__fd_emulate_sync_cache(task);
+}
+
 /*
  * Tell TCM Core that we are capable of WriteCache emulation for
  * an underlying struct se_device.
@@ -429,7 +454,7 @@ static int fd_emulated_fua_read(struct se_device *dev)
  * WRITE Force Unit Access (FUA) emulation on a per struct se_task
  * LBA range basis..
  */
-static void fd_emulate_write_fua(struct se_cmd *cmd, struct se_task *task)
+static int fd_emulate_write_fua(struct se_cmd *cmd, struct se_task *task)
 {
 	struct se_device *dev = cmd->se_dev;
 	struct fd_dev *fd_dev = dev->dev_ptr;
@@ -443,14 +468,71 @@ static void fd_emulate_write_fua(struct se_cmd *cmd, struct se_task *task)
 	ret = vfs_fsync_range(fd_dev->fd_file, start, end, 1);
 	if (ret != 0)
 		pr_err("FILEIO: vfs_fsync_range() failed: %d\n", ret);
+	return ret;
+}
+
+/*
+ * fd_async_io=1 WRITEs go to the page cache and only their own LBA
+ * range is synced: always for write-through (no WriteCache emulation),
+ * and otherwise for FUA WRITEs.  Each sync runs in its own fd_async_wq
+ * worker, so neither blocks the other commands on the LUN.
+ */
+static int fd_async_write_needs_sync(struct se_cmd *cmd)
+{
+	struct se_dev_attrib *attrib = &cmd->se_dev->se_sub_dev->se_dev_attrib;
+
+	if (attrib->emulate_write_cache <= 0)
+		return 1;
+
+	return attrib->emulate_fua_write > 0 && cmd->t_tasks_fua;
+}
+
+static void fd_async_work(struct work_struct *work)
+{
+	struct fd_request *req = container_of(work, struct fd_request, fd_work);
+	struct se_task *task = &req->fd_task;
+	struct se_cmd *cmd = task->task_se_cmd;
+	int ret;
+
+	if (!(cmd->se_cmd_flags & SCF_SCSI_DATA_SG_IO_CDB)) {
+		__fd_emulate_sync_cache(task);
+		return;
+	}
+
+	if (task->task_data_direction == DMA_FROM_DEVICE) {
+		ret = fd_do_readv(task);
+	} else {
+		ret = fd_do_writev(task);
+		if (ret > 0 && fd_async_write_needs_sync(cmd) &&
+		    fd_emulate_write_fua(cmd, task) != 0)
+			ret = -EIO;
+	}
+
+	if (ret < 0) {
+		task->task_error_status = PYX_TRANSPORT_LU_COMM_FAILURE;
+		cmd->transport_error_status = PYX_TRANSPORT_LU_COMM_FAILURE;
+		transport_complete_task(task, 0);
+		return;
+	}
+
+	task->task_scsi_status = GOOD;
+	transport_complete_task(task, 1);
 }
 
 static int fd_do_task(struct se_task *task)
 {
 	struct se_cmd *cmd = task->task_se_cmd;
 	struct se_device *dev = cmd->se_dev;
+	struct fd_dev *fd_dev = dev->dev_ptr;
+	struct fd_request *req = FILE_REQ(task);
 	int ret = 0;
 
+	if (fd_dev->fbd_flags & FDBD_USE_ASYNC_IO) {
+		INIT_WORK(&req->fd_work, fd_async_work);
+		queue_work(fd_async_wq, &req->fd_work);
+		return PYX_TRANSPORT_SENT_TO_TRANSPORT;
+	}
+
 	/*
 	 * Call vectorized fileio functions to map struct scatterlist
 	 * physical memory addresses to struct iovec virtual memory.
@@ -495,13 +577,15 @@ static void fd_free_task(struct se_task *task)
 }
 
 enum {
-	Opt_fd_dev_name, Opt_fd_dev_size, Opt_fd_buffered_io, Opt_err
+	Opt_fd_dev_name, Opt_fd_dev_size, Opt_fd_buffered_io, Opt_fd_async_io,
+	Opt_err
 };
 
 static match_table_t tokens = {
 	{Opt_fd_dev_name, "fd_dev_name=%s"},
 	{Opt_fd_dev_size, "fd_dev_size=%s"},
 	{Opt_fd_buffered_io, "fd_buffered_io=%d"},
+	{Opt_fd_async_io, "fd_async_io=%d"},
 	{Opt_err, NULL}
 };
 
@@ -570,6 +654,19 @@ static ssize_t fd_set_configfs_dev_params(
 
 			fd_dev->fbd_flags |= FDBD_USE_BUFFERED_IO;
 			break;
+		case Opt_fd_async_io:
+			match_int(args, &arg);
+			if (arg != 1) {
+				pr_err("bogus fd_async_io=%d value\n", arg);
+				ret = -EINVAL;
+				goto out;
+			}
+
+			pr_debug("FILEIO: Using asynchronous I/O"
+				" operations for struct fd_dev\n");
+
+			fd_dev->fbd_flags |= FDBD_USE_ASYNC_IO;
+			break;
 		default:
 			break;
 		}
@@ -603,6 +700,7 @@ static ssize_t fd_show_configfs_dev_params(
 	bl = sprintf(b + bl, "TCM FILEIO ID: %u", fd_dev->fd_dev_id);
 	bl += sprintf(b + bl, "        File: %s  Size: %llu  Mode: %s\n",
 		fd_dev->fd_dev_name, fd_dev->fd_dev_size,
+		(fd_dev->fbd_flags & FDBD_USE_ASYNC_IO) ? "Asynchronous" :
 		(fd_dev->fbd_flags & FDBD_USE_BUFFERED_IO) ?
 		"Buffered" : "Synchronous");
 	return bl;
@@ -674,12 +772,23 @@ static struct se_subsystem_api fileio_template = {
 
 static int __init fileio_module_init(void)
 {
-	return transport_subsystem_register(&fileio_template);
+	int ret;
+
+	fd_async_wq = alloc_workqueue("fd_async", WQ_UNBOUND | WQ_MEM_RECLAIM,
+				      WQ_UNBOUND_MAX_ACTIVE);
+	if (!fd_async_wq)
+		return -ENOMEM;
+
+	ret = transport_subsystem_register(&fileio_template);
+	if (ret < 0)
+		destroy_workqueue(fd_async_wq);
+	return ret;
 }
 
 static void fileio_module_exit(void)
 {
 	transport_subsystem_release(&fileio_template);
+	destroy_workqueue(fd_async_wq);
 }
 
 MODULE_DESCRIPTION("TCM FILEIO subsystem plugin");
@@ -16,11 +16,14 @@ struct fd_request {
 	struct se_task	fd_task;
 	/* SCSI CDB from iSCSI Command PDU */
 	unsigned char	fd_scsi_cdb[TCM_MAX_COMMAND_SIZE];
+	/* Used to run the request in fd_async_wq for fd_async_io=1 */
+	struct work_struct fd_work;
 } ____cacheline_aligned;
 
 #define FBDF_HAS_PATH		0x01
 #define FBDF_HAS_SIZE		0x02
 #define FDBD_USE_BUFFERED_IO	0x04
+#define FDBD_USE_ASYNC_IO	0x08
 
 struct fd_dev {
 	u32		fbd_flags;
@@ -44,6 +44,8 @@
 
 #include "target_core_rd.h"
 
+#define RD_SG_PER_TABLE		(RD_MAX_ALLOCATION_SIZE / sizeof(struct scatterlist))
+
 static struct se_subsystem_api rd_mcp_template;
 
 /*	rd_attach_hba(): (Part of se_subsystem_api_t template)
@@ -124,6 +126,7 @@ static void rd_release_device_space(struct rd_dev *rd_dev)
 	kfree(sg_table);
 	rd_dev->sg_table_array = NULL;
 	rd_dev->sg_table_count = 0;
+	rd_dev->rd_page_alloc_count = 0;
 }
 
 
@@ -134,8 +137,7 @@ static void rd_release_device_space(struct rd_dev *rd_dev)
 static int rd_build_device_space(struct rd_dev *rd_dev)
 {
 	u32 i = 0, j, page_offset = 0, sg_per_table, sg_tables, total_sg_needed;
-	u32 max_sg_per_table = (RD_MAX_ALLOCATION_SIZE /
-				sizeof(struct scatterlist));
+	u32 max_sg_per_table = RD_SG_PER_TABLE;
 	struct rd_dev_sg_table *sg_table;
 	struct page *pg;
 	struct scatterlist *sg;
@@ -180,6 +182,14 @@ static int rd_build_device_space(struct rd_dev *rd_dev)
 						- 1;
 
 		for (j = 0; j < sg_per_table; j++) {
+			sg[j].length = PAGE_SIZE;
+			/*
+			 * Sparse devices start out as one large hole, pages
+			 * are allocated by rd_get_page() on first WRITE.
+			 */
+			if (rd_dev->rd_flags & RDF_SPARSE)
+				continue;
+
 			pg = alloc_pages(GFP_KERNEL, 0);
 			if (!pg) {
 				pr_err("Unable to allocate scatterlist"
@@ -187,15 +197,16 @@ static int rd_build_device_space(struct rd_dev *rd_dev)
 				return -ENOMEM;
 			}
 			sg_assign_page(&sg[j], pg);
-			sg[j].length = PAGE_SIZE;
+			rd_dev->rd_page_alloc_count++;
 		}
 
 		page_offset += sg_per_table;
 		total_sg_needed -= sg_per_table;
 	}
 
-	pr_debug("CORE_RD[%u] - Built Ramdisk Device ID: %u space of"
+	pr_debug("CORE_RD[%u] - Built %s Ramdisk Device ID: %u space of"
 		" %u pages in %u tables\n", rd_dev->rd_host->rd_host_id,
+		(rd_dev->rd_flags & RDF_SPARSE) ? "sparse" : "preallocated",
 		rd_dev->rd_dev_id, rd_dev->rd_page_count,
 		rd_dev->sg_table_count);
 
@@ -218,6 +229,7 @@ static void *rd_allocate_virtdevice(
 
 	rd_dev->rd_host = rd_host;
 	rd_dev->rd_direct = rd_direct;
+	spin_lock_init(&rd_dev->rd_page_lock);
 
 	return rd_dev;
 }
@@ -328,13 +340,12 @@ rd_alloc_task(unsigned char *cdb)
  */
 static struct rd_dev_sg_table *rd_get_sg_table(struct rd_dev *rd_dev, u32 page)
 {
-	u32 i;
+	u32 i = page / RD_SG_PER_TABLE;
 	struct rd_dev_sg_table *sg_table;
 
-	for (i = 0; i < rd_dev->sg_table_count; i++) {
+	if (i < rd_dev->sg_table_count) {
 		sg_table = &rd_dev->sg_table_array[i];
-		if ((sg_table->page_start_offset <= page) &&
-		    (sg_table->page_end_offset >= page))
+		if (page <= sg_table->page_end_offset && sg_table->sg_table)
 			return sg_table;
 	}
 
@@ -344,234 +355,209 @@ static struct rd_dev_sg_table *rd_get_sg_table(struct rd_dev *rd_dev, u32 page)
 	return NULL;
 }
 
-/*	rd_MEMCPY_read():
- *
+/*	rd_get_page():
  *
+ *	Return the backing page for ramdisk page @page, or NULL for a hole
+ *	in an RDF_SPARSE device.  With @alloc set a hole is filled with a
+ *	zeroed page first.  Pages of a sparse device are returned with an
+ *	extra reference that is dropped with rd_put_page(), so that a
+ *	concurrent rd_do_discard() cannot free them from under the caller.
  */
-static int rd_MEMCPY_read(struct rd_request *req)
+static struct page *rd_get_page(struct rd_dev *rd_dev, u32 page, int alloc)
 {
-	struct se_task *task = &req->rd_task;
-	struct rd_dev *dev = req->rd_task.se_dev->dev_ptr;
 	struct rd_dev_sg_table *table;
-	struct scatterlist *sg_d, *sg_s;
-	void *dst, *src;
-	u32 i = 0, j = 0, dst_offset = 0, src_offset = 0;
-	u32 length, page_end = 0, table_sg_end;
-	u32 rd_offset = req->rd_offset;
+	struct scatterlist *sg;
+	struct page *pg, *new_pg = NULL;
 
-	table = rd_get_sg_table(dev, req->rd_page);
+	table = rd_get_sg_table(rd_dev, page);
 	if (!table)
-		return -EINVAL;
-
-	table_sg_end = (table->page_end_offset - req->rd_page);
-	sg_d = task->task_sg;
-	sg_s = &table->sg_table[req->rd_page - table->page_start_offset];
-
-	pr_debug("RD[%u]: Read LBA: %llu, Size: %u Page: %u, Offset:"
-		" %u\n", dev->rd_dev_id, task->task_lba, req->rd_size,
-		req->rd_page, req->rd_offset);
-
-	src_offset = rd_offset;
-
-	while (req->rd_size) {
-		if ((sg_d[i].length - dst_offset) <
-		    (sg_s[j].length - src_offset)) {
-			length = (sg_d[i].length - dst_offset);
-
-			pr_debug("Step 1 - sg_d[%d]: %p length: %d"
-				" offset: %u sg_s[%d].length: %u\n", i,
-				&sg_d[i], sg_d[i].length, sg_d[i].offset, j,
-				sg_s[j].length);
-			pr_debug("Step 1 - length: %u dst_offset: %u"
-				" src_offset: %u\n", length, dst_offset,
-				src_offset);
-
-			if (length > req->rd_size)
-				length = req->rd_size;
-
-			dst = sg_virt(&sg_d[i++]) + dst_offset;
-			BUG_ON(!dst);
-
-			src = sg_virt(&sg_s[j]) + src_offset;
-			BUG_ON(!src);
-
-			dst_offset = 0;
-			src_offset = length;
-			page_end = 0;
-		} else {
-			length = (sg_s[j].length - src_offset);
-
-			pr_debug("Step 2 - sg_d[%d]: %p length: %d"
-				" offset: %u sg_s[%d].length: %u\n", i,
-				&sg_d[i], sg_d[i].length, sg_d[i].offset,
-				j, sg_s[j].length);
-			pr_debug("Step 2 - length: %u dst_offset: %u"
-				" src_offset: %u\n", length, dst_offset,
-				src_offset);
-
-			if (length > req->rd_size)
-				length = req->rd_size;
-
-			dst = sg_virt(&sg_d[i]) + dst_offset;
-			BUG_ON(!dst);
-
-			if (sg_d[i].length == length) {
-				i++;
-				dst_offset = 0;
-			} else
-				dst_offset = length;
-
-			src = sg_virt(&sg_s[j++]) + src_offset;
-			BUG_ON(!src);
-
-			src_offset = 0;
-			page_end = 1;
+		return ERR_PTR(-EINVAL);
+
+	sg = &table->sg_table[page - table->page_start_offset];
+	if (!(rd_dev->rd_flags & RDF_SPARSE))
+		return sg_page(sg);
+
+	for (;;) {
+		spin_lock(&rd_dev->rd_page_lock);
+		pg = sg_page(sg);
+		if (!pg && new_pg) {
+			sg_assign_page(sg, new_pg);
+			rd_dev->rd_page_alloc_count++;
+			pg = new_pg;
+			new_pg = NULL;
 		}
-
-		memcpy(dst, src, length);
-
-		pr_debug("page: %u, remaining size: %u, length: %u,"
-			" i: %u, j: %u\n", req->rd_page,
-			(req->rd_size - length), length, i, j);
-
-		req->rd_size -= length;
-		if (!req->rd_size)
-			return 0;
-
-		if (!page_end)
-			continue;
-
-		if (++req->rd_page <= table->page_end_offset) {
-			pr_debug("page: %u in same page table\n",
-				req->rd_page);
-			continue;
+		if (pg)
+			get_page(pg);
+		spin_unlock(&rd_dev->rd_page_lock);
+		/*
+		 * Another WRITE filled the hole while we were allocating.
+		 */
+		if (new_pg)
+			__free_page(new_pg);
+
+		if (pg || !alloc)
+			return pg;
+
+		new_pg = alloc_page(GFP_NOIO | __GFP_ZERO);
+		if (!new_pg) {
+			pr_err("Unable to allocate page %u for sparse"
+				" Ramdisk Device ID: %u\n", page,
+				rd_dev->rd_dev_id);
+			return ERR_PTR(-ENOMEM);
 		}
-
-		pr_debug("getting new page table for page: %u\n",
-				req->rd_page);
-
-		table = rd_get_sg_table(dev, req->rd_page);
-		if (!table)
-			return -EINVAL;
-
-		sg_s = &table->sg_table[j = 0];
 	}
+}
 
-	return 0;
+static inline void rd_put_page(struct rd_dev *rd_dev, struct page *pg)
+{
+	if (pg && (rd_dev->rd_flags & RDF_SPARSE))
+		__free_page(pg);
 }
 
-/*	rd_MEMCPY_write():
- *
+/*	rd_MEMCPY():
  *
+ *	Copy between task->task_sg and the ramdisk pages one backing page at
+ *	a time.  READs of holes in a sparse device return zeros, WRITEs fill
+ *	them in.
  */
-static int rd_MEMCPY_write(struct rd_request *req)
+static int rd_MEMCPY(struct rd_request *req, int read_rd)
 {
 	struct se_task *task = &req->rd_task;
-	struct rd_dev *dev = req->rd_task.se_dev->dev_ptr;
-	struct rd_dev_sg_table *table;
-	struct scatterlist *sg_d, *sg_s;
-	void *dst, *src;
-	u32 i = 0, j = 0, dst_offset = 0, src_offset = 0;
-	u32 length, page_end = 0, table_sg_end;
-	u32 rd_offset = req->rd_offset;
-
-	table = rd_get_sg_table(dev, req->rd_page);
-	if (!table)
-		return -EINVAL;
-
-	table_sg_end = (table->page_end_offset - req->rd_page);
-	sg_d = &table->sg_table[req->rd_page - table->page_start_offset];
-	sg_s = task->task_sg;
+	struct rd_dev *dev = task->se_dev->dev_ptr;
+	struct sg_mapping_iter m;
+	struct page *pg;
+	void *rd_addr;
+	u32 len, sg_off = 0, rd_offset = req->rd_offset;
+	int ret = 0;
 
-	pr_debug("RD[%d] Write LBA: %llu, Size: %u, Page: %u,"
-		" Offset: %u\n", dev->rd_dev_id, task->task_lba, req->rd_size,
-		req->rd_page, req->rd_offset);
+	pr_debug("RD[%u]: %s LBA: %llu, Size: %u Page: %u, Offset: %u\n",
+		dev->rd_dev_id, (read_rd) ? "Read" : "Write", task->task_lba,
+		req->rd_size, req->rd_page, req->rd_offset);
 
-	dst_offset = rd_offset;
+	sg_miter_start(&m, task->task_sg, task->task_sg_nents,
+			(read_rd) ? SG_MITER_TO_SG : SG_MITER_FROM_SG);
 
 	while (req->rd_size) {
-		if ((sg_s[i].length - src_offset) <
-		    (sg_d[j].length - dst_offset)) {
-			length = (sg_s[i].length - src_offset);
-
-			pr_debug("Step 1 - sg_s[%d]: %p length: %d"
-				" offset: %d sg_d[%d].length: %u\n", i,
-				&sg_s[i], sg_s[i].length, sg_s[i].offset,
-				j, sg_d[j].length);
-			pr_debug("Step 1 - length: %u src_offset: %u"
-				" dst_offset: %u\n", length, src_offset,
-				dst_offset);
-
-			if (length > req->rd_size)
-				length = req->rd_size;
-
-			src = sg_virt(&sg_s[i++]) + src_offset;
-			BUG_ON(!src);
-
-			dst = sg_virt(&sg_d[j]) + dst_offset;
-			BUG_ON(!dst);
-
-			src_offset = 0;
-			dst_offset = length;
-			page_end = 0;
-		} else {
-			length = (sg_d[j].length - dst_offset);
-
-			pr_debug("Step 2 - sg_s[%d]: %p length: %d"
-				" offset: %d sg_d[%d].length: %u\n", i,
-				&sg_s[i], sg_s[i].length, sg_s[i].offset,
-				j, sg_d[j].length);
-			pr_debug("Step 2 - length: %u src_offset: %u"
-				" dst_offset: %u\n", length, src_offset,
-				dst_offset);
-
-			if (length > req->rd_size)
-				length = req->rd_size;
-
-			src = sg_virt(&sg_s[i]) + src_offset;
-			BUG_ON(!src);
-
-			if (sg_s[i].length == length) {
-				i++;
-				src_offset = 0;
-			} else
-				src_offset = length;
+		pg = rd_get_page(dev, req->rd_page, !read_rd);
+		if (IS_ERR(pg)) {
+			ret = PTR_ERR(pg);
+			break;
+		}
 
-			dst = sg_virt(&sg_d[j++]) + dst_offset;
-			BUG_ON(!dst);
+		len = min_t(u32, req->rd_size, PAGE_SIZE - rd_offset);
+		rd_addr = (pg) ? page_address(pg) + rd_offset : NULL;
+		req->rd_size -= len;
+
+		while (len) {
+			u32 chunk;
+
+			if (sg_off == m.length) {
+				if (!sg_miter_next(&m)) {
+					pr_err("RD[%u]: task_sg exhausted with"
+						" %u bytes remaining\n",
+						dev->rd_dev_id,
+						req->rd_size + len);
+					rd_put_page(dev, pg);
+					ret = -EINVAL;
+					goto out;
+				}
+				sg_off = 0;
+			}
 
-			dst_offset = 0;
-			page_end = 1;
+			chunk = min_t(u32, len, m.length - sg_off);
+			if (!read_rd)
+				memcpy(rd_addr, m.addr + sg_off, chunk);
+			else if (rd_addr)
+				memcpy(m.addr + sg_off, rd_addr, chunk);
+			else
+				memset(m.addr + sg_off, 0, chunk);
+
+			if (rd_addr)
+				rd_addr += chunk;
+			sg_off += chunk;
+			len -= chunk;
 		}
 
-		memcpy(dst, src, length);
+		rd_put_page(dev, pg);
+		req->rd_page++;
+		rd_offset = 0;
+	}
+out:
+	sg_miter_stop(&m);
+	return ret;
+}
 
-		pr_debug("page: %u, remaining size: %u, length: %u,"
-			" i: %u, j: %u\n", req->rd_page,
-			(req->rd_size - length), length, i, j);
+/*	rd_DIRECT_read():
+ *
+ *	Zero-copy READ for rd_direct=1: instead of copying, swap the
+ *	ramdisk pages into the PAGE_SIZE entries of cmd->t_data_sg that
+ *	transport_generic_get_mem() allocated for this command.  Each mapped
+ *	page carries its own reference that transport_free_pages() drops,
+ *	so the fabric may keep transmitting from it even if the blocks are
+ *	unmapped meanwhile.  Holes are left pointing at the zeroed pages
+ *	from transport_generic_get_mem().
+ *
+ *	Returns 1 when the request cannot be mapped this way and has to go
+ *	through rd_MEMCPY() instead.
+ */
+static int rd_DIRECT_read(struct rd_request *req)
+{
+	struct se_task *task = &req->rd_task;
+	struct se_cmd *cmd = task->task_se_cmd;
+	struct rd_dev *dev = task->se_dev->dev_ptr;
+	struct scatterlist *sg, *cmd_sg;
+	struct page *pg;
+	u32 block_size = task->se_dev->se_sub_dev->se_dev_attrib.block_size;
+	unsigned long long task_offset;
+	u32 i;
+	int count;
+
+	/*
+	 * Only memory allocated by the target core may be swapped, fabric
+	 * provided buffers must be filled in place.
+	 */
+	if (cmd->se_cmd_flags & SCF_PASSTHROUGH_SG_TO_MEM_NOALLOC)
+		return 1;
+	if (cmd->t_bidi_data_sg || req->rd_offset)
+		return 1;
+
+	task_offset = (task->task_lba - cmd->t_task_lba) * block_size;
+	if (task_offset & ~PAGE_MASK)
+		return 1;
+
+	i = task_offset >> PAGE_SHIFT;
+	if (i + task->task_sg_nents > cmd->t_data_nents)
+		return 1;
+
+	for_each_sg(task->task_sg, sg, task->task_sg_nents, count) {
+		if (sg->offset || (sg->length != PAGE_SIZE &&
+		    count != task->task_sg_nents - 1))
+			return 1;
+	}
 
-		req->rd_size -= length;
-		if (!req->rd_size)
-			return 0;
+	pr_debug("RD[%u]: Direct Read LBA: %llu, Size: %u Page: %u\n",
+		dev->rd_dev_id, task->task_lba, req->rd_size, req->rd_page);
 
-		if (!page_end)
-			continue;
+	for_each_sg(task->task_sg, sg, task->task_sg_nents, count) {
+		pg = rd_get_page(dev, req->rd_page, 0);
+		if (IS_ERR(pg))
+			return PTR_ERR(pg);
 
-		if (++req->rd_page <= table->page_end_offset) {
-			pr_debug("page: %u in same page table\n",
-				req->rd_page);
+		cmd_sg = &cmd->t_data_sg[i++];
+		req->rd_page++;
+		if (!pg)
 			continue;
-		}
-
-		pr_debug("getting new page table for page: %u\n",
-				req->rd_page);
-
-		table = rd_get_sg_table(dev, req->rd_page);
-		if (!table)
-			return -EINVAL;
-
-		sg_d = &table->sg_table[j = 0];
+		/*
+		 * rd_get_page() already took a reference for sparse devices.
+		 */
+		if (!(dev->rd_flags & RDF_SPARSE))
+			get_page(pg);
+
+		__free_page(sg_page(cmd_sg));
+		sg_set_page(cmd_sg, pg, sg->length, 0);
+		sg_set_page(sg, pg, sg->length, 0);
 	}
+	req->rd_size = 0;
 
 	return 0;
 }
@@ -583,9 +569,10 @@ static int rd_MEMCPY_write(struct rd_request *req)
 static int rd_MEMCPY_do_task(struct se_task *task)
 {
 	struct se_device *dev = task->se_dev;
+	struct rd_dev *rd_dev = dev->dev_ptr;
 	struct rd_request *req = RD_REQ(task);
 	unsigned long long lba;
-	int ret;
+	int ret = 1;
 
 	req->rd_page = (task->task_lba * dev->se_sub_dev->se_dev_attrib.block_size) / PAGE_SIZE;
 	lba = task->task_lba;
@@ -594,11 +581,19 @@ static int rd_MEMCPY_do_task(struct se_task *task)
 			   dev->se_sub_dev->se_dev_attrib.block_size;
 	req->rd_size = task->task_size;
 
-	if (task->task_data_direction == DMA_FROM_DEVICE)
-		ret = rd_MEMCPY_read(req);
-	else
-		ret = rd_MEMCPY_write(req);
-
+	if (task->task_data_direction == DMA_FROM_DEVICE) {
+		if (rd_dev->rd_direct)
+			ret = rd_DIRECT_read(req);
+		if (ret > 0)
+			ret = rd_MEMCPY(req, 1);
+	} else
+		ret = rd_MEMCPY(req, 0);
+
+	/*
+	 * A sparse device that cannot fill a hole is out of space.
+	 */
+	if (ret == -ENOMEM)
+		return PYX_TRANSPORT_OUT_OF_MEMORY_RESOURCES;
 	if (ret != 0)
 		return ret;
 
@@ -608,6 +603,76 @@ static int rd_MEMCPY_do_task(struct se_task *task)
 	return PYX_TRANSPORT_SENT_TO_TRANSPORT;
 }
 
+/*	rd_do_discard(): (Part of se_subsystem_api_t template)
+ *
+ *	UNMAP and WRITE_SAME w/ UNMAP=1 emulation.  Pages that are entirely
+ *	covered by the range are released back to the page allocator for
+ *	RDF_SPARSE devices, everything else is zeroed in place so that the
+ *	blocks read back as zeros either way.
+ */
+static int rd_do_discard(struct se_device *dev, sector_t lba, u32 range)
+{
+	struct rd_dev *rd_dev = dev->dev_ptr;
+	struct rd_dev_sg_table *table;
+	struct scatterlist *sg;
+	struct page *pg;
+	u32 block_size = dev->se_sub_dev->se_dev_attrib.block_size;
+	u64 start = (u64)lba * block_size;
+	u64 end = start + (u64)range * block_size;
+	u64 dev_size = (u64)rd_dev->rd_page_count * PAGE_SIZE;
+	u32 page, offset, len, freed = 0;
+
+	if (end > dev_size)
+		end = dev_size;
+
+	pr_debug("RD[%u]: Discard LBA: %llu Range: %u\n", rd_dev->rd_dev_id,
+		(unsigned long long)lba, range);
+
+	while (start < end) {
+		page = start >> PAGE_SHIFT;
+		offset = start & ~PAGE_MASK;
+		len = min_t(u64, end - start, PAGE_SIZE - offset);
+		start += len;
+
+		if ((rd_dev->rd_flags & RDF_SPARSE) && len == PAGE_SIZE) {
+			table = rd_get_sg_table(rd_dev, page);
+			if (!table)
+				return -EINVAL;
+			sg = &table->sg_table[page - table->page_start_offset];
+
+			spin_lock(&rd_dev->rd_page_lock);
+			pg = sg_page(sg);
+			if (pg) {
+				sg_assign_page(sg, NULL);
+				rd_dev->rd_page_alloc_count--;
+			}
+			spin_unlock(&rd_dev->rd_page_lock);
+
+			if (pg) {
+				__free_page(pg);
+				freed++;
+			}
+		} else {
+			pg = rd_get_page(rd_dev, page, 0);
+			if (IS_ERR(pg))
+				return PTR_ERR(pg);
+			if (!pg)
+				continue;
+
+			memset(page_address(pg) + offset, 0, len);
+			rd_put_page(rd_dev, pg);
+		}
+
+		if (need_resched())
+			cond_resched();
+	}
+
+	pr_debug("RD[%u]: Discard released %u pages\n", rd_dev->rd_dev_id,
+		freed);
+
+	return 0;
+}
+
 /*	rd_free_task(): (Part of se_subsystem_api_t template)
  *
  *
@@ -618,11 +683,13 @@ static void rd_free_task(struct se_task *task)
 }
 
 enum {
-	Opt_rd_pages, Opt_err
+	Opt_rd_pages, Opt_rd_sparse, Opt_rd_direct, Opt_err
 };
 
 static match_table_t tokens = {
 	{Opt_rd_pages, "rd_pages=%d"},
+	{Opt_rd_sparse, "rd_sparse=%d"},
+	{Opt_rd_direct, "rd_direct=%d"},
 	{Opt_err, NULL}
 };
 
@@ -656,6 +723,27 @@ static ssize_t rd_set_configfs_dev_params(
 				" Count: %u\n", rd_dev->rd_page_count);
 			rd_dev->rd_flags |= RDF_HAS_PAGE_COUNT;
 			break;
+		case Opt_rd_sparse:
+			if (rd_dev->sg_table_array) {
+				pr_err("Unable to change rd_sparse on an"
+					" active Ramdisk device\n");
+				ret = -EINVAL;
+				break;
+			}
+			match_int(args, &arg);
+			if (arg)
+				rd_dev->rd_flags |= RDF_SPARSE;
+			else
+				rd_dev->rd_flags &= ~RDF_SPARSE;
+			pr_debug("RAMDISK: Using %s page allocation\n",
+				(arg) ? "sparse" : "preallocated");
+			break;
+		case Opt_rd_direct:
+			match_int(args, &arg);
+			rd_dev->rd_direct = (arg != 0);
+			pr_debug("RAMDISK: Using %s READs\n",
+				(arg) ? "direct mapped" : "memcpy");
+			break;
 		default:
 			break;
 		}
@@ -689,6 +777,9 @@ static ssize_t rd_show_configfs_dev_params(
 	bl += sprintf(b + bl, "        PAGES/PAGE_SIZE: %u*%lu"
 			"  SG_table_count: %u\n", rd_dev->rd_page_count,
 			PAGE_SIZE, rd_dev->sg_table_count);
+	bl += sprintf(b + bl, "        Allocation: %s  Allocated pages: %u\n",
+			(rd_dev->rd_flags & RDF_SPARSE) ? "sparse" :
+			"preallocated", rd_dev->rd_page_alloc_count);
 	return bl;
 }
 
@@ -733,6 +824,7 @@ static struct se_subsystem_api rd_mcp_template = {
 	.alloc_task		= rd_alloc_task,
 	.do_task		= rd_MEMCPY_do_task,
 	.free_task		= rd_free_task,
+	.do_discard		= rd_do_discard,
 	.check_configfs_dev_params = rd_check_configfs_dev_params,
 	.set_configfs_dev_params = rd_set_configfs_dev_params,
 	.show_configfs_dev_params = rd_show_configfs_dev_params,
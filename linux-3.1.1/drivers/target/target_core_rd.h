@@ -42,8 +42,11 @@ struct rd_dev_sg_table {
 } ____cacheline_aligned;
 
 #define RDF_HAS_PAGE_COUNT	0x01
+/* Backing pages are allocated on first write and released by UNMAP */
+#define RDF_SPARSE		0x02
 
 struct rd_dev {
+	/* Map backing pages into the fabric SGL for READs instead of copying */
 	int		rd_direct;
 	u32		rd_flags;
 	/* Unique Ramdisk Device ID in Ramdisk HBA */
@@ -53,6 +56,10 @@ struct rd_dev {
 	/* Number of SG tables in sg_table_array */
 	u32		sg_table_count;
 	u32		rd_queue_depth;
+	/* Number of backing pages currently allocated */
+	u32		rd_page_alloc_count;
+	/* Protects sg_page() of the tables and rd_page_alloc_count for RDF_SPARSE */
+	spinlock_t	rd_page_lock;
 	/* Array of rd_dev_sg_table_t containing scatterlists */
 	struct rd_dev_sg_table *sg_table_array;
 	/* Ramdisk HBA device is connected to */
@@ -285,6 +285,16 @@ static void core_tmr_drain_task_list(
 				atomic_read(&cmd->t_task_cdbs_ex_left));
 			continue;
 		}
+		/*
+		 * The completion work already claimed this command and
+		 * will send its status, leave it alone.
+		 */
+		if (atomic_read(&cmd->t_transport_completing)) {
+			spin_unlock_irqrestore(&cmd->t_state_lock, flags);
+			pr_debug("LUN_RESET: Skipping completing task: %p,"
+				" dev: %p\n", task, dev);
+			continue;
+		}
 		fe_count = atomic_read(&cmd->t_fe_count);
 
 		if (atomic_read(&cmd->t_transport_active)) {
@@ -293,6 +303,11 @@ static void core_tmr_drain_task_list(
 				fe_count, dev);
 			atomic_set(&cmd->t_transport_aborted, 1);
 			spin_unlock_irqrestore(&cmd->t_state_lock, flags);
+			/*
+			 * A completion queued before the abort will now see
+			 * t_transport_aborted, wait for it to drop the cmd.
+			 */
+			cancel_work_sync(&cmd->work);
 
 			core_tmr_handle_tas_abort(tmr_nacl, cmd, tas, fe_count);
 			continue;
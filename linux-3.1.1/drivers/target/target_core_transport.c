@@ -70,12 +70,20 @@ struct kmem_cache *t10_alua_lu_gp_mem_cache;
 struct kmem_cache *t10_alua_tg_pt_gp_cache;
 struct kmem_cache *t10_alua_tg_pt_gp_mem_cache;
 
+/*
+ * Bound (per-CPU) workqueue for TRANSPORT_COMPLETE_OK/FAILURE, so that
+ * command completion runs on the CPU the backend completed the I/O on
+ * instead of funneling through the per device processing thread.
+ */
+static struct workqueue_struct *target_completion_wq;
+
 /* Used for transport_dev_get_map_*() */
 typedef int (*map_func_t)(struct se_task *, u32);
 
 static int transport_generic_write_pending(struct se_cmd *);
 static int transport_processing_thread(void *param);
 static int __transport_execute_tasks(struct se_device *dev);
+static int transport_execute_tasks_direct(struct se_cmd *cmd);
 static void transport_complete_task_attr(struct se_cmd *cmd);
 static int transport_complete_qf(struct se_cmd *cmd);
 static void transport_handle_queue_full(struct se_cmd *cmd,
@@ -94,6 +102,9 @@ static void transport_remove_cmd_from_queue(struct se_cmd *cmd,
 		struct se_queue_obj *qobj);
 static int transport_set_sense_codes(struct se_cmd *cmd, u8 asc, u8 ascq);
 static void transport_stop_all_task_timers(struct se_cmd *cmd);
+static void transport_generic_complete_ok(struct se_cmd *cmd);
+static void transport_generic_request_failure(struct se_cmd *,
+			struct se_device *, int, int);
 
 int init_se_kmem_caches(void)
 {
@@ -168,6 +179,12 @@ int init_se_kmem_caches(void)
 				"mem_t failed\n");
 		goto out;
 	}
+	target_completion_wq = alloc_workqueue("target_completion",
+					       WQ_MEM_RECLAIM, 0);
+	if (!target_completion_wq) {
+		pr_err("alloc_workqueue() for target_completion failed\n");
+		goto out;
+	}
 
 	return 0;
 out:
@@ -194,6 +211,7 @@ out:
 
 void release_se_kmem_caches(void)
 {
+	destroy_workqueue(target_completion_wq);
 	kmem_cache_destroy(se_cmd_cache);
 	kmem_cache_destroy(se_tmr_req_cache);
 	kmem_cache_destroy(se_sess_cache);
@@ -715,6 +733,51 @@ void transport_complete_sync_cache(struct se_cmd *cmd, int good)
 }
 EXPORT_SYMBOL(transport_complete_sync_cache);
 
+/*
+ * Completion work is not serialized with TMRs on the device thread, so
+ * a LUN_RESET may abort the command while it sits in the workqueue.
+ * Whichever of the two sees the other's flag under t_state_lock first
+ * owns the command; core_tmr_drain_task_list() leaves commands with
+ * t_transport_completing set to finish here.
+ */
+static int target_complete_work_claim(struct se_cmd *cmd)
+{
+	unsigned long flags;
+	int aborted;
+
+	spin_lock_irqsave(&cmd->t_state_lock, flags);
+	aborted = atomic_read(&cmd->t_transport_aborted);
+	if (!aborted)
+		atomic_set(&cmd->t_transport_completing, 1);
+	spin_unlock_irqrestore(&cmd->t_state_lock, flags);
+
+	if (aborted)
+		pr_debug("Skipping completion for aborted ITT: 0x%08x\n",
+			cmd->se_tfo->get_task_tag(cmd));
+	return !aborted;
+}
+
+static void target_complete_ok_work(struct work_struct *work)
+{
+	struct se_cmd *cmd = container_of(work, struct se_cmd, work);
+
+	if (!target_complete_work_claim(cmd))
+		return;
+
+	transport_stop_all_task_timers(cmd);
+	transport_generic_complete_ok(cmd);
+}
+
+static void target_complete_failure_work(struct work_struct *work)
+{
+	struct se_cmd *cmd = container_of(work, struct se_cmd, work);
+
+	if (!target_complete_work_claim(cmd))
+		return;
+
+	transport_generic_request_failure(cmd, NULL, 1, 1);
+}
+
 /*	transport_complete_task():
  *
  *	Called from interrupt and non interrupt context depending
@@ -800,21 +863,35 @@ void transport_complete_task(struct se_task *task, int success)
 		return;
 	}
 
+	/*
+	 * A LUN_RESET that already aborted the command owns it now.
+	 */
+	if (atomic_read(&cmd->t_transport_aborted)) {
+		spin_unlock_irqrestore(&cmd->t_state_lock, flags);
+		return;
+	}
+	/*
+	 * Hand the completion to target_completion_wq on this CPU, it
+	 * does not need the ordering of the per device processing thread.
+	 */
 	if (!success || cmd->t_tasks_failed) {
-		t_state = TRANSPORT_COMPLETE_FAILURE;
+		cmd->t_state = TRANSPORT_COMPLETE_FAILURE;
 		if (!task->task_error_status) {
 			task->task_error_status =
 				PYX_TRANSPORT_UNKNOWN_SAM_OPCODE;
 			cmd->transport_error_status =
 				PYX_TRANSPORT_UNKNOWN_SAM_OPCODE;
 		}
+		INIT_WORK(&cmd->work, target_complete_failure_work);
 	} else {
 		atomic_set(&cmd->t_transport_complete, 1);
-		t_state = TRANSPORT_COMPLETE_OK;
+		cmd->t_state = TRANSPORT_COMPLETE_OK;
+		INIT_WORK(&cmd->work, target_complete_ok_work);
 	}
+	atomic_set(&cmd->t_transport_active, 1);
 	spin_unlock_irqrestore(&cmd->t_state_lock, flags);
 
-	transport_add_cmd_to_queue(cmd, t_state);
+	queue_work(target_completion_wq, &cmd->work);
 }
 EXPORT_SYMBOL(transport_complete_task);
 
@@ -933,7 +1010,12 @@ static void transport_add_tasks_from_cmd(struct se_cmd *cmd)
 
 	spin_lock_irqsave(&dev->execute_task_lock, flags);
 	list_for_each_entry(task, &cmd->t_task_list, t_list) {
-		if (atomic_read(&task->task_execute_queue))
+		/*
+		 * Tasks already dispatched by transport_execute_tasks_direct()
+		 * before the device queue filled up are skipped as well.
+		 */
+		if (atomic_read(&task->task_execute_queue) ||
+		    atomic_read(&task->task_sent))
 			continue;
 		/*
 		 * __transport_add_task_to_execute_queue() handles the
@@ -1603,6 +1685,7 @@ void transport_init_se_cmd(
 	init_completion(&cmd->transport_lun_fe_stop_comp);
 	init_completion(&cmd->transport_lun_stop_comp);
 	init_completion(&cmd->t_transport_stop_comp);
+	INIT_WORK(&cmd->work, target_complete_ok_work);
 	spin_lock_init(&cmd->t_state_lock);
 	atomic_set(&cmd->transport_dev_active, 1);
 
@@ -1747,8 +1830,6 @@ int transport_generic_handle_cdb(
 }
 EXPORT_SYMBOL(transport_generic_handle_cdb);
 
-static void transport_generic_request_failure(struct se_cmd *,
-			struct se_device *, int, int);
 /*
  * Used by fabric module frontends to queue tasks directly.
  * Many only be used from process context only
@@ -1816,13 +1897,49 @@ int transport_generic_handle_cdb_map(
 }
 EXPORT_SYMBOL(transport_generic_handle_cdb_map);
 
-/*	transport_generic_handle_data():
- *
- *
+/*
+ * Process context counterpart of transport_generic_handle_cdb_map() for
+ * fabric modules that defer submission to their own (per-CPU) process
+ * context: calls TFO->new_cmd_map() and submits the command on the
+ * calling CPU via transport_handle_cdb_direct().
  */
-int transport_generic_handle_data(
+int transport_generic_handle_cdb_map_direct(
 	struct se_cmd *cmd)
 {
+	int ret;
+
+	if (!cmd->se_lun) {
+		dump_stack();
+		pr_err("cmd->se_lun is NULL\n");
+		return -EINVAL;
+	}
+	if (in_interrupt()) {
+		dump_stack();
+		pr_err("transport_generic_handle_cdb_map_direct cannot be"
+				" called from interrupt context\n");
+		return -EINVAL;
+	}
+
+	ret = cmd->se_tfo->new_cmd_map(cmd);
+	if (ret < 0) {
+		cmd->t_state = TRANSPORT_NEW_CMD_MAP;
+		atomic_set(&cmd->t_transport_active, 1);
+		cmd->transport_error_status = ret;
+		transport_generic_request_failure(cmd, NULL, 0,
+				(cmd->data_direction != DMA_TO_DEVICE));
+		return 0;
+	}
+
+	return transport_handle_cdb_direct(cmd);
+}
+EXPORT_SYMBOL(transport_generic_handle_cdb_map_direct);
+
+static int __transport_generic_handle_data(
+	struct se_cmd *cmd,
+	int direct)
+{
+	unsigned long flags;
+
 	/*
 	 * For the software fabric case, then we assume the nexus is being
 	 * failed/shutdown when signals are pending from the kthread context
@@ -1841,11 +1958,52 @@ int transport_generic_handle_data(
 	if (transport_check_aborted_status(cmd, 1) != 0)
 		return 0;
 
-	transport_add_cmd_to_queue(cmd, TRANSPORT_PROCESS_WRITE);
+	if (!direct) {
+		transport_add_cmd_to_queue(cmd, TRANSPORT_PROCESS_WRITE);
+		return 0;
+	}
+
+	spin_lock_irqsave(&cmd->t_state_lock, flags);
+	cmd->t_state = TRANSPORT_PROCESS_WRITE;
+	atomic_set(&cmd->t_transport_active, 1);
+	spin_unlock_irqrestore(&cmd->t_state_lock, flags);
+
+	transport_generic_process_write(cmd);
 	return 0;
 }
+
+/*	transport_generic_handle_data():
+ *
+ *
+ */
+int transport_generic_handle_data(
+	struct se_cmd *cmd)
+{
+	return __transport_generic_handle_data(cmd, 0);
+}
 EXPORT_SYMBOL(transport_generic_handle_data);
 
+/*	transport_generic_handle_data_direct():
+ *
+ *	Dispatch the WRITE to the backend from the calling fabric thread,
+ *	on the CPU that received the data, instead of through
+ *	transport_processing_thread().  Process context only, with no
+ *	locks held.
+ */
+int transport_generic_handle_data_direct(
+	struct se_cmd *cmd)
+{
+	if (in_interrupt()) {
+		dump_stack();
+		pr_err("transport_generic_handle_data_direct cannot be"
+				" called from interrupt context\n");
+		return -EINVAL;
+	}
+
+	return __transport_generic_handle_data(cmd, 1);
+}
+EXPORT_SYMBOL(transport_generic_handle_data_direct);
+
 /*	transport_generic_handle_tmr():
  *
  *
@@ -2401,6 +2559,15 @@ static int transport_execute_tasks(struct se_cmd *cmd)
 		add_tasks = transport_execute_task_attr(cmd);
 		if (!add_tasks)
 			goto execute_tasks;
+		/*
+		 * Everything but ORDERED may bypass the per device execution
+		 * queue as long as nothing is waiting on it already, the SAM
+		 * ordering rules are kept by transport_execute_task_attr().
+		 */
+		if (cmd->sam_task_attr != MSG_ORDERED_TAG &&
+		    !atomic_read(&cmd->se_dev->execute_tasks) &&
+		    !transport_execute_tasks_direct(cmd))
+			return 0;
 		/*
 		 * This calls transport_add_tasks_from_cmd() to handle
 		 * HEAD_OF_QUEUE ordering for SAM Task Attribute emulation
@@ -2419,43 +2586,16 @@ execute_tasks:
 }
 
 /*
- * Called to check struct se_device tcq depth window, and once open pull struct se_task
- * from struct se_device->execute_task_list and
- *
- * Called from transport_processing_thread()
+ * Send a single struct se_task to the backend, the caller has already
+ * taken it off any execution list and accounted for it in
+ * dev->depth_left.  Returns non zero if the struct se_cmd failed and
+ * the rest of its tasks must not be sent.
  */
-static int __transport_execute_tasks(struct se_device *dev)
+static int __transport_execute_task(struct se_device *dev, struct se_task *task)
 {
-	int error;
-	struct se_cmd *cmd = NULL;
-	struct se_task *task = NULL;
+	struct se_cmd *cmd = task->task_se_cmd;
 	unsigned long flags;
-
-	/*
-	 * Check if there is enough room in the device and HBA queue to send
-	 * struct se_tasks to the selected transport.
-	 */
-check_depth:
-	if (!atomic_read(&dev->depth_left))
-		return transport_tcq_window_closed(dev);
-
-	dev->dev_tcq_window_closed = 0;
-
-	spin_lock_irq(&dev->execute_task_lock);
-	if (list_empty(&dev->execute_task_list)) {
-		spin_unlock_irq(&dev->execute_task_lock);
-		return 0;
-	}
-	task = list_first_entry(&dev->execute_task_list,
-				struct se_task, t_execute_list);
-	list_del(&task->t_execute_list);
-	atomic_set(&task->task_execute_queue, 0);
-	atomic_dec(&dev->execute_tasks);
-	spin_unlock_irq(&dev->execute_task_lock);
-
-	atomic_dec(&dev->depth_left);
-
-	cmd = task->task_se_cmd;
+	int error;
 
 	spin_lock_irqsave(&cmd->t_state_lock, flags);
 	atomic_set(&task->task_active, 1);
@@ -2481,7 +2621,7 @@ check_depth:
 			atomic_set(&cmd->transport_sent, 0);
 			transport_stop_tasks_for_cmd(cmd);
 			transport_generic_request_failure(cmd, dev, 0, 1);
-			goto check_depth;
+			return error;
 		}
 		/*
 		 * Handle the successful completion for transport_emulate_cdb()
@@ -2517,14 +2657,93 @@ check_depth:
 			atomic_set(&cmd->transport_sent, 0);
 			transport_stop_tasks_for_cmd(cmd);
 			transport_generic_request_failure(cmd, dev, 0, 1);
+			return error;
 		}
 	}
 
+	return 0;
+}
+
+/*
+ * Called to check struct se_device tcq depth window, and once open pull struct se_task
+ * from struct se_device->execute_task_list and
+ *
+ * Called from transport_processing_thread()
+ */
+static int __transport_execute_tasks(struct se_device *dev)
+{
+	struct se_task *task = NULL;
+
+	/*
+	 * Check if there is enough room in the device and HBA queue to send
+	 * struct se_tasks to the selected transport.
+	 */
+check_depth:
+	if (!atomic_read(&dev->depth_left))
+		return transport_tcq_window_closed(dev);
+
+	dev->dev_tcq_window_closed = 0;
+
+	spin_lock_irq(&dev->execute_task_lock);
+	if (list_empty(&dev->execute_task_list)) {
+		spin_unlock_irq(&dev->execute_task_lock);
+		return 0;
+	}
+	task = list_first_entry(&dev->execute_task_list,
+				struct se_task, t_execute_list);
+	list_del(&task->t_execute_list);
+	atomic_set(&task->task_execute_queue, 0);
+	atomic_dec(&dev->execute_tasks);
+	spin_unlock_irq(&dev->execute_task_lock);
+
+	atomic_dec(&dev->depth_left);
+
+	__transport_execute_task(dev, task);
+
 	goto check_depth;
 
 	return 0;
 }
 
+/*
+ * Fast path of transport_execute_tasks() for SIMPLE, untagged and
+ * HEAD_OF_QUEUE commands: send the tasks to the backend right here in
+ * the submitting (fabric) context, on the CPU that received the command,
+ * without going through dev->execute_task_list and its lock.  Only when
+ * the device queue depth is exhausted are the remaining tasks queued for
+ * transport_processing_thread() like before.
+ *
+ * Returns zero if every task has been sent.
+ */
+static int transport_execute_tasks_direct(struct se_cmd *cmd)
+{
+	struct se_device *dev = cmd->se_dev;
+	struct se_task *task, *next, *last;
+	/*
+	 * The tasks still have to be visible on dev->state_task_list for
+	 * LUN_RESET and device shutdown.
+	 */
+	transport_add_tasks_to_state_queue(cmd);
+
+	last = list_entry(cmd->t_task_list.prev, struct se_task, t_list);
+	list_for_each_entry_safe(task, next, &cmd->t_task_list, t_list) {
+		if (!atomic_add_unless(&dev->depth_left, -1, 0))
+			return -EAGAIN;
+		/*
+		 * Once the last task is sent the command may complete, and
+		 * be released, before __transport_execute_task() returns.
+		 */
+		if (task == last) {
+			__transport_execute_task(dev, task);
+			return 0;
+		}
+		if (__transport_execute_task(dev, task))
+			return 0;
+	}
+
+	return 0;
+}
+
 void transport_new_cmd_failure(struct se_cmd *se_cmd)
 {
 	unsigned long flags;
@@ -1442,11 +1442,18 @@ out:
  */
 static int ext3_has_free_blocks(struct ext3_sb_info *sbi)
 {
-	ext3_fsblk_t free_blocks, root_blocks;
+	ext3_fsblk_t root_blocks;
 
-	free_blocks = percpu_counter_read_positive(&sbi->s_freeblocks_counter);
 	root_blocks = le32_to_cpu(sbi->s_es->s_r_blocks_count);
-	if (free_blocks < root_blocks + 1 && !capable(CAP_SYS_RESOURCE) &&
+	/*
+	 * The counter is adaptive, so the rough count may be off by a lot
+	 * more than percpu_counter_batch.  percpu_counter_compare() sums it
+	 * up when it is that close to the reserve, and shrinks the batch
+	 * again while the filesystem stays nearly full.
+	 */
+	if (percpu_counter_compare(&sbi->s_freeblocks_counter,
+				   root_blocks + 1) < 0 &&
+		!capable(CAP_SYS_RESOURCE) &&
 		sbi->s_resuid != current_fsuid() &&
 		(sbi->s_resgid == 0 || !in_group_p (sbi->s_resgid))) {
 		return 0;
@@ -2003,6 +2003,9 @@ static int ext3_fill_super (struct super_block *sb, void *data, int silent)
 		ret = err;
 		goto failed_mount3;
 	}
+	/* only hints for the allocators; let busy counters batch more */
+	percpu_counter_set_adaptive(&sbi->s_freeblocks_counter, 0);
+	percpu_counter_set_adaptive(&sbi->s_freeinodes_counter, 0);
 
 	/* We have now updated the journal if required, so we can
 	 * validate the data journaling mode. */
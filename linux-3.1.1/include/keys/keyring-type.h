@@ -24,7 +24,11 @@ struct keyring_list {
 	unsigned short	maxkeys;	/* max keys this list can hold */
 	unsigned short	nkeys;		/* number of keys currently held */
 	unsigned short	delkey;		/* key to be unlinked by RCU */
+	unsigned short	hmask;		/* mask for the lookup index */
 	struct key	*keys[0];
+	/* followed by hmask + 1 index slots (unsigned short), each holding
+	 * 1 + the keys[] slot of a key, hashed by type and description, or 0
+	 * if the index slot is unused */
 };
 
 
@@ -29,6 +29,49 @@
 
 #ifndef __GENALLOC_H__
 #define __GENALLOC_H__
+
+#include <linux/percpu.h>
+
+/**
+ * Allocation callback function type definition
+ * @map: Pointer to bitmap
+ * @size: The bitmap size in bits
+ * @start: The bitnumber to start searching at
+ * @nr: The number of zeroed bits we're looking for
+ * @data: optional additional data used by @genpool_algo_t
+ */
+typedef unsigned long (*genpool_algo_t)(unsigned long *map,
+			unsigned long size,
+			unsigned long start,
+			unsigned int nr,
+			void *data);
+
+/*
+ * Number of objects a per-CPU magazine can hold and number of distinct
+ * allocation sizes that can be cached per pool.
+ */
+#define GEN_POOL_MAGAZINE_SIZE	16
+#define GEN_POOL_MAX_CACHES	4
+
+/*
+ *  Per-CPU magazine of free objects of one cached size.  The lock is
+ *  only contended when an allocation that found the bitmaps exhausted
+ *  flushes the magazines of other CPUs.
+ */
+struct gen_pool_magazine {
+	spinlock_t lock;
+	int count;
+	unsigned long objs[GEN_POOL_MAGAZINE_SIZE];
+};
+
+/*
+ *  Per-CPU object cache for one common allocation size.
+ */
+struct gen_pool_cache {
+	size_t size;			/* granule-rounded object size */
+	struct gen_pool_magazine __percpu *mag;
+};
+
 /*
  *  General purpose special memory pool descriptor.
  */
@@ -36,10 +79,22 @@ struct gen_pool {
 	spinlock_t lock;
 	struct list_head chunks;	/* list of chunks in this pool */
 	int min_alloc_order;		/* minimum allocation order */
+
+	genpool_algo_t algo;		/* allocation function */
+	void *data;
+
+	int nr_caches;			/* number of per-CPU caches in use */
+	struct gen_pool_cache caches[GEN_POOL_MAX_CACHES];
 };
 
 /*
  *  General purpose special memory pool chunk descriptor.
+ *
+ *  The @full bitmap summarises @bits: bit n is set when word n of @bits
+ *  is known to be completely allocated.  No free area can span such a
+ *  word, so first-fit searches only look at the runs of words between
+ *  them.  It is only a hint and is kept up to date locklessly by the
+ *  set/clear paths.
  */
 struct gen_pool_chunk {
 	struct list_head next_chunk;	/* next chunk in pool */
@@ -47,6 +102,7 @@ struct gen_pool_chunk {
 	phys_addr_t phys_addr;		/* physical starting address of memory chunk */
 	unsigned long start_addr;	/* starting address of memory chunk */
 	unsigned long end_addr;		/* ending address of memory chunk */
+	unsigned long *full;		/* summary bitmap of full words in @bits */
 	unsigned long bits[0];		/* bitmap for allocating memory chunk */
 };
 
@@ -78,4 +134,17 @@ extern void gen_pool_for_each_chunk(struct gen_pool *,
 	void (*)(struct gen_pool *, struct gen_pool_chunk *, void *), void *);
 extern size_t gen_pool_avail(struct gen_pool *);
 extern size_t gen_pool_size(struct gen_pool *);
+
+extern void gen_pool_set_algo(struct gen_pool *pool, genpool_algo_t algo,
+		void *data);
+
+extern unsigned long gen_pool_first_fit(unsigned long *map, unsigned long size,
+		unsigned long start, unsigned int nr, void *data);
+
+extern unsigned long gen_pool_best_fit(unsigned long *map, unsigned long size,
+		unsigned long start, unsigned int nr, void *data);
+
+extern int gen_pool_add_cache(struct gen_pool *pool, size_t size);
+extern void gen_pool_drain_caches(struct gen_pool *pool);
+
 #endif /* __GENALLOC_H__ */
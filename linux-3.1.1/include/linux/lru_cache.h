@@ -31,6 +31,8 @@
 #include <linux/bitops.h>
 #include <linux/string.h> /* for memset */
 #include <linux/seq_file.h>
+#include <linux/rculist.h>
+#include <linux/atomic.h>
 
 /*
 This header file (and its .c file; kernel-doc of functions see there)
@@ -155,11 +157,21 @@ write intent log information, three of which are mentioned here.
  * as well.  Which also means that using a kmem_cache to allocate the objects
  * from wastes some resources.
  * But it avoids high order page allocations in kmalloc.
+ *
+ * Because elements are never freed while the cache exists, the hash chains
+ * may be walked under rcu_read_lock() without the user's lock, see
+ * lc_try_get_active().  To make that safe against an element being recycled
+ * under the lockless reader, .refcnt does not only hold the reference count
+ * (LC_REFCNT_MASK bits, read it with lc_refcnt()), but also a "label change
+ * pending" flag and a generation number that is bumped on every label change.
+ * A lockless reader only takes a reference with a cmpxchg on the whole word,
+ * so it fails if the element changed its label in the mean time, unless the
+ * generation wrapped; which is why it checks the label again afterwards.
  */
 struct lc_element {
 	struct hlist_node colision;
 	struct list_head list;		 /* LRU list or free list */
-	unsigned refcnt;
+	atomic_t refcnt;
 	/* back "pointer" into lc_cache->element[index],
 	 * for paranoia, and for "lc_element_to_index" */
 	unsigned lc_index;
@@ -171,6 +183,17 @@ struct lc_element {
 #define LC_FREE (~0U)
 };
 
+/* layout of lc_element.refcnt */
+#define LC_REFCNT_BITS	20
+#define LC_REFCNT_MASK	((1U << LC_REFCNT_BITS) - 1)
+#define LC_CHANGING	(1U << LC_REFCNT_BITS)
+#define LC_GEN_ONE	(1U << (LC_REFCNT_BITS + 1))
+
+static inline unsigned lc_refcnt(struct lc_element *e)
+{
+	return (unsigned)atomic_read(&e->refcnt) & LC_REFCNT_MASK;
+}
+
 struct lru_cache {
 	/* the least recently used item is kept at lru->prev */
 	struct list_head lru;
@@ -251,6 +274,9 @@ extern struct lc_element *lc_get(struct lru_cache *lc, unsigned int enr);
 extern unsigned int lc_put(struct lru_cache *lc, struct lc_element *e);
 extern void lc_changed(struct lru_cache *lc, struct lc_element *e);
 
+extern struct lc_element *lc_try_get_active(struct lru_cache *lc, unsigned int enr);
+extern int lc_try_put_active(struct lru_cache *lc, unsigned int enr);
+
 struct seq_file;
 extern size_t lc_seq_printf_stats(struct seq_file *seq, struct lru_cache *lc);
 
@@ -282,7 +308,7 @@ static inline void lc_unlock(struct lru_cache *lc)
 static inline int lc_is_used(struct lru_cache *lc, unsigned int enr)
 {
 	struct lc_element *e = lc_find(lc, enr);
-	return e && e->refcnt;
+	return e && lc_refcnt(e);
 }
 
 #define lc_entry(ptr, type, member) \
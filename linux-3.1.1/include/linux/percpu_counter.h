@@ -22,10 +22,16 @@ struct percpu_counter {
 	struct list_head list;	/* All percpu_counters are on a list */
 #endif
 	s32 __percpu *counters;
+	s32 batch;		/* adaptive batch size, 0 if not adaptive */
+	s32 batch_limit;	/* upper bound for @batch */
+	s32 batch_seen;		/* bound on the per-cpu deltas */
 };
 
 extern int percpu_counter_batch;
 
+/* default upper bound for percpu_counter_set_adaptive() */
+#define PERCPU_COUNTER_BATCH_LIMIT	1024
+
 int __percpu_counter_init(struct percpu_counter *fbc, s64 amount,
 			  struct lock_class_key *key);
 
@@ -38,13 +44,28 @@ int __percpu_counter_init(struct percpu_counter *fbc, s64 amount,
 
 void percpu_counter_destroy(struct percpu_counter *fbc);
 void percpu_counter_set(struct percpu_counter *fbc, s64 amount);
+void percpu_counter_set_adaptive(struct percpu_counter *fbc, s32 limit);
 void __percpu_counter_add(struct percpu_counter *fbc, s64 amount, s32 batch);
 s64 __percpu_counter_sum(struct percpu_counter *fbc);
+s64 percpu_counter_error(struct percpu_counter *fbc);
 int percpu_counter_compare(struct percpu_counter *fbc, s64 rhs);
+int percpu_counter_compare_approx(struct percpu_counter *fbc, s64 rhs,
+				  s64 slack);
+
+/*
+ * Batch at which percpu_counter_add() folds the local delta into fbc->count:
+ * the counter's adaptive batch if it has one, percpu_counter_batch otherwise.
+ */
+static inline s32 percpu_counter_cur_batch(struct percpu_counter *fbc)
+{
+	s32 batch = ACCESS_ONCE(fbc->batch);
+
+	return batch ? batch : percpu_counter_batch;
+}
 
 static inline void percpu_counter_add(struct percpu_counter *fbc, s64 amount)
 {
-	__percpu_counter_add(fbc, amount, percpu_counter_batch);
+	__percpu_counter_add(fbc, amount, percpu_counter_cur_batch(fbc));
 }
 
 static inline s64 percpu_counter_sum_positive(struct percpu_counter *fbc)
@@ -104,6 +125,16 @@ static inline void percpu_counter_set(struct percpu_counter *fbc, s64 amount)
 	fbc->count = amount;
 }
 
+static inline void
+percpu_counter_set_adaptive(struct percpu_counter *fbc, s32 limit)
+{
+}
+
+static inline s64 percpu_counter_error(struct percpu_counter *fbc)
+{
+	return 0;
+}
+
 static inline int percpu_counter_compare(struct percpu_counter *fbc, s64 rhs)
 {
 	if (fbc->count > rhs)
@@ -114,6 +145,12 @@ static inline int percpu_counter_compare(struct percpu_counter *fbc, s64 rhs)
 		return 0;
 }
 
+static inline int
+percpu_counter_compare_approx(struct percpu_counter *fbc, s64 rhs, s64 slack)
+{
+	return percpu_counter_compare(fbc, rhs);
+}
+
 static inline void
 percpu_counter_add(struct percpu_counter *fbc, s64 amount)
 {
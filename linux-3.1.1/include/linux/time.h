@@ -170,6 +170,7 @@ extern int timekeeping_valid_for_hres(void);
 extern u64 timekeeping_max_deferment(void);
 extern void timekeeping_leap_insert(int leapsecond);
 extern int timekeeping_inject_offset(struct timespec *ts);
+extern unsigned long timekeeping_read_retries(void);
 
 struct tms;
 extern void do_sys_times(struct tms *);
@@ -477,6 +477,8 @@ struct se_cmd {
 	struct se_session	*se_sess;
 	struct se_tmr_req	*se_tmr_req;
 	struct list_head	se_queue_node;
+	/* Used for completion in target_completion_wq */
+	struct work_struct	work;
 	struct target_core_fabric_ops *se_tfo;
 	int (*transport_emulate_cdb)(struct se_cmd *);
 	void (*transport_split_cdb)(unsigned long long, u32, unsigned char *);
@@ -500,6 +502,7 @@ struct se_cmd {
 	atomic_t		t_transport_aborted;
 	atomic_t		t_transport_active;
 	atomic_t		t_transport_complete;
+	atomic_t		t_transport_completing;
 	atomic_t		t_transport_queue_active;
 	atomic_t		t_transport_sent;
 	atomic_t		t_transport_stop;
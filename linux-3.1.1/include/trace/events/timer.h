@@ -323,6 +323,53 @@ TRACE_EVENT(itimer_expire,
 		  (int) __entry->pid, (unsigned long long)__entry->now)
 );
 
+/**
+ * tick_stop - called when an idle CPU tries to stop its tick
+ * @success:	whether the tick was stopped
+ * @reason:	what kept the tick running, "none" or "cpu_offline" on success
+ */
+TRACE_EVENT(tick_stop,
+
+	TP_PROTO(int success, const char *reason),
+
+	TP_ARGS(success, reason),
+
+	TP_STRUCT__entry(
+		__field(	int,	success	)
+		__string(	reason,	reason	)
+	),
+
+	TP_fast_assign(
+		__entry->success = success;
+		__assign_str(reason, reason);
+	),
+
+	TP_printk("success=%s reason=%s",
+		  __entry->success ? "yes" : "no", __get_str(reason))
+);
+
+/**
+ * tick_fire - called when the tick timer of a CPU expires
+ * @stopped:	whether the tick was stopped, so that this is the wakeup
+ *		programmed for the next timer rather than a periodic tick
+ */
+TRACE_EVENT(tick_fire,
+
+	TP_PROTO(int stopped),
+
+	TP_ARGS(stopped),
+
+	TP_STRUCT__entry(
+		__field(	int,	stopped	)
+	),
+
+	TP_fast_assign(
+		__entry->stopped = stopped;
+	),
+
+	TP_printk("reason=%s", __entry->stopped ? "timer" : "periodic")
+);
+
 #endif /*  _TRACE_TIMER_H */
 
 /* This part must be outside protection */
@@ -23,6 +23,8 @@
 
 #include <asm/irq_regs.h>
 
+#include <trace/events/timer.h>
+
 #include "tick-internal.h"
 
 /*
@@ -260,6 +262,7 @@ void tick_nohz_stop_sched_tick(int inidle)
 	struct tick_sched *ts;
 	ktime_t last_update, expires, now;
 	struct clock_event_device *dev = __get_cpu_var(tick_cpu_device).evtdev;
+	const char *reason = NULL;
 	u64 time_delta;
 	int cpu;
 
@@ -297,15 +300,21 @@ void tick_nohz_stop_sched_tick(int inidle)
 			tick_do_timer_cpu = TICK_DO_TIMER_NONE;
 	}
 
-	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE))
+	if (unlikely(ts->nohz_mode == NOHZ_MODE_INACTIVE)) {
+		trace_tick_stop(0, "nohz_inactive");
 		goto end;
+	}
 
-	if (need_resched())
+	if (need_resched()) {
+		trace_tick_stop(0, "need_resched");
 		goto end;
+	}
 
 	if (unlikely(local_softirq_pending() && cpu_online(cpu))) {
 		static int ratelimit;
 
+		trace_tick_stop(0, "softirq");
+
 		if (ratelimit < 10) {
 			printk(KERN_ERR "NOHZ: local_softirq_pending %02x\n",
 			       (unsigned int) local_softirq_pending());
@@ -323,8 +332,14 @@ void tick_nohz_stop_sched_tick(int inidle)
 		time_delta = timekeeping_max_deferment();
 	} while (read_seqretry(&xtime_lock, seq));
 
-	if (rcu_needs_cpu(cpu) || printk_needs_cpu(cpu) ||
-	    arch_needs_cpu(cpu)) {
+	if (rcu_needs_cpu(cpu))
+		reason = "rcu";
+	else if (printk_needs_cpu(cpu))
+		reason = "printk";
+	else if (arch_needs_cpu(cpu))
+		reason = "arch";
+
+	if (reason) {
 		next_jiffies = last_jiffies + 1;
 		delta_jiffies = 1;
 	} else {
@@ -336,8 +351,10 @@ void tick_nohz_stop_sched_tick(int inidle)
 	 * Do not stop the tick, if we are only one off
 	 * or if the cpu is required for rcu
 	 */
-	if (!ts->tick_stopped && delta_jiffies == 1)
+	if (!ts->tick_stopped && delta_jiffies == 1) {
+		trace_tick_stop(0, reason ? reason : "timer");
 		goto out;
+	}
 
 	/* Schedule the tick, if we are at least one jiffie off */
 	if ((long)delta_jiffies >= 1) {
@@ -410,6 +427,8 @@ void tick_nohz_stop_sched_tick(int inidle)
 			ts->tick_stopped = 1;
 			ts->idle_jiffies = last_jiffies;
 			rcu_enter_nohz();
+			trace_tick_stop(1, cpu_online(cpu) ? "none" :
+					"cpu_offline");
 		}
 
 		ts->idle_sleeps++;
@@ -440,6 +459,7 @@ void tick_nohz_stop_sched_tick(int inidle)
 		 * jiffie boundary. Update jiffies and raise the
 		 * softirq.
 		 */
+		trace_tick_stop(0, "expired");
 		tick_do_update_jiffies64(ktime_get());
 		cpumask_clear_cpu(cpu, nohz_cpu_mask);
 	}
@@ -569,6 +589,7 @@ static void tick_nohz_handler(struct clock_event_device *dev)
 	ktime_t now = ktime_get();
 
 	dev->next_event.tv64 = KTIME_MAX;
+	trace_tick_fire(ts->tick_stopped);
 
 	/*
 	 * Check if the do_timer duty was dropped. We don't care about
@@ -723,6 +744,7 @@ static enum hrtimer_restart tick_sched_timer(struct hrtimer *timer)
 	ktime_t now = ktime_get();
 	int cpu = smp_processor_id();
 
+	trace_tick_fire(ts->tick_stopped);
 #ifdef CONFIG_NO_HZ
 	/*
 	 * Check if the do_timer duty was dropped. We don't care about
@@ -169,11 +169,133 @@ static struct timespec raw_time;
 /* flag for if timekeeping is suspended */
 int __read_mostly timekeeping_suspended;
 
+/*
+ * Reader-facing copy of the state needed to read the time, kept as a
+ * latch: two copies and a sequence count whose low bit tells readers
+ * which copy is stable.  The writer flips the count before rewriting
+ * each copy, so a reader only retries if it raced with one of those two
+ * short copies, never for the whole of update_wall_time() and the NTP
+ * work done under xtime_lock.
+ *
+ * Only in-kernel readers and the syscalls built on them use the latch.
+ * The vDSO and vsyscall readers go through update_vsyscall() and keep
+ * their own seqlock.
+ */
+struct tk_fast_base {
+	struct clocksource	*clock;
+	cycle_t			cycle_last;
+	cycle_t			mask;
+	u32			mult;
+	int			shift;
+	struct timespec		xtime;
+	struct timespec		wall_to_monotonic;
+};
+
+static struct {
+	unsigned int		seq;
+	struct tk_fast_base	base[2];
+} tk_fast ____cacheline_aligned;
+
+/* Number of latch reads that had to be retried, for the benchmark. */
+static DEFINE_PER_CPU(unsigned long, tk_fast_retries);
+
+static void tk_fast_fill(struct tk_fast_base *base)
+{
+	base->clock = timekeeper.clock;
+	base->cycle_last = timekeeper.clock->cycle_last;
+	base->mask = timekeeper.clock->mask;
+	base->mult = timekeeper.mult;
+	base->shift = timekeeper.shift;
+	base->xtime = xtime;
+	base->wall_to_monotonic = wall_to_monotonic;
+}
+
+/*
+ * Publish the current timekeeping state to readers.  Must be called,
+ * with xtime_lock held for writing, whenever xtime, wall_to_monotonic,
+ * the clocksource or its cycle_last or mult change.
+ */
+static void tk_fast_update(void)
+{
+	/* steer readers to base[1], and only then rewrite base[0] */
+	smp_wmb();
+	tk_fast.seq++;
+	smp_wmb();
+	tk_fast_fill(&tk_fast.base[0]);
+	/* base[0] must be complete before readers are sent back to it */
+	smp_wmb();
+	tk_fast.seq++;
+	smp_wmb();
+	tk_fast_fill(&tk_fast.base[1]);
+}
+
+/*
+ * Read xtime, optionally wall_to_monotonic, and the nanoseconds elapsed
+ * since they were last updated, all consistent with each other.
+ */
+static __always_inline void tk_fast_read(struct timespec *ts,
+					 struct timespec *tomono, s64 *nsecs)
+{
+#ifdef CONFIG_ARCH_USES_GETTIMEOFFSET
+	unsigned long seq;
+
+	/* the arch tick offset is only consistent with xtime_lock held */
+	do {
+		seq = read_seqbegin(&xtime_lock);
+		*ts = xtime;
+		if (tomono)
+			*tomono = wall_to_monotonic;
+		*nsecs = timekeeping_get_ns() + arch_gettimeoffset();
+	} while (read_seqretry(&xtime_lock, seq));
+#else
+	struct tk_fast_base *base;
+	cycle_t cycle_delta;
+	unsigned int seq;
+
+	for (;;) {
+		seq = ACCESS_ONCE(tk_fast.seq);
+		smp_rmb();
+		base = &tk_fast.base[seq & 1];
+
+		*ts = base->xtime;
+		if (tomono)
+			*tomono = base->wall_to_monotonic;
+		cycle_delta = (base->clock->read(base->clock) -
+			       base->cycle_last) & base->mask;
+		*nsecs = clocksource_cyc2ns(cycle_delta, base->mult,
+					    base->shift);
+
+		smp_rmb();
+		if (likely(ACCESS_ONCE(tk_fast.seq) == seq))
+			break;
+		this_cpu_inc(tk_fast_retries);
+	}
+#endif
+}
+
+/**
+ * timekeeping_read_retries - Number of lockless time reads retried so far
+ *
+ * Summed over all CPUs; only meant for measuring reader contention.
+ */
+unsigned long timekeeping_read_retries(void)
+{
+	unsigned long sum = 0;
+	int cpu;
+
+	for_each_possible_cpu(cpu)
+		sum += per_cpu(tk_fast_retries, cpu);
+	return sum;
+}
+EXPORT_SYMBOL_GPL(timekeeping_read_retries);
+
 /* must hold xtime_lock */
 void timekeeping_leap_insert(int leapsecond)
 {
 	xtime.tv_sec += leapsecond;
 	wall_to_monotonic.tv_sec -= leapsecond;
+	/* readers see this when update_wall_time() publishes, as xtime.tv_nsec
+	 * is not yet consistent with cycle_last here */
 	update_vsyscall(&xtime, &wall_to_monotonic, timekeeper.clock,
 			timekeeper.mult);
 }
@@ -216,21 +338,11 @@ static void timekeeping_forward_now(void)
  */
 void getnstimeofday(struct timespec *ts)
 {
-	unsigned long seq;
 	s64 nsecs;
 
 	WARN_ON(timekeeping_suspended);
 
-	do {
-		seq = read_seqbegin(&xtime_lock);
-
-		*ts = xtime;
-		nsecs = timekeeping_get_ns();
-
-		/* If arch requires, add in gettimeoffset() */
-		nsecs += arch_gettimeoffset();
-
-	} while (read_seqretry(&xtime_lock, seq));
+	tk_fast_read(ts, NULL, &nsecs);
 
 	timespec_add_ns(ts, nsecs);
 }
@@ -239,18 +351,14 @@ EXPORT_SYMBOL(getnstimeofday);
 
 ktime_t ktime_get(void)
 {
-	unsigned int seq;
+	struct timespec now, tomono;
 	s64 secs, nsecs;
 
 	WARN_ON(timekeeping_suspended);
 
-	do {
-		seq = read_seqbegin(&xtime_lock);
-		secs = xtime.tv_sec + wall_to_monotonic.tv_sec;
-		nsecs = xtime.tv_nsec + wall_to_monotonic.tv_nsec;
-		nsecs += timekeeping_get_ns();
-
-	} while (read_seqretry(&xtime_lock, seq));
+	tk_fast_read(&now, &tomono, &nsecs);
+	secs = now.tv_sec + tomono.tv_sec;
+	nsecs += now.tv_nsec + tomono.tv_nsec;
 	/*
 	 * Use ktime_set/ktime_add_ns to create a proper ktime on
 	 * 32-bit architectures without CONFIG_KTIME_SCALAR.
@@ -270,18 +378,11 @@ EXPORT_SYMBOL_GPL(ktime_get);
 void ktime_get_ts(struct timespec *ts)
 {
 	struct timespec tomono;
-	unsigned int seq;
 	s64 nsecs;
 
 	WARN_ON(timekeeping_suspended);
 
-	do {
-		seq = read_seqbegin(&xtime_lock);
-		*ts = xtime;
-		tomono = wall_to_monotonic;
-		nsecs = timekeeping_get_ns();
-
-	} while (read_seqretry(&xtime_lock, seq));
+	tk_fast_read(ts, &tomono, &nsecs);
 
 	set_normalized_timespec(ts, ts->tv_sec + tomono.tv_sec,
 				ts->tv_nsec + tomono.tv_nsec + nsecs);
@@ -374,6 +475,7 @@ int do_settimeofday(const struct timespec *tv)
 	timekeeper.ntp_error = 0;
 	ntp_clear();
 
+	tk_fast_update();
 	update_vsyscall(&xtime, &wall_to_monotonic, timekeeper.clock,
 				timekeeper.mult);
 
@@ -411,6 +513,7 @@ int timekeeping_inject_offset(struct timespec *ts)
 	timekeeper.ntp_error = 0;
 	ntp_clear();
 
+	tk_fast_update();
 	update_vsyscall(&xtime, &wall_to_monotonic, timekeeper.clock,
 				timekeeper.mult);
 
@@ -438,6 +541,7 @@ static int change_clocksource(void *data)
 	if (!new->enable || new->enable(new) == 0) {
 		old = timekeeper.clock;
 		timekeeper_setup_internals(new);
+		tk_fast_update();
 		if (old->disable)
 			old->disable(old);
 	}
@@ -589,6 +693,7 @@ void __init timekeeping_init(void)
 				-boot.tv_sec, -boot.tv_nsec);
 	total_sleep_time.tv_sec = 0;
 	total_sleep_time.tv_nsec = 0;
+	tk_fast_update();
 	write_sequnlock_irqrestore(&xtime_lock, flags);
 }
 
@@ -643,6 +748,7 @@ void timekeeping_inject_sleeptime(struct timespec *delta)
 
 	timekeeper.ntp_error = 0;
 	ntp_clear();
+	tk_fast_update();
 	update_vsyscall(&xtime, &wall_to_monotonic, timekeeper.clock,
 				timekeeper.mult);
 
@@ -679,6 +785,7 @@ static void timekeeping_resume(void)
 	timekeeper.clock->cycle_last = timekeeper.clock->read(timekeeper.clock);
 	timekeeper.ntp_error = 0;
 	timekeeping_suspended = 0;
+	tk_fast_update();
 	write_sequnlock_irqrestore(&xtime_lock, flags);
 
 	touch_softlockup_watchdog();
@@ -699,6 +806,7 @@ static int timekeeping_suspend(void)
 
 	write_seqlock_irqsave(&xtime_lock, flags);
 	timekeeping_forward_now();
+	tk_fast_update();
 	timekeeping_suspended = 1;
 
 	/*
@@ -966,6 +1074,7 @@ static void update_wall_time(void)
 	}
 
 	/* check to see if there is a new clocksource to use */
+	tk_fast_update();
 	update_vsyscall(&xtime, &wall_to_monotonic, timekeeper.clock,
 				timekeeper.mult);
 }
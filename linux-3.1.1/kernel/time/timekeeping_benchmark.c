@@ -0,0 +1,104 @@
+/*
+ * Timekeeping reader benchmark
+ *
+ * Runs a thread per online CPU reading the monotonic clock in a tight
+ * loop, then reports how many reads were done, what they cost and how
+ * many of them had to be retried against a concurrent timekeeping update.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/completion.h>
+#include <linux/kthread.h>
+#include <linux/module.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/time.h>
+
+/* run time in seconds */
+static unsigned int run_time = 5;
+module_param(run_time, uint, 0444);
+MODULE_PARM_DESC(run_time, "seconds each reader runs for");
+
+static atomic_t readers_running;
+static DECLARE_COMPLETION(readers_done);
+static unsigned long *reads;
+
+static int tk_bench_reader(void *data)
+{
+	unsigned long *count = data;
+	unsigned long end = jiffies + run_time * HZ;
+	unsigned long n = 0;
+
+	while (time_before(jiffies, end)) {
+		int i;
+
+		for (i = 0; i < 1000; i++)
+			ktime_get();
+		n += 1000;
+		cond_resched();
+	}
+	*count = n;
+
+	if (atomic_dec_and_test(&readers_running))
+		complete(&readers_done);
+	return 0;
+}
+
+static int __init tk_bench_init(void)
+{
+	unsigned long retries, total = 0;
+	struct task_struct *t;
+	ktime_t start, delta;
+	int cpu;
+
+	reads = kcalloc(nr_cpu_ids, sizeof(*reads), GFP_KERNEL);
+	if (!reads)
+		return -ENOMEM;
+
+	get_online_cpus();
+	atomic_set(&readers_running, 1);
+	retries = timekeeping_read_retries();
+	start = ktime_get();
+
+	for_each_online_cpu(cpu) {
+		t = kthread_create(tk_bench_reader, &reads[cpu],
+				   "tk_bench/%d", cpu);
+		if (IS_ERR(t))
+			continue;
+		kthread_bind(t, cpu);
+		atomic_inc(&readers_running);
+		wake_up_process(t);
+	}
+	put_online_cpus();
+
+	if (!atomic_dec_and_test(&readers_running))
+		wait_for_completion(&readers_done);
+
+	delta = ktime_sub(ktime_get(), start);
+	retries = timekeeping_read_retries() - retries;
+
+	for_each_possible_cpu(cpu) {
+		if (!reads[cpu])
+			continue;
+		pr_info("tk_bench: cpu %d: %lu reads, %llu ns/read\n",
+			cpu, reads[cpu],
+			div64_u64(ktime_to_ns(delta), reads[cpu]));
+		total += reads[cpu];
+	}
+	pr_info("tk_bench: %lu reads, %lu retried\n", total, retries);
+
+	kfree(reads);
+	return 0;
+}
+
+static void __exit tk_bench_exit(void)
+{
+}
+
+module_init(tk_bench_init);
+module_exit(tk_bench_exit);
+
+MODULE_DESCRIPTION("timekeeping reader benchmark");
+MODULE_LICENSE("GPL");
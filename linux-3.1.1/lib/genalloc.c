@@ -22,6 +22,12 @@
  * allocator in NMI handler should depend on
  * CONFIG_ARCH_HAVE_NMI_SAFE_CMPXCHG.
  *
+ * The search for free space is pluggable (first-fit by default, see
+ * gen_pool_set_algo()).  First-fit searches use a per-chunk summary
+ * bitmap of completely allocated bitmap words to step over them.
+ * Frequently used allocation sizes can additionally be served from
+ * per-CPU magazines, see gen_pool_add_cache().
+ *
  * Copyright 2005 (C) Jes Sorensen <jes@trained-monkey.org>
  *
  * This source code is licensed under the GNU General Public License,
@@ -65,9 +71,44 @@ static int clear_bits_ll(unsigned long *addr, unsigned long mask_to_clear)
 	return 0;
 }
 
+/*
+ * mark_word_full - record in the summary bitmap that a bitmap word is full
+ * @map: pointer to a bitmap
+ * @full: summary bitmap of @map
+ * @p: word of @map that has just had bits set
+ *
+ * The summary bit is only a hint.  Whoever sets it re-reads the word
+ * afterwards and backs out if a concurrent clear_bits_ll() freed bits
+ * in the meantime; the clearing side always drops the summary bit after
+ * its cmpxchg, so between the two sides a stale "full" mark can not
+ * survive.
+ */
+static void mark_word_full(unsigned long *map, unsigned long *full,
+			   unsigned long *p)
+{
+	unsigned long idx = p - map;
+
+	if (ACCESS_ONCE(*p) != ~0UL)
+		return;
+	set_bit(idx, full);
+	smp_mb();
+	if (ACCESS_ONCE(*p) != ~0UL)
+		clear_bit(idx, full);
+}
+
+static void mark_word_free(unsigned long *map, unsigned long *full,
+			   unsigned long *p)
+{
+	unsigned long idx = p - map;
+
+	if (test_bit(idx, full))
+		clear_bit(idx, full);
+}
+
 /*
  * bitmap_set_ll - set the specified number of bits at the specified position
  * @map: pointer to a bitmap
+ * @full: summary bitmap of full words in @map
  * @start: a bit position in @map
  * @nr: number of bits to set
  *
@@ -76,7 +117,8 @@ static int clear_bits_ll(unsigned long *addr, unsigned long mask_to_clear)
  * users set the same bit, one user will return remain bits, otherwise
  * return 0.
  */
-static int bitmap_set_ll(unsigned long *map, int start, int nr)
+static int bitmap_set_ll(unsigned long *map, unsigned long *full,
+			 int start, int nr)
 {
 	unsigned long *p = map + BIT_WORD(start);
 	const int size = start + nr;
@@ -86,6 +128,7 @@ static int bitmap_set_ll(unsigned long *map, int start, int nr)
 	while (nr - bits_to_set >= 0) {
 		if (set_bits_ll(p, mask_to_set))
 			return nr;
+		mark_word_full(map, full, p);
 		nr -= bits_to_set;
 		bits_to_set = BITS_PER_LONG;
 		mask_to_set = ~0UL;
@@ -95,6 +138,7 @@ static int bitmap_set_ll(unsigned long *map, int start, int nr)
 		mask_to_set &= BITMAP_LAST_WORD_MASK(size);
 		if (set_bits_ll(p, mask_to_set))
 			return nr;
+		mark_word_full(map, full, p);
 	}
 
 	return 0;
@@ -103,6 +147,7 @@ static int bitmap_set_ll(unsigned long *map, int start, int nr)
 /*
  * bitmap_clear_ll - clear the specified number of bits at the specified position
  * @map: pointer to a bitmap
+ * @full: summary bitmap of full words in @map
  * @start: a bit position in @map
  * @nr: number of bits to set
  *
@@ -111,7 +156,8 @@ static int bitmap_set_ll(unsigned long *map, int start, int nr)
  * users clear the same bit, one user will return remain bits,
  * otherwise return 0.
  */
-static int bitmap_clear_ll(unsigned long *map, int start, int nr)
+static int bitmap_clear_ll(unsigned long *map, unsigned long *full,
+			   int start, int nr)
 {
 	unsigned long *p = map + BIT_WORD(start);
 	const int size = start + nr;
@@ -121,6 +167,7 @@ static int bitmap_clear_ll(unsigned long *map, int start, int nr)
 	while (nr - bits_to_clear >= 0) {
 		if (clear_bits_ll(p, mask_to_clear))
 			return nr;
+		mark_word_free(map, full, p);
 		nr -= bits_to_clear;
 		bits_to_clear = BITS_PER_LONG;
 		mask_to_clear = ~0UL;
@@ -130,11 +177,75 @@ static int bitmap_clear_ll(unsigned long *map, int start, int nr)
 		mask_to_clear &= BITMAP_LAST_WORD_MASK(size);
 		if (clear_bits_ll(p, mask_to_clear))
 			return nr;
+		mark_word_free(map, full, p);
 	}
 
 	return 0;
 }
 
+/*
+ * chunk_next_run - find the next run of bitmap words that are not full
+ * @chunk: chunk whose bitmap is about to be searched
+ * @end_bit: size of the chunk bitmap in bits
+ * @start_bit: bit the caller wants to start searching at
+ * @run_end: returns the bit just past the end of the run
+ *
+ * Returns the first bit at or after @start_bit that lies in a word not
+ * marked full in the summary bitmap, or @end_bit if there is none.
+ */
+static unsigned long chunk_next_run(struct gen_pool_chunk *chunk,
+				    unsigned long end_bit,
+				    unsigned long start_bit,
+				    unsigned long *run_end)
+{
+	unsigned long nwords = BITS_TO_LONGS(end_bit);
+	unsigned long word, next_full;
+
+	word = find_next_zero_bit(chunk->full, nwords, BIT_WORD(start_bit));
+	if (word >= nwords)
+		return end_bit;
+
+	next_full = find_next_bit(chunk->full, nwords, word);
+	*run_end = min(end_bit, next_full * BITS_PER_LONG);
+
+	return max(start_bit, word * BITS_PER_LONG);
+}
+
+/*
+ * chunk_find_area - search a chunk for @nbits free bits
+ *
+ * A free area can not contain a full word, so for first-fit the search
+ * goes run by run, skipping full words a summary word (BITS_PER_LONG
+ * bitmap words) at a time.  Other algorithms may need to compare areas
+ * across the whole bitmap and are given all of it.
+ *
+ * Returns the first bit of the area, or a value >= @end_bit.
+ */
+static unsigned long chunk_find_area(struct gen_pool *pool,
+				     struct gen_pool_chunk *chunk,
+				     unsigned long end_bit,
+				     unsigned long start_bit, int nbits)
+{
+	unsigned long run_end, bit;
+
+	if (pool->algo != gen_pool_first_fit)
+		return pool->algo(chunk->bits, end_bit, start_bit, nbits,
+				  pool->data);
+
+	while (start_bit < end_bit) {
+		start_bit = chunk_next_run(chunk, end_bit, start_bit, &run_end);
+		if (start_bit >= end_bit)
+			break;
+		bit = gen_pool_first_fit(chunk->bits, run_end, start_bit,
+					 nbits, NULL);
+		if (bit < run_end)
+			return bit;
+		start_bit = run_end;
+	}
+
+	return end_bit;
+}
+
 /**
  * gen_pool_create - create a new special memory pool
  * @min_alloc_order: log base 2 of number of bytes each bitmap bit represents
@@ -152,6 +263,9 @@ struct gen_pool *gen_pool_create(int min_alloc_order, int nid)
 		spin_lock_init(&pool->lock);
 		INIT_LIST_HEAD(&pool->chunks);
 		pool->min_alloc_order = min_alloc_order;
+		pool->algo = gen_pool_first_fit;
+		pool->data = NULL;
+		pool->nr_caches = 0;
 	}
 	return pool;
 }
@@ -175,13 +289,15 @@ int gen_pool_add_virt(struct gen_pool *pool, unsigned long virt, phys_addr_t phy
 {
 	struct gen_pool_chunk *chunk;
 	int nbits = size >> pool->min_alloc_order;
+	int nwords = BITS_TO_LONGS(nbits);
 	int nbytes = sizeof(struct gen_pool_chunk) +
-				(nbits + BITS_PER_BYTE - 1) / BITS_PER_BYTE;
+			(nwords + BITS_TO_LONGS(nwords)) * sizeof(long);
 
 	chunk = kmalloc_node(nbytes, GFP_KERNEL | __GFP_ZERO, nid);
 	if (unlikely(chunk == NULL))
 		return -ENOMEM;
 
+	chunk->full = &chunk->bits[nwords];
 	chunk->phys_addr = phys;
 	chunk->start_addr = virt;
 	chunk->end_addr = virt + size;
@@ -232,7 +348,11 @@ void gen_pool_destroy(struct gen_pool *pool)
 	struct list_head *_chunk, *_next_chunk;
 	struct gen_pool_chunk *chunk;
 	int order = pool->min_alloc_order;
-	int bit, end_bit;
+	int bit, end_bit, i;
+
+	gen_pool_drain_caches(pool);
+	for (i = 0; i < pool->nr_caches; i++)
+		free_percpu(pool->caches[i].mag);
 
 	list_for_each_safe(_chunk, _next_chunk, &pool->chunks) {
 		chunk = list_entry(_chunk, struct gen_pool_chunk, next_chunk);
@@ -249,29 +369,134 @@ void gen_pool_destroy(struct gen_pool *pool)
 }
 EXPORT_SYMBOL(gen_pool_destroy);
 
-/**
- * gen_pool_alloc - allocate special memory from the pool
- * @pool: pool to allocate from
- * @size: number of bytes to allocate from the pool
- *
- * Allocate the requested number of bytes from the specified pool.
- * Uses a first-fit algorithm. Can not be used in NMI handler on
- * architectures without NMI-safe cmpxchg implementation.
+/*
+ * Return the per-CPU cache serving allocations of @size bytes, if any.
  */
-unsigned long gen_pool_alloc(struct gen_pool *pool, size_t size)
+static struct gen_pool_cache *gen_pool_find_cache(struct gen_pool *pool,
+						  size_t size)
 {
-	struct gen_pool_chunk *chunk;
-	unsigned long addr = 0;
 	int order = pool->min_alloc_order;
-	int nbits, start_bit = 0, end_bit, remain;
+	size_t rounded = ALIGN(size, 1UL << order);
+	int i;
 
-#ifndef CONFIG_ARCH_HAVE_NMI_SAFE_CMPXCHG
-	BUG_ON(in_nmi());
-#endif
+	for (i = 0; i < pool->nr_caches; i++)
+		if (pool->caches[i].size == rounded)
+			return &pool->caches[i];
+	return NULL;
+}
 
-	if (size == 0)
+/*
+ * The magazines are only protected by disabling interrupts, which does
+ * not keep NMIs out, so NMI context always goes to the bitmap.
+ */
+static unsigned long gen_pool_cache_get(struct gen_pool_cache *cache)
+{
+	struct gen_pool_magazine *mag;
+	unsigned long flags, addr = 0;
+
+	if (in_nmi())
+		return 0;
+
+	local_irq_save(flags);
+	mag = this_cpu_ptr(cache->mag);
+	spin_lock(&mag->lock);
+	if (mag->count)
+		addr = mag->objs[--mag->count];
+	spin_unlock(&mag->lock);
+	local_irq_restore(flags);
+
+	return addr;
+}
+
+static int gen_pool_cache_put(struct gen_pool_cache *cache, unsigned long addr)
+{
+	struct gen_pool_magazine *mag;
+	unsigned long flags;
+	int ret = 0;
+
+	if (in_nmi())
 		return 0;
 
+	local_irq_save(flags);
+	mag = this_cpu_ptr(cache->mag);
+	spin_lock(&mag->lock);
+	if (mag->count < GEN_POOL_MAGAZINE_SIZE) {
+		mag->objs[mag->count++] = addr;
+		ret = 1;
+	}
+	spin_unlock(&mag->lock);
+	local_irq_restore(flags);
+
+	return ret;
+}
+
+/*
+ * Return memory to the chunk bitmaps, bypassing the per-CPU caches.
+ */
+static void __gen_pool_free(struct gen_pool *pool, unsigned long addr,
+			    size_t size)
+{
+	struct gen_pool_chunk *chunk;
+	int order = pool->min_alloc_order;
+	int start_bit, nbits, remain;
+
+	nbits = (size + (1UL << order) - 1) >> order;
+	rcu_read_lock();
+	list_for_each_entry_rcu(chunk, &pool->chunks, next_chunk) {
+		if (addr >= chunk->start_addr && addr < chunk->end_addr) {
+			BUG_ON(addr + size > chunk->end_addr);
+			start_bit = (addr - chunk->start_addr) >> order;
+			remain = bitmap_clear_ll(chunk->bits, chunk->full,
+						 start_bit, nbits);
+			BUG_ON(remain);
+			size = nbits << order;
+			atomic_add(size, &chunk->avail);
+			rcu_read_unlock();
+			return;
+		}
+	}
+	rcu_read_unlock();
+	BUG();
+}
+
+/*
+ * Move every object held in the per-CPU magazines, of all CPUs, back
+ * into the chunk bitmaps.  Returns the number of objects moved.
+ */
+static int gen_pool_flush_caches(struct gen_pool *pool)
+{
+	struct gen_pool_magazine *mag;
+	unsigned long flags;
+	int i, cpu, flushed = 0;
+
+	for (i = 0; i < pool->nr_caches; i++) {
+		struct gen_pool_cache *cache = &pool->caches[i];
+
+		for_each_possible_cpu(cpu) {
+			mag = per_cpu_ptr(cache->mag, cpu);
+			spin_lock_irqsave(&mag->lock, flags);
+			while (mag->count) {
+				__gen_pool_free(pool, mag->objs[--mag->count],
+						cache->size);
+				flushed++;
+			}
+			spin_unlock_irqrestore(&mag->lock, flags);
+		}
+	}
+
+	return flushed;
+}
+
+/*
+ * Allocate from the chunk bitmaps, bypassing the per-CPU caches.
+ */
+static unsigned long __gen_pool_alloc(struct gen_pool *pool, size_t size)
+{
+	struct gen_pool_chunk *chunk;
+	unsigned long addr = 0;
+	int order = pool->min_alloc_order;
+	int nbits, start_bit, end_bit, remain;
+
 	nbits = (size + (1UL << order) - 1) >> order;
 	rcu_read_lock();
 	list_for_each_entry_rcu(chunk, &pool->chunks, next_chunk) {
@@ -279,15 +504,17 @@ unsigned long gen_pool_alloc(struct gen_pool *pool, size_t size)
 			continue;
 
 		end_bit = (chunk->end_addr - chunk->start_addr) >> order;
+		start_bit = 0;
 retry:
-		start_bit = bitmap_find_next_zero_area(chunk->bits, end_bit,
-						       start_bit, nbits, 0);
+		start_bit = chunk_find_area(pool, chunk, end_bit, start_bit,
+					    nbits);
 		if (start_bit >= end_bit)
 			continue;
-		remain = bitmap_set_ll(chunk->bits, start_bit, nbits);
+		remain = bitmap_set_ll(chunk->bits, chunk->full, start_bit,
+				       nbits);
 		if (remain) {
-			remain = bitmap_clear_ll(chunk->bits, start_bit,
-						 nbits - remain);
+			remain = bitmap_clear_ll(chunk->bits, chunk->full,
+						 start_bit, nbits - remain);
 			BUG_ON(remain);
 			goto retry;
 		}
@@ -300,6 +527,46 @@ retry:
 	rcu_read_unlock();
 	return addr;
 }
+
+/**
+ * gen_pool_alloc - allocate special memory from the pool
+ * @pool: pool to allocate from
+ * @size: number of bytes to allocate from the pool
+ *
+ * Allocate the requested number of bytes from the specified pool.
+ * Uses the pool allocation function (first-fit by default).  Sizes
+ * registered with gen_pool_add_cache() are served from the per-CPU
+ * magazine first.  If the bitmaps have no room, objects cached on
+ * other CPUs are given back to them and the search is retried.  Can
+ * not be used in NMI handler on architectures without NMI-safe
+ * cmpxchg implementation.
+ */
+unsigned long gen_pool_alloc(struct gen_pool *pool, size_t size)
+{
+	struct gen_pool_cache *cache;
+	unsigned long addr;
+
+#ifndef CONFIG_ARCH_HAVE_NMI_SAFE_CMPXCHG
+	BUG_ON(in_nmi());
+#endif
+
+	if (size == 0)
+		return 0;
+
+	cache = gen_pool_find_cache(pool, size);
+	if (cache) {
+		addr = gen_pool_cache_get(cache);
+		if (addr)
+			return addr;
+	}
+
+	addr = __gen_pool_alloc(pool, size);
+	if (!addr && pool->nr_caches && !in_nmi() &&
+	    gen_pool_flush_caches(pool))
+		addr = __gen_pool_alloc(pool, size);
+
+	return addr;
+}
 EXPORT_SYMBOL(gen_pool_alloc);
 
 /**
@@ -314,30 +581,17 @@ EXPORT_SYMBOL(gen_pool_alloc);
  */
 void gen_pool_free(struct gen_pool *pool, unsigned long addr, size_t size)
 {
-	struct gen_pool_chunk *chunk;
-	int order = pool->min_alloc_order;
-	int start_bit, nbits, remain;
+	struct gen_pool_cache *cache;
 
 #ifndef CONFIG_ARCH_HAVE_NMI_SAFE_CMPXCHG
 	BUG_ON(in_nmi());
 #endif
 
-	nbits = (size + (1UL << order) - 1) >> order;
-	rcu_read_lock();
-	list_for_each_entry_rcu(chunk, &pool->chunks, next_chunk) {
-		if (addr >= chunk->start_addr && addr < chunk->end_addr) {
-			BUG_ON(addr + size > chunk->end_addr);
-			start_bit = (addr - chunk->start_addr) >> order;
-			remain = bitmap_clear_ll(chunk->bits, start_bit, nbits);
-			BUG_ON(remain);
-			size = nbits << order;
-			atomic_add(size, &chunk->avail);
-			rcu_read_unlock();
-			return;
-		}
-	}
-	rcu_read_unlock();
-	BUG();
+	cache = gen_pool_find_cache(pool, size);
+	if (cache && gen_pool_cache_put(cache, addr))
+		return;
+
+	__gen_pool_free(pool, addr, size);
 }
 EXPORT_SYMBOL(gen_pool_free);
 
@@ -400,3 +654,131 @@ size_t gen_pool_size(struct gen_pool *pool)
 	return size;
 }
 EXPORT_SYMBOL_GPL(gen_pool_size);
+
+/**
+ * gen_pool_set_algo - set the allocation algorithm
+ * @pool: pool to change allocation algorithm
+ * @algo: custom algorithm function
+ * @data: additional data used by @algo
+ *
+ * Call @algo for each memory allocation in the pool.
+ * If @algo is NULL use gen_pool_first_fit as default
+ * memory allocation function.  Must not be called while
+ * allocations from @pool may be in progress.
+ */
+void gen_pool_set_algo(struct gen_pool *pool, genpool_algo_t algo, void *data)
+{
+	rcu_read_lock();
+
+	pool->algo = algo;
+	if (!pool->algo)
+		pool->algo = gen_pool_first_fit;
+
+	pool->data = data;
+
+	rcu_read_unlock();
+}
+EXPORT_SYMBOL(gen_pool_set_algo);
+
+/**
+ * gen_pool_first_fit - find the first available region
+ * of memory matching the size requirement (no alignment constraint)
+ * @map: The address to base the search on
+ * @size: The bitmap size in bits
+ * @start: The bitnumber to start searching at
+ * @nr: The number of zeroed bits we're looking for
+ * @data: additional data - unused
+ */
+unsigned long gen_pool_first_fit(unsigned long *map, unsigned long size,
+		unsigned long start, unsigned int nr, void *data)
+{
+	return bitmap_find_next_zero_area(map, size, start, nr, 0);
+}
+EXPORT_SYMBOL(gen_pool_first_fit);
+
+/**
+ * gen_pool_best_fit - find the best fitting region of memory
+ * matching the size requirement (no alignment constraint)
+ * @map: The address to base the search on
+ * @size: The bitmap size in bits
+ * @start: The bitnumber to start searching at
+ * @nr: The number of zeroed bits we're looking for
+ * @data: additional data - unused
+ *
+ * Iterate over the bitmap to find the smallest free region
+ * which we can allocate the memory.
+ */
+unsigned long gen_pool_best_fit(unsigned long *map, unsigned long size,
+		unsigned long start, unsigned int nr, void *data)
+{
+	unsigned long start_bit = size;
+	unsigned long len = size + 1;
+	unsigned long index;
+
+	index = bitmap_find_next_zero_area(map, size, start, nr, 0);
+
+	while (index < size) {
+		unsigned long next_bit = find_next_bit(map, size, index + nr);
+		if ((next_bit - index) < len) {
+			len = next_bit - index;
+			start_bit = index;
+			if (len == nr)
+				return start_bit;
+		}
+		index = bitmap_find_next_zero_area(map, size,
+						   next_bit + 1, nr, 0);
+	}
+
+	return start_bit;
+}
+EXPORT_SYMBOL(gen_pool_best_fit);
+
+/**
+ * gen_pool_add_cache - serve a common allocation size from per-CPU caches
+ * @pool: pool to add the cache to
+ * @size: allocation size in bytes to cache
+ *
+ * Frees of @size bytes are kept in a small per-CPU magazine and handed
+ * back out by later allocations of the same size on that CPU without
+ * touching the chunk bitmaps.  Memory sitting in a magazine is still
+ * accounted as allocated by gen_pool_avail(); gen_pool_drain_caches()
+ * returns it to the pool.  Must be called before the pool is in use.
+ *
+ * Returns 0 on success or a -ve errno on failure.
+ */
+int gen_pool_add_cache(struct gen_pool *pool, size_t size)
+{
+	struct gen_pool_cache *cache;
+	int cpu;
+
+	if (size == 0)
+		return -EINVAL;
+	if (gen_pool_find_cache(pool, size))
+		return 0;
+	if (pool->nr_caches >= GEN_POOL_MAX_CACHES)
+		return -ENOSPC;
+
+	cache = &pool->caches[pool->nr_caches];
+	cache->mag = alloc_percpu(struct gen_pool_magazine);
+	if (!cache->mag)
+		return -ENOMEM;
+	for_each_possible_cpu(cpu)
+		spin_lock_init(&per_cpu_ptr(cache->mag, cpu)->lock);
+	cache->size = ALIGN(size, 1UL << pool->min_alloc_order);
+	pool->nr_caches++;
+
+	return 0;
+}
+EXPORT_SYMBOL(gen_pool_add_cache);
+
+/**
+ * gen_pool_drain_caches - return all per-CPU cached memory to the pool
+ * @pool: pool whose caches to drain
+ *
+ * Must not be called from NMI context.
+ */
+void gen_pool_drain_caches(struct gen_pool *pool)
+{
+	gen_pool_flush_caches(pool);
+}
+EXPORT_SYMBOL(gen_pool_drain_caches);
@@ -28,6 +28,7 @@
 #include <linux/slab.h>
 #include <linux/string.h> /* for memset */
 #include <linux/seq_file.h> /* for seq_printf */
+#include <linux/rcupdate.h>
 #include <linux/lru_cache.h>
 
 MODULE_AUTHOR("Philipp Reisner <phil@linbit.com>, "
@@ -211,6 +212,7 @@ size_t lc_seq_printf_stats(struct seq_file *seq, struct lru_cache *lc)
 	 * misses include "dirty" count (update from an other thread in
 	 * progress) and "changed", when this in fact lead to an successful
 	 * update of the cache.
+	 * References taken locklessly by lc_try_get_active() are not counted.
 	 */
 	return seq_printf(seq, "\t%s: used:%u/%u "
 		"hits:%lu misses:%lu starving:%lu dirty:%lu changed:%lu\n",
@@ -262,7 +264,7 @@ static struct lc_element *lc_evict(struct lru_cache *lc)
 	PARANOIA_LC_ELEMENT(lc, e);
 
 	list_del(&e->list);
-	hlist_del(&e->colision);
+	hlist_del_init_rcu(&e->colision);
 	return e;
 }
 
@@ -278,10 +280,11 @@ void lc_del(struct lru_cache *lc, struct lc_element *e)
 {
 	PARANOIA_ENTRY();
 	PARANOIA_LC_ELEMENT(lc, e);
-	BUG_ON(e->refcnt);
+	BUG_ON(lc_refcnt(e));
 
 	e->lc_number = LC_FREE;
-	hlist_del_init(&e->colision);
+	atomic_add(LC_GEN_ONE, &e->refcnt);
+	hlist_del_init_rcu(&e->colision);
 	list_move(&e->list, &lc->free);
 	RETURN();
 }
@@ -308,6 +311,11 @@ static int lc_unused_element_available(struct lru_cache *lc)
 	return 0;
 }
 
+/* take a reference, return the new reference count */
+static unsigned lc_get_ref(struct lc_element *e)
+{
+	return (unsigned)atomic_inc_return(&e->refcnt) & LC_REFCNT_MASK;
+}
 
 /**
  * lc_get - get element by label, maybe change the active set
@@ -359,7 +367,7 @@ struct lc_element *lc_get(struct lru_cache *lc, unsigned int enr)
 	e = lc_find(lc, enr);
 	if (e) {
 		++lc->hits;
-		if (e->refcnt++ == 0)
+		if (lc_get_ref(e) == 1)
 			lc->used++;
 		list_move(&e->list, &lc->in_use); /* Not evictable... */
 		RETURN(e);
@@ -388,7 +396,11 @@ struct lc_element *lc_get(struct lru_cache *lc, unsigned int enr)
 	BUG_ON(!e);
 
 	clear_bit(__LC_STARVING, &lc->flags);
-	BUG_ON(++e->refcnt != 1);
+	/* take the first reference, and mark the label as changing,
+	 * so lockless readers that still see this element in its old
+	 * hash chain won't take a reference on it */
+	BUG_ON((atomic_add_return(1 + LC_CHANGING + LC_GEN_ONE, &e->refcnt)
+		& (LC_REFCNT_MASK | LC_CHANGING)) != (1 | LC_CHANGING));
 	lc->used++;
 
 	lc->changing_element = e;
@@ -415,7 +427,7 @@ struct lc_element *lc_try_get(struct lru_cache *lc, unsigned int enr)
 	e = lc_find(lc, enr);
 	if (e) {
 		++lc->hits;
-		if (e->refcnt++ == 0)
+		if (lc_get_ref(e) == 1)
 			lc->used++;
 		list_move(&e->list, &lc->in_use); /* Not evictable... */
 	}
@@ -434,8 +446,10 @@ void lc_changed(struct lru_cache *lc, struct lc_element *e)
 	PARANOIA_LC_ELEMENT(lc, e);
 	++lc->changed;
 	e->lc_number = lc->new_number;
+	/* implies a full barrier: new label visible before the flag clears */
+	atomic_sub_return(LC_CHANGING, &e->refcnt);
 	list_add(&e->list, &lc->in_use);
-	hlist_add_head(&e->colision, lc_hash_slot(lc, lc->new_number));
+	hlist_add_head_rcu(&e->colision, lc_hash_slot(lc, lc->new_number));
 	lc->changing_element = NULL;
 	lc->new_number = LC_FREE;
 	clear_bit(__LC_DIRTY, &lc->flags);
@@ -455,18 +469,127 @@ void lc_changed(struct lru_cache *lc, struct lc_element *e)
  */
 unsigned int lc_put(struct lru_cache *lc, struct lc_element *e)
 {
+	unsigned int refcnt;
+
 	PARANOIA_ENTRY();
 	PARANOIA_LC_ELEMENT(lc, e);
-	BUG_ON(e->refcnt == 0);
+	BUG_ON(lc_refcnt(e) == 0);
 	BUG_ON(e == lc->changing_element);
-	if (--e->refcnt == 0) {
+	refcnt = (unsigned)atomic_dec_return(&e->refcnt) & LC_REFCNT_MASK;
+	if (refcnt == 0) {
 		/* move it to the front of LRU. */
 		list_move(&e->list, &lc->lru);
 		lc->used--;
 		clear_bit(__LC_STARVING, &lc->flags);
 		smp_mb__after_clear_bit();
 	}
-	RETURN(e->refcnt);
+	RETURN(refcnt);
+}
+
+/* lockless lookup; may miss an element that is moved between hash chains
+ * concurrently, callers must treat a miss as "ask again under the lock" */
+static struct lc_element *lc_find_rcu(struct lru_cache *lc, unsigned int enr)
+{
+	struct hlist_node *n;
+	struct lc_element *e;
+
+	hlist_for_each_entry_rcu(e, n, lc_hash_slot(lc, enr), colision) {
+		if (ACCESS_ONCE(e->lc_number) == enr)
+			return e;
+	}
+	return NULL;
+}
+
+/**
+ * lc_try_get_active - get a reference on an active element without locking
+ * @lc: the lru cache to operate on
+ * @enr: the label to look up
+ *
+ * Only succeeds if the element labelled @enr is in the active set and
+ * already has a non-zero reference count, i.e. when lc_get() would neither
+ * change the set nor move the element between lists.  Does not need the
+ * lock the user otherwise serializes lc_get()/lc_put()/lc_changed() with,
+ * but must not run concurrently with lc_reset(), lc_set() or lc_destroy().
+ *
+ * Returns the element with an additional reference, or NULL; in the latter
+ * case the caller should fall back to lc_get() under its lock.
+ *
+ * The generation in .refcnt only has a few bits, so an element that was
+ * relabelled often enough while we looked may still pass the cmpxchg.  The
+ * caller must therefore check that ->lc_number is @enr.  If it is not, the
+ * reference is on some other element in use, and the caller has to give it
+ * back with lc_put() under its lock: dropping it here could drop the last
+ * one, which has to move the element to the lru list.
+ */
+struct lc_element *lc_try_get_active(struct lru_cache *lc, unsigned int enr)
+{
+	struct lc_element *e;
+	int ref, old;
+
+	if (lc->flags & LC_STARVING)
+		return NULL;
+
+	rcu_read_lock();
+	e = lc_find_rcu(lc, enr);
+	if (!e)
+		goto out;
+
+	ref = atomic_read(&e->refcnt);
+	for (;;) {
+		if ((ref & LC_CHANGING) ||
+		    (ref & LC_REFCNT_MASK) == 0 ||
+		    (ref & LC_REFCNT_MASK) == LC_REFCNT_MASK) {
+			e = NULL;
+			break;
+		}
+		/* the label we matched must belong to this generation */
+		smp_rmb();
+		if (ACCESS_ONCE(e->lc_number) != enr) {
+			e = NULL;
+			break;
+		}
+		old = atomic_cmpxchg(&e->refcnt, ref, ref + 1);
+		if (likely(old == ref))
+			break;
+		ref = old;
+	}
+out:
+	rcu_read_unlock();
+	return e;
+}
+
+/**
+ * lc_try_put_active - drop a reference without locking, unless it is the last
+ * @lc: the lru cache to operate on
+ * @enr: the label of an element the caller holds a reference on
+ *
+ * Counterpart of lc_try_get_active().  Returns 1 if a reference was dropped
+ * and the element is still in use.  Returns 0 if nothing was done, because
+ * dropping it would move the element to the lru list; the caller must then
+ * use lc_put() under its lock.
+ */
+int lc_try_put_active(struct lru_cache *lc, unsigned int enr)
+{
+	struct lc_element *e;
+	int ref, old, ret = 0;
+
+	rcu_read_lock();
+	e = lc_find_rcu(lc, enr);
+	if (!e)
+		goto out;
+
+	ref = atomic_read(&e->refcnt);
+	while ((ref & LC_REFCNT_MASK) > 1) {
+		old = atomic_cmpxchg(&e->refcnt, ref, ref - 1);
+		if (likely(old == ref)) {
+			ret = 1;
+			break;
+		}
+		ref = old;
+	}
+out:
+	rcu_read_unlock();
+	return ret;
 }
 
 /**
@@ -510,10 +633,11 @@ void lc_set(struct lru_cache *lc, unsigned int enr, int index)
 
 	e = lc_element_by_index(lc, index);
 	e->lc_number = enr;
+	atomic_add(LC_GEN_ONE, &e->refcnt);
 
-	hlist_del_init(&e->colision);
-	hlist_add_head(&e->colision, lc_hash_slot(lc, enr));
-	list_move(&e->list, e->refcnt ? &lc->in_use : &lc->lru);
+	hlist_del_init_rcu(&e->colision);
+	hlist_add_head_rcu(&e->colision, lc_hash_slot(lc, enr));
+	list_move(&e->list, lc_refcnt(e) ? &lc->in_use : &lc->lru);
 }
 
 /**
@@ -538,7 +662,7 @@ void lc_seq_dump_details(struct seq_file *seq, struct lru_cache *lc, char *utext
 			seq_printf(seq, "\t%2d: FREE\n", i);
 		} else {
 			seq_printf(seq, "\t%2d: %4u %4u    ", i,
-				   e->lc_number, e->refcnt);
+				   e->lc_number, lc_refcnt(e));
 			detail(seq, e);
 		}
 	}
@@ -554,6 +678,8 @@ EXPORT_SYMBOL(lc_find);
 EXPORT_SYMBOL(lc_get);
 EXPORT_SYMBOL(lc_put);
 EXPORT_SYMBOL(lc_changed);
+EXPORT_SYMBOL(lc_try_get_active);
+EXPORT_SYMBOL(lc_try_put_active);
 EXPORT_SYMBOL(lc_element_by_index);
 EXPORT_SYMBOL(lc_index_of);
 EXPORT_SYMBOL(lc_seq_printf_stats);
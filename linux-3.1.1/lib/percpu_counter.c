@@ -1,5 +1,11 @@
 /*
  * Fast batching percpu counters.
+ *
+ * Counters can opt in to an adaptive batch size with
+ * percpu_counter_set_adaptive(): the batch doubles whenever folding the
+ * local delta finds fbc->lock contended, and halves again whenever a
+ * comparison has to look closely, i.e. the counter is within a few times
+ * its error bound from the value it is compared against.
  */
 
 #include <linux/percpu_counter.h>
@@ -65,24 +71,91 @@ void percpu_counter_set(struct percpu_counter *fbc, s64 amount)
 		*pcount = 0;
 	}
 	fbc->count = amount;
+	fbc->batch_seen = fbc->batch;
 	spin_unlock(&fbc->lock);
 }
 EXPORT_SYMBOL(percpu_counter_set);
 
+/**
+ * percpu_counter_set_adaptive - let the batch size of @fbc adapt to its use
+ * @fbc: the counter
+ * @limit: the largest batch to grow to, 0 for PERCPU_COUNTER_BATCH_LIMIT
+ *
+ * Only for counters updated with percpu_counter_add() and friends, whose
+ * users can live with percpu_counter_read() being off by up to
+ * percpu_counter_error(), which grows with the batch.
+ */
+void percpu_counter_set_adaptive(struct percpu_counter *fbc, s32 limit)
+{
+	if (!limit)
+		limit = PERCPU_COUNTER_BATCH_LIMIT;
+
+	spin_lock(&fbc->lock);
+	fbc->batch_limit = max(limit, percpu_counter_batch);
+	fbc->batch = percpu_counter_batch;
+	fbc->batch_seen = max(fbc->batch_seen, fbc->batch);
+	spin_unlock(&fbc->lock);
+}
+EXPORT_SYMBOL(percpu_counter_set_adaptive);
+
+/* fbc->lock is held */
+static void percpu_counter_grow_batch(struct percpu_counter *fbc)
+{
+	if (!fbc->batch || fbc->batch >= fbc->batch_limit)
+		return;
+	fbc->batch = min(fbc->batch * 2, fbc->batch_limit);
+	fbc->batch_seen = max(fbc->batch_seen, fbc->batch);
+}
+
+/*
+ * batch_seen is left alone here: cpus may still hold deltas up to the
+ * old batch, __percpu_counter_sum() lowers it once it has seen them.
+ */
+static void percpu_counter_shrink_batch(struct percpu_counter *fbc)
+{
+	if (ACCESS_ONCE(fbc->batch) <= percpu_counter_batch)
+		return;
+
+	spin_lock(&fbc->lock);
+	if (fbc->batch > percpu_counter_batch)
+		fbc->batch = max(fbc->batch / 2, percpu_counter_batch);
+	spin_unlock(&fbc->lock);
+}
+
 void __percpu_counter_add(struct percpu_counter *fbc, s64 amount, s32 batch)
 {
 	s64 count;
 
 	preempt_disable();
 	count = __this_cpu_read(*fbc->counters) + amount;
-	if (count >= batch || count <= -batch) {
+	if (count >= batch || count <= -batch)
+		goto fold;
+	__this_cpu_write(*fbc->counters, count);
+	/*
+	 * @batch may predate a shrink.  Deltas below percpu_counter_batch
+	 * are within any batch, larger ones are checked again against the
+	 * current batch.  Pairs with the smp_mb() in __percpu_counter_sum():
+	 * either the sum sees this delta, or we see the smaller batch and
+	 * fold before the sum could have lowered batch_seen past it.
+	 */
+	if (fbc->batch && (count >= percpu_counter_batch ||
+			   count <= -percpu_counter_batch)) {
+		smp_mb();
+		batch = ACCESS_ONCE(fbc->batch);
+		if (count >= batch || count <= -batch)
+			goto fold;
+	}
+	preempt_enable();
+	return;
+
+fold:
+	if (!spin_trylock(&fbc->lock)) {
 		spin_lock(&fbc->lock);
-		fbc->count += count;
-		__this_cpu_write(*fbc->counters, 0);
-		spin_unlock(&fbc->lock);
-	} else {
-		__this_cpu_write(*fbc->counters, count);
+		percpu_counter_grow_batch(fbc);
 	}
+	fbc->count += count;
+	__this_cpu_write(*fbc->counters, 0);
+	spin_unlock(&fbc->lock);
 	preempt_enable();
 }
 EXPORT_SYMBOL(__percpu_counter_add);
@@ -90,18 +163,31 @@ EXPORT_SYMBOL(__percpu_counter_add);
 /*
  * Add up all the per-cpu counts, return the result.  This is a more accurate
  * but much slower version of percpu_counter_read_positive()
+ *
+ * For adaptive counters this also recomputes batch_seen from the deltas
+ * actually held, so the error bound comes back down once the batch has
+ * shrunk and the cpus have folded what they held under the larger one.
+ * Only a pass over every cpu does that, and only under fbc->lock, which
+ * every change of the batch holds too.
  */
 s64 __percpu_counter_sum(struct percpu_counter *fbc)
 {
 	s64 ret;
+	s32 held = 0;
 	int cpu;
 
 	spin_lock(&fbc->lock);
+	/* order the batch we lower to against the deltas, see the add */
+	if (fbc->batch)
+		smp_mb();
 	ret = fbc->count;
 	for_each_online_cpu(cpu) {
 		s32 *pcount = per_cpu_ptr(fbc->counters, cpu);
 		ret += *pcount;
+		held = max(held, abs(*pcount));
 	}
+	if (fbc->batch)
+		fbc->batch_seen = max(fbc->batch, held);
 	spin_unlock(&fbc->lock);
 	return ret;
 }
@@ -113,6 +199,9 @@ int __percpu_counter_init(struct percpu_counter *fbc, s64 amount,
 	spin_lock_init(&fbc->lock);
 	lockdep_set_class(&fbc->lock, key);
 	fbc->count = amount;
+	fbc->batch = 0;
+	fbc->batch_limit = 0;
+	fbc->batch_seen = 0;
 	fbc->counters = alloc_percpu(s32);
 	if (!fbc->counters)
 		return -ENOMEM;
@@ -184,21 +273,61 @@ static int __cpuinit percpu_counter_hotcpu_callback(struct notifier_block *nb,
 	return NOTIFY_OK;
 }
 
+/*
+ * Upper bound of the difference between percpu_counter_read() and
+ * percpu_counter_sum(): every online cpu may hold up to a batch locally,
+ * or more if it has not folded since the batch last shrank.
+ */
+s64 percpu_counter_error(struct percpu_counter *fbc)
+{
+	s32 batch = ACCESS_ONCE(fbc->batch_seen);
+
+	return (s64)max(batch, percpu_counter_batch) * num_online_cpus();
+}
+EXPORT_SYMBOL(percpu_counter_error);
+
 /*
  * Compare counter against given value.
  * Return 1 if greater, 0 if equal and -1 if less
  */
 int percpu_counter_compare(struct percpu_counter *fbc, s64 rhs)
 {
-	s64	count;
+	return percpu_counter_compare_approx(fbc, rhs, 0);
+}
+EXPORT_SYMBOL(percpu_counter_compare);
+
+/**
+ * percpu_counter_compare_approx - compare counter against a value, cheaply
+ * @fbc: the counter
+ * @rhs: the value to compare against
+ * @slack: how far off the answer may be
+ *
+ * Like percpu_counter_compare(), but only falls back to summing up all
+ * cpus if the rough count is within the error bound of @rhs and that
+ * error bound exceeds @slack.  So the result is exact when the counter is
+ * far from @rhs, and may be wrong by at most @slack otherwise.
+ */
+int percpu_counter_compare_approx(struct percpu_counter *fbc, s64 rhs,
+				  s64 slack)
+{
+	s64	count, error, dist;
 
 	count = percpu_counter_read(fbc);
+	error = percpu_counter_error(fbc);
+	dist = abs(count - rhs);
+
+	/* close to the threshold: trade update cost for read accuracy */
+	if (dist <= 4 * error)
+		percpu_counter_shrink_batch(fbc);
+
 	/* Check to see if rough count will be sufficient for comparison */
-	if (abs(count - rhs) > (percpu_counter_batch*num_online_cpus())) {
+	if (dist > error || error <= slack) {
 		if (count > rhs)
 			return 1;
-		else
+		else if (count < rhs)
 			return -1;
+		else
+			return 0;
 	}
 	/* Need to use precise count */
 	count = percpu_counter_sum(fbc);
@@ -209,7 +338,7 @@ int percpu_counter_compare(struct percpu_counter *fbc, s64 rhs)
 	else
 		return 0;
 }
-EXPORT_SYMBOL(percpu_counter_compare);
+EXPORT_SYMBOL(percpu_counter_compare_approx);
 
 static int __init percpu_counter_startup(void)
 {
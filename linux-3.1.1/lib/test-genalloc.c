@@ -0,0 +1,181 @@
+/*
+ * Stress test and benchmark for the generic special memory allocator.
+ *
+ * One thread per online CPU hammers a shared pool with a random mix of
+ * allocations and frees of typical descriptor sizes.  The run is
+ * repeated for each allocation algorithm and with per-CPU caches
+ * enabled, and the elapsed time is reported for each configuration.
+ *
+ * This source code is licensed under the GNU General Public License,
+ * Version 2.  See the file COPYING for more details.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/genalloc.h>
+#include <linux/kthread.h>
+#include <linux/completion.h>
+#include <linux/random.h>
+#include <linux/vmalloc.h>
+#include <linux/ktime.h>
+#include <linux/err.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/cpu.h>
+
+#define NR_SLOTS	256
+
+static unsigned int pool_kb = 4096;
+module_param(pool_kb, uint, 0444);
+MODULE_PARM_DESC(pool_kb, "Size of the test pool in KiB");
+
+static unsigned int order = 5;
+module_param(order, uint, 0444);
+MODULE_PARM_DESC(order, "log2 of the pool allocation granule");
+
+static unsigned int iterations = 200000;
+module_param(iterations, uint, 0444);
+MODULE_PARM_DESC(iterations, "Allocations or frees per thread and run");
+
+static const size_t bench_sizes[] = { 64, 128, 256, 2048 };
+
+struct bench_run {
+	const char *name;
+	genpool_algo_t algo;
+	int cached;
+};
+
+static const struct bench_run bench_runs[] = {
+	{ "first-fit",		gen_pool_first_fit,	0 },
+	{ "best-fit",		gen_pool_best_fit,	0 },
+	{ "first-fit+cache",	gen_pool_first_fit,	1 },
+	{ "best-fit+cache",	gen_pool_best_fit,	1 },
+};
+
+struct bench_ctx {
+	struct gen_pool *pool;
+	atomic_t running;
+	atomic_t failures;
+	struct completion done;
+};
+
+static int test_genalloc_thread(void *data)
+{
+	struct bench_ctx *ctx = data;
+	unsigned long *slots;
+	size_t *sizes;
+	struct rnd_state rnd;
+	unsigned int i, j;
+
+	slots = kzalloc(NR_SLOTS * sizeof(*slots), GFP_KERNEL);
+	sizes = kzalloc(NR_SLOTS * sizeof(*sizes), GFP_KERNEL);
+	if (!slots || !sizes)
+		goto out;
+
+	prandom32_seed(&rnd, current->pid);
+
+	for (i = 0; i < iterations; i++) {
+		u32 r = prandom32(&rnd);
+
+		j = r % NR_SLOTS;
+		if (slots[j]) {
+			gen_pool_free(ctx->pool, slots[j], sizes[j]);
+			slots[j] = 0;
+			continue;
+		}
+		sizes[j] = bench_sizes[(r >> 16) % ARRAY_SIZE(bench_sizes)];
+		slots[j] = gen_pool_alloc(ctx->pool, sizes[j]);
+		if (!slots[j])
+			atomic_inc(&ctx->failures);
+	}
+
+	for (j = 0; j < NR_SLOTS; j++)
+		if (slots[j])
+			gen_pool_free(ctx->pool, slots[j], sizes[j]);
+out:
+	kfree(slots);
+	kfree(sizes);
+	if (atomic_dec_and_test(&ctx->running))
+		complete(&ctx->done);
+	return 0;
+}
+
+static int __init test_genalloc_run(const struct bench_run *run, void *mem)
+{
+	size_t size = (size_t)pool_kb << 10;
+	struct task_struct *tsk;
+	struct bench_ctx ctx;
+	ktime_t start;
+	s64 elapsed;
+	int cpu, i, ret;
+
+	ctx.pool = gen_pool_create(order, -1);
+	if (!ctx.pool)
+		return -ENOMEM;
+	gen_pool_set_algo(ctx.pool, run->algo, NULL);
+	ret = gen_pool_add(ctx.pool, (unsigned long)mem, size, -1);
+	if (ret)
+		goto out;
+	if (run->cached) {
+		for (i = 0; i < ARRAY_SIZE(bench_sizes); i++) {
+			ret = gen_pool_add_cache(ctx.pool, bench_sizes[i]);
+			if (ret)
+				goto out;
+		}
+	}
+
+	atomic_set(&ctx.running, 1);
+	atomic_set(&ctx.failures, 0);
+	init_completion(&ctx.done);
+
+	start = ktime_get();
+	get_online_cpus();
+	for_each_online_cpu(cpu) {
+		tsk = kthread_create(test_genalloc_thread, &ctx,
+				     "test_genalloc/%d", cpu);
+		if (IS_ERR(tsk))
+			continue;
+		kthread_bind(tsk, cpu);
+		atomic_inc(&ctx.running);
+		wake_up_process(tsk);
+	}
+	put_online_cpus();
+	if (atomic_dec_and_test(&ctx.running))
+		complete(&ctx.done);
+	wait_for_completion(&ctx.done);
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	gen_pool_drain_caches(ctx.pool);
+	WARN(gen_pool_avail(ctx.pool) != size,
+	     "test_genalloc: %s leaked %zu bytes\n", run->name,
+	     size - gen_pool_avail(ctx.pool));
+
+	printk(KERN_INFO "test_genalloc: %-16s %u threads x %u ops: %lld us, %d failed allocations\n",
+	       run->name, num_online_cpus(), iterations,
+	       (long long)elapsed / NSEC_PER_USEC,
+	       atomic_read(&ctx.failures));
+out:
+	gen_pool_destroy(ctx.pool);
+	return ret;
+}
+
+static int __init test_genalloc_init(void)
+{
+	void *mem;
+	int i, ret = 0;
+
+	mem = vmalloc((size_t)pool_kb << 10);
+	if (!mem)
+		return -ENOMEM;
+
+	for (i = 0; i < ARRAY_SIZE(bench_runs) && !ret; i++)
+		ret = test_genalloc_run(&bench_runs[i], mem);
+
+	vfree(mem);
+
+	/* Nothing to keep around, fail the load so no rmmod is needed. */
+	return ret ? ret : -EAGAIN;
+}
+module_init(test_genalloc_init);
+MODULE_LICENSE("GPL");
@@ -16,6 +16,7 @@
 #define __AA_MATCH_H
 
 #include <linux/kref.h>
+#include <linux/seqlock.h>
 #include <linux/workqueue.h>
 
 #define DFA_NOMATCH			0
@@ -88,10 +89,34 @@ struct table_header {
 #define ACCEPT_TABLE(DFA) ((u32 *)((DFA)->tables[YYTD_ID_ACCEPT]->td_data))
 #define ACCEPT_TABLE2(DFA) ((u32 *)((DFA)->tables[YYTD_ID_ACCEPT2]->td_data))
 
+#define AA_DFA_CACHE_BITS	5
+#define AA_DFA_CACHE_SIZE	(1 << AA_DFA_CACHE_BITS)
+/* longer strings are always matched by walking the dfa */
+#define AA_DFA_CACHE_MAXLEN	128
+
+/**
+ * struct aa_dfa_cache_ent - a cached match result
+ * @lock: readers retry, writers that find it taken skip the update
+ * @hash: hash of @start and @str
+ * @start: the state the match started in
+ * @state: the state the match finished in
+ * @len: length of @str, 0 while the slot is unused
+ * @str: the string that was matched (not NUL terminated)
+ */
+struct aa_dfa_cache_ent {
+	seqlock_t lock;
+	u32 hash;
+	unsigned int start;
+	unsigned int state;
+	unsigned int len;
+	char str[AA_DFA_CACHE_MAXLEN];
+};
+
 struct aa_dfa {
 	struct kref count;
 	u16 flags;
 	struct table_header *tables[YYTD_ID_TSIZE];
+	struct aa_dfa_cache_ent *cache;		/* MAYBE NULL */
 };
 
 #define byte_to_byte(X) (X)
@@ -116,6 +141,8 @@ unsigned int aa_dfa_match_len(struct aa_dfa *dfa, unsigned int start,
 			      const char *str, int len);
 unsigned int aa_dfa_match(struct aa_dfa *dfa, unsigned int start,
 			  const char *str);
+unsigned int aa_dfa_match_cached(struct aa_dfa *dfa, unsigned int start,
+				 const char *str);
 void aa_dfa_free_kref(struct kref *kref);
 
 /**
@@ -19,6 +19,8 @@
 #include <linux/vmalloc.h>
 #include <linux/err.h>
 #include <linux/kref.h>
+#include <linux/dcache.h>
+#include <linux/hash.h>
 
 #include "include/apparmor.h"
 #include "include/match.h"
@@ -173,6 +175,7 @@ static void dfa_free(struct aa_dfa *dfa)
 			kvfree(dfa->tables[i]);
 			dfa->tables[i] = NULL;
 		}
+		kfree(dfa->cache);
 		kfree(dfa);
 	}
 }
@@ -201,7 +204,7 @@ void aa_dfa_free_kref(struct kref *kref)
  */
 struct aa_dfa *aa_dfa_unpack(void *blob, size_t size, int flags)
 {
-	int hsize;
+	int hsize, i;
 	int error = -ENOMEM;
 	char *data = blob;
 	struct table_header *table = NULL;
@@ -272,6 +275,14 @@ struct aa_dfa *aa_dfa_unpack(void *blob, size_t size, int flags)
 	if (error)
 		goto fail;
 
+	/* the match cache is optional, run without it if it can't be had */
+	dfa->cache = kzalloc(AA_DFA_CACHE_SIZE * sizeof(*dfa->cache),
+			     GFP_KERNEL);
+	if (dfa->cache) {
+		for (i = 0; i < AA_DFA_CACHE_SIZE; i++)
+			seqlock_init(&dfa->cache[i].lock);
+	}
+
 	return dfa;
 
 fail:
@@ -349,5 +360,96 @@ unsigned int aa_dfa_match_len(struct aa_dfa *dfa, unsigned int start,
 unsigned int aa_dfa_match(struct aa_dfa *dfa, unsigned int start,
 			  const char *str)
 {
-	return aa_dfa_match_len(dfa, start, str, strlen(str));
+	u16 *def = DEFAULT_TABLE(dfa);
+	u32 *base = BASE_TABLE(dfa);
+	u16 *next = NEXT_TABLE(dfa);
+	u16 *check = CHECK_TABLE(dfa);
+	unsigned int state = start, pos;
+
+	if (state == 0)
+		return 0;
+
+	/* walk until the NUL instead of running strlen() over @str first */
+	if (dfa->tables[YYTD_ID_EC]) {
+		/* Equivalence class table defined */
+		u8 *equiv = EQUIV_TABLE(dfa);
+		/* default is direct to next state */
+		while (*str) {
+			pos = base[state] + equiv[(u8) *str++];
+			if (check[pos] == state)
+				state = next[pos];
+			else
+				state = def[state];
+		}
+	} else {
+		/* default is direct to next state */
+		while (*str) {
+			pos = base[state] + (u8) *str++;
+			if (check[pos] == state)
+				state = next[pos];
+			else
+				state = def[state];
+		}
+	}
+
+	return state;
+}
+
+/**
+ * aa_dfa_match_cached - aa_dfa_match() with a cache of recent results
+ * @dfa: the dfa to match @str against  (NOT NULL)
+ * @start: the state of the dfa to start matching in
+ * @str: the null terminated string of bytes to match against the dfa (NOT NULL)
+ *
+ * Checks the per dfa cache of recent matches before walking the dfa. A
+ * replaced policy comes with a new dfa, so cached results never outlive
+ * the policy they were computed against. The cache slots are allocated
+ * with the dfa, so a miss only copies the string into its slot.
+ *
+ * Returns: final state reached after input is consumed
+ */
+unsigned int aa_dfa_match_cached(struct aa_dfa *dfa, unsigned int start,
+				 const char *str)
+{
+	struct aa_dfa_cache_ent *ent;
+	unsigned int len, state, seq;
+	unsigned long partial;
+	u32 hash;
+	bool hit;
+
+	if (!dfa->cache)
+		return aa_dfa_match(dfa, start, str);
+
+	/* length and hash in one pass, giving up on long strings early */
+	partial = init_name_hash();
+	for (len = 0; str[len]; len++) {
+		if (len == AA_DFA_CACHE_MAXLEN)
+			return aa_dfa_match(dfa, start, str);
+		partial = partial_name_hash((unsigned char) str[len], partial);
+	}
+	hash = end_name_hash(partial) ^ start;
+	ent = &dfa->cache[hash_32(hash, AA_DFA_CACHE_BITS)];
+
+	do {
+		seq = read_seqbegin(&ent->lock);
+		hit = ent->len == len && ent->hash == hash &&
+		      ent->start == start && memcmp(ent->str, str, len) == 0;
+		state = ent->state;
+	} while (read_seqretry(&ent->lock, seq));
+	if (hit && len)
+		return state;
+
+	state = aa_dfa_match(dfa, start, str);
+
+	/* don't wait for another task filling the same slot */
+	if (write_tryseqlock(&ent->lock)) {
+		ent->hash = hash;
+		ent->start = start;
+		ent->state = state;
+		ent->len = len;
+		memcpy(ent->str, str, len);
+		write_sequnlock(&ent->lock);
+	}
+
+	return state;
 }
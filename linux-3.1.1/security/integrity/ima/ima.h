@@ -73,6 +73,7 @@ void ima_fs_cleanup(void);
 int ima_inode_alloc(struct inode *inode);
 int ima_add_template_entry(struct ima_template_entry *entry, int violation,
 			   const char *op, struct inode *inode);
+int ima_init_crypto(void);
 int ima_calc_hash(struct file *file, char *digest);
 int ima_calc_template_hash(int template_len, void *template, char *digest);
 int ima_calc_boot_aggregate(char *digest);
@@ -102,6 +103,7 @@ static inline unsigned long ima_hash_key(u8 *digest)
 /* integrity data associated with an inode */
 struct ima_iint_cache {
 	struct rb_node rb_node; /* rooted in ima_iint_tree */
+	struct rcu_head rcu;	/* freed by rcu, lookups are lockless */
 	struct inode *inode;	/* back pointer to inode in question */
 	u64 version;		/* track inode changes */
 	unsigned char flags;
@@ -16,27 +16,50 @@
 #include <linux/kernel.h>
 #include <linux/file.h>
 #include <linux/crypto.h>
-#include <linux/scatterlist.h>
 #include <linux/err.h>
 #include <linux/slab.h>
+#include <crypto/hash.h>
 #include "ima.h"
 
-static int init_desc(struct hash_desc *desc)
+/* largest buffer ima_calc_hash() tries to read a file into at once */
+#define IMA_MAX_READ_SIZE	(32 * PAGE_SIZE)
+
+static struct crypto_shash *ima_shash_tfm;
+
+int __init ima_init_crypto(void)
 {
-	int rc;
+	long rc;
 
-	desc->tfm = crypto_alloc_hash(ima_hash, 0, CRYPTO_ALG_ASYNC);
-	if (IS_ERR(desc->tfm)) {
-		pr_info("IMA: failed to load %s transform: %ld\n",
-			ima_hash, PTR_ERR(desc->tfm));
-		rc = PTR_ERR(desc->tfm);
+	ima_shash_tfm = crypto_alloc_shash(ima_hash, 0, 0);
+	if (IS_ERR(ima_shash_tfm)) {
+		rc = PTR_ERR(ima_shash_tfm);
+		pr_err("IMA: failed to load %s transform: %ld\n",
+		       ima_hash, rc);
 		return rc;
 	}
-	desc->flags = 0;
-	rc = crypto_hash_init(desc);
-	if (rc)
-		crypto_free_hash(desc->tfm);
-	return rc;
+	return 0;
+}
+
+/*
+ * Allocate a read buffer of up to @size bytes, settling for less,
+ * down to a single page, when memory is fragmented.
+ */
+static void *ima_alloc_rbuf(loff_t size, size_t *rbuf_size)
+{
+	size_t len = IMA_MAX_READ_SIZE;
+	void *rbuf;
+
+	while (len > PAGE_SIZE && len / 2 >= size)
+		len /= 2;
+	for (; len > PAGE_SIZE; len /= 2) {
+		rbuf = kmalloc(len, GFP_KERNEL | __GFP_NOWARN | __GFP_NORETRY);
+		if (rbuf) {
+			*rbuf_size = len;
+			return rbuf;
+		}
+	}
+	*rbuf_size = PAGE_SIZE;
+	return kmalloc(PAGE_SIZE, GFP_KERNEL);
 }
 
 /*
@@ -44,26 +67,36 @@ static int init_desc(struct hash_desc *desc)
  */
 int ima_calc_hash(struct file *file, char *digest)
 {
-	struct hash_desc desc;
-	struct scatterlist sg[1];
+	struct {
+		struct shash_desc shash;
+		char ctx[crypto_shash_descsize(ima_shash_tfm)];
+	} desc;
 	loff_t i_size, offset = 0;
+	size_t rbuf_size;
 	char *rbuf;
 	int rc;
 
-	rc = init_desc(&desc);
+	desc.shash.tfm = ima_shash_tfm;
+	desc.shash.flags = 0;
+
+	rc = crypto_shash_init(&desc.shash);
 	if (rc != 0)
 		return rc;
 
-	rbuf = kzalloc(PAGE_SIZE, GFP_KERNEL);
-	if (!rbuf) {
-		rc = -ENOMEM;
-		goto out;
-	}
 	i_size = i_size_read(file->f_dentry->d_inode);
+
+	/*
+	 * Reading many pages per call lets the page cache readahead work
+	 * in large chunks, and hashes each chunk in a single update.
+	 */
+	rbuf = ima_alloc_rbuf(i_size, &rbuf_size);
+	if (!rbuf)
+		return -ENOMEM;
+
 	while (offset < i_size) {
 		int rbuf_len;
 
-		rbuf_len = kernel_read(file, offset, rbuf, PAGE_SIZE);
+		rbuf_len = kernel_read(file, offset, rbuf, rbuf_size);
 		if (rbuf_len < 0) {
 			rc = rbuf_len;
 			break;
@@ -71,17 +104,14 @@ int ima_calc_hash(struct file *file, char *digest)
 		if (rbuf_len == 0)
 			break;
 		offset += rbuf_len;
-		sg_init_one(sg, rbuf, rbuf_len);
 
-		rc = crypto_hash_update(&desc, sg, rbuf_len);
+		rc = crypto_shash_update(&desc.shash, rbuf, rbuf_len);
 		if (rc)
 			break;
 	}
 	kfree(rbuf);
 	if (!rc)
-		rc = crypto_hash_final(&desc, digest);
-out:
-	crypto_free_hash(desc.tfm);
+		rc = crypto_shash_final(&desc.shash, digest);
 	return rc;
 }
 
@@ -90,20 +120,16 @@ out:
  */
 int ima_calc_template_hash(int template_len, void *template, char *digest)
 {
-	struct hash_desc desc;
-	struct scatterlist sg[1];
-	int rc;
+	struct {
+		struct shash_desc shash;
+		char ctx[crypto_shash_descsize(ima_shash_tfm)];
+	} desc;
 
-	rc = init_desc(&desc);
-	if (rc != 0)
-		return rc;
+	desc.shash.tfm = ima_shash_tfm;
+	desc.shash.flags = 0;
 
-	sg_init_one(sg, template, template_len);
-	rc = crypto_hash_update(&desc, sg, template_len);
-	if (!rc)
-		rc = crypto_hash_final(&desc, digest);
-	crypto_free_hash(desc.tfm);
-	return rc;
+	return crypto_shash_digest(&desc.shash, template, template_len,
+				   digest);
 }
 
 static void __init ima_pcrread(int idx, u8 *pcr)
@@ -120,12 +146,17 @@ static void __init ima_pcrread(int idx, u8 *pcr)
  */
 int __init ima_calc_boot_aggregate(char *digest)
 {
-	struct hash_desc desc;
-	struct scatterlist sg;
+	struct {
+		struct shash_desc shash;
+		char ctx[crypto_shash_descsize(ima_shash_tfm)];
+	} desc;
 	u8 pcr_i[IMA_DIGEST_SIZE];
 	int rc, i;
 
-	rc = init_desc(&desc);
+	desc.shash.tfm = ima_shash_tfm;
+	desc.shash.flags = 0;
+
+	rc = crypto_shash_init(&desc.shash);
 	if (rc != 0)
 		return rc;
 
@@ -133,11 +164,9 @@ int __init ima_calc_boot_aggregate(char *digest)
 	for (i = TPM_PCR0; i < TPM_PCR8; i++) {
 		ima_pcrread(i, pcr_i);
 		/* now accumulate with current aggregate */
-		sg_init_one(&sg, pcr_i, IMA_DIGEST_SIZE);
-		rc = crypto_hash_update(&desc, &sg, IMA_DIGEST_SIZE);
+		rc = crypto_shash_update(&desc.shash, pcr_i, IMA_DIGEST_SIZE);
 	}
 	if (!rc)
-		crypto_hash_final(&desc, digest);
-	crypto_free_hash(desc.tfm);
+		crypto_shash_final(&desc.shash, digest);
 	return rc;
 }
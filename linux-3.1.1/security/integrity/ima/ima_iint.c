@@ -17,13 +17,23 @@
 #include <linux/slab.h>
 #include <linux/module.h>
 #include <linux/spinlock.h>
+#include <linux/seqlock.h>
+#include <linux/rcupdate.h>
 #include <linux/rbtree.h>
 #include "ima.h"
 
+/*
+ * Writers serialize on ima_iint_lock. Readers walk the tree under
+ * rcu_read_lock() and retry if a writer ran concurrently; iints are
+ * freed by rcu so a racing walk never touches freed memory.
+ */
 static struct rb_root ima_iint_tree = RB_ROOT;
-static DEFINE_SPINLOCK(ima_iint_lock);
+static DEFINE_SEQLOCK(ima_iint_lock);
 static struct kmem_cache *iint_cache __read_mostly;
 
+/* deeper than any valid rbtree, bounds a walk racing with a rotation */
+#define IMA_IINT_MAX_DEPTH	(2 * BITS_PER_LONG)
+
 int iint_initialized = 0;
 
 /*
@@ -32,17 +42,18 @@ int iint_initialized = 0;
 static struct ima_iint_cache *__ima_iint_find(struct inode *inode)
 {
 	struct ima_iint_cache *iint;
-	struct rb_node *n = ima_iint_tree.rb_node;
-
-	assert_spin_locked(&ima_iint_lock);
+	struct rb_node *n = rcu_dereference_raw(ima_iint_tree.rb_node);
+	int depth = 0;
 
 	while (n) {
+		if (++depth > IMA_IINT_MAX_DEPTH)
+			return NULL;
 		iint = rb_entry(n, struct ima_iint_cache, rb_node);
 
 		if (inode < iint->inode)
-			n = n->rb_left;
+			n = rcu_dereference_raw(n->rb_left);
 		else if (inode > iint->inode)
-			n = n->rb_right;
+			n = rcu_dereference_raw(n->rb_right);
 		else
 			break;
 	}
@@ -58,13 +69,21 @@ static struct ima_iint_cache *__ima_iint_find(struct inode *inode)
 struct ima_iint_cache *ima_iint_find(struct inode *inode)
 {
 	struct ima_iint_cache *iint;
+	unsigned seq;
 
 	if (!IS_IMA(inode))
 		return NULL;
 
-	spin_lock(&ima_iint_lock);
-	iint = __ima_iint_find(inode);
-	spin_unlock(&ima_iint_lock);
+	/*
+	 * The caller holds a reference to @inode, so the iint found
+	 * stays around after rcu_read_unlock().
+	 */
+	rcu_read_lock();
+	do {
+		seq = read_seqbegin(&ima_iint_lock);
+		iint = __ima_iint_find(inode);
+	} while (read_seqretry(&ima_iint_lock, seq));
+	rcu_read_unlock();
 
 	return iint;
 }
@@ -76,6 +95,11 @@ static void iint_free(struct ima_iint_cache *iint)
 	kmem_cache_free(iint_cache, iint);
 }
 
+static void iint_free_rcu(struct rcu_head *head)
+{
+	iint_free(container_of(head, struct ima_iint_cache, rcu));
+}
+
 /**
  * ima_inode_alloc - allocate an iint associated with an inode
  * @inode: pointer to the inode
@@ -95,7 +119,7 @@ int ima_inode_alloc(struct inode *inode)
 	new_node = &new_iint->rb_node;
 
 	mutex_lock(&inode->i_mutex); /* i_flags */
-	spin_lock(&ima_iint_lock);
+	write_seqlock(&ima_iint_lock);
 
 	p = &ima_iint_tree.rb_node;
 	while (*p) {
@@ -115,12 +139,12 @@ int ima_inode_alloc(struct inode *inode)
 	rb_link_node(new_node, parent, p);
 	rb_insert_color(new_node, &ima_iint_tree);
 
-	spin_unlock(&ima_iint_lock);
+	write_sequnlock(&ima_iint_lock);
 	mutex_unlock(&inode->i_mutex); /* i_flags */
 
 	return 0;
 out_err:
-	spin_unlock(&ima_iint_lock);
+	write_sequnlock(&ima_iint_lock);
 	mutex_unlock(&inode->i_mutex); /* i_flags */
 	iint_free(new_iint);
 
@@ -140,12 +164,12 @@ void ima_inode_free(struct inode *inode)
 	if (!IS_IMA(inode))
 		return;
 
-	spin_lock(&ima_iint_lock);
+	write_seqlock(&ima_iint_lock);
 	iint = __ima_iint_find(inode);
 	rb_erase(&iint->rb_node, &ima_iint_tree);
-	spin_unlock(&ima_iint_lock);
+	write_sequnlock(&ima_iint_lock);
 
-	iint_free(iint);
+	call_rcu(&iint->rcu, iint_free_rcu);
 }
 
 static void init_once(void *foo)
@@ -18,6 +18,13 @@
  */
 unsigned key_gc_delay = 5 * 60;
 
+/*
+ * Number of keys the collector looks at before giving up key_serial_lock and
+ * rescheduling itself, so that a large key population is trawled in slices
+ * rather than with the serial tree locked throughout
+ */
+#define KEY_GC_BATCH 256
+
 /*
  * Reaper
  */
@@ -117,6 +124,7 @@ static void key_garbage_collector(struct work_struct *work)
 	key_serial_t cursor;
 	struct key *key, *xkey;
 	time_t new_timer = LONG_MAX, limit, now;
+	unsigned scanned = 0;
 
 	now = current_kernel_time().tv_sec;
 	kenter("[%x,%ld]", key_gc_cursor, key_gc_new_timer - now);
@@ -185,12 +193,27 @@ static void key_garbage_collector(struct work_struct *work)
 			 * could be modified, so we have to get it again */
 			goto gc_released_our_lock;
 
+		if (++scanned >= KEY_GC_BATCH)
+			goto gc_yield;
+
 		rb = rb_next(&key->serial_node);
 		if (!rb)
 			goto reached_the_end;
 		key = rb_entry(rb, struct key, serial_node);
 	}
 
+	/* we've done our share for this pass; note where we got to and let
+	 * the rest of the tree be done by a fresh invocation */
+gc_yield:
+	kdebug("gc_yield");
+	key_gc_cursor = key->serial;
+	spin_unlock(&key_serial_lock);
+	key_gc_new_timer = new_timer;
+	clear_bit(0, &key_gc_executing);
+	schedule_work(&key_gc_work);
+	kleave(" [yield]");
+	return;
+
 gc_released_our_lock:
 	kdebug("gc_released_our_lock");
 	key_gc_new_timer = new_timer;
@@ -16,7 +16,10 @@
 #include <linux/security.h>
 #include <linux/seq_file.h>
 #include <linux/err.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
 #include <keys/keyring-type.h>
+#include <keys/user-type.h>
 #include <linux/uaccess.h>
 #include "internal.h"
 
@@ -33,6 +36,12 @@
  */
 #define KEYRING_SEARCH_MAX_DEPTH 6
 
+/*
+ * Key lists are allocated with kmalloc() and are replaced wholesale under RCU,
+ * so keep them within the orders the page allocator can reliably supply.
+ */
+#define KEYRING_LIST_MAX_SIZE (PAGE_SIZE << PAGE_ALLOC_COSTLY_ORDER)
+
 /*
  * We keep all named keyrings in a hash to speed looking them up.
  */
@@ -265,6 +274,151 @@ struct key *keyring_alloc(const char *description, uid_t uid, gid_t gid,
 	return keyring;
 }
 
+/*
+ * Each key list carries an open-addressed index of its keys, hashed by type
+ * and description, so that a key can be found by exact description without
+ * walking every key in the list.  Because a keyring holds at most one link to
+ * any given type+description combination, a lookup has at most one answer.
+ *
+ * Entries are only ever added in place (when a key is appended into the slack
+ * space of the current list); anything that removes a key builds a new list
+ * with a fresh index and swaps it in under RCU.  Expired and revoked keys stay
+ * in the index until the garbage collector rebuilds the list; lookups just
+ * skip them.
+ */
+static inline unsigned short *keyring_list_index(struct keyring_list *klist)
+{
+	return (unsigned short *)&klist->keys[klist->maxkeys];
+}
+
+static unsigned keyring_index_hash(const struct key_type *type,
+				   const char *description)
+{
+	u32 seed = (u32)(unsigned long)type;
+
+	if (!description)
+		return seed;
+	return jhash(description, strlen(description), seed);
+}
+
+/*
+ * Work out the size of a key list that can hold max keys.
+ */
+static size_t keyring_list_size(unsigned max, unsigned *_hsize)
+{
+	unsigned hsize = roundup_pow_of_two(max_t(unsigned, max, 1) * 2);
+
+	if (_hsize)
+		*_hsize = hsize;
+	return sizeof(struct keyring_list) +
+		sizeof(struct key *) * max +
+		sizeof(unsigned short) * hsize;
+}
+
+/*
+ * Allocate a key list that can hold max keys, with an empty index.
+ */
+static struct keyring_list *keyring_list_alloc(unsigned max)
+{
+	struct keyring_list *klist;
+	unsigned hsize;
+	size_t size;
+
+	size = keyring_list_size(max, &hsize);
+	if (size > KEYRING_LIST_MAX_SIZE)
+		return NULL;
+
+	klist = kmalloc(size, GFP_KERNEL);
+	if (klist) {
+		klist->maxkeys = max;
+		klist->nkeys = 0;
+		klist->delkey = 0;
+		klist->hmask = hsize - 1;
+		memset(keyring_list_index(klist), 0,
+		       sizeof(unsigned short) * hsize);
+	}
+	return klist;
+}
+
+/*
+ * Add keys[slot] to the index of a key list.  The slot must not yet be
+ * counted in klist->nkeys if the list is visible to RCU readers.
+ */
+static void keyring_index_add(struct keyring_list *klist,
+			      const struct key_type *type,
+			      const char *description,
+			      unsigned slot)
+{
+	unsigned short *index = keyring_list_index(klist);
+	unsigned h = keyring_index_hash(type, description);
+
+	while (index[h & klist->hmask])
+		h++;
+	index[h & klist->hmask] = slot + 1;
+}
+
+/*
+ * Rebuild the index of a freshly assembled key list from its keys.
+ */
+static void keyring_index_rebuild(struct keyring_list *klist)
+{
+	struct key *key;
+	int loop;
+
+	memset(keyring_list_index(klist), 0,
+	       sizeof(unsigned short) * (klist->hmask + 1));
+
+	for (loop = 0; loop < klist->nkeys; loop++) {
+		key = klist->keys[loop];
+		keyring_index_add(klist, key->type, key->description, loop);
+	}
+}
+
+/*
+ * Find the key of the given type with exactly the given description in a key
+ * list.  The caller must hold the RCU read lock or the keyring semaphore.
+ *
+ * Returns the keys[] slot of the key or -1 if there isn't one.
+ */
+static int keyring_index_lookup(struct keyring_list *klist,
+				const struct key_type *type,
+				const char *description)
+{
+	unsigned short *index = keyring_list_index(klist);
+	unsigned h = keyring_index_hash(type, description);
+	unsigned nkeys, slot;
+	struct key *key;
+
+	/* slots beyond nkeys may be in the middle of being appended */
+	nkeys = ACCESS_ONCE(klist->nkeys);
+	smp_rmb();
+
+	for (;; h++) {
+		slot = index[h & klist->hmask];
+		if (!slot)
+			return -1;
+		slot--;
+		if (slot >= nkeys)
+			continue;
+
+		key = klist->keys[slot];
+		if (key->type == type &&
+		    key->description && description &&
+		    strcmp(key->description, description) == 0)
+			return slot;
+	}
+}
+
+/*
+ * Determine whether a match function is nothing more than an exact comparison
+ * of the key description, in which case the key list index may be used in
+ * place of trying the match function on every key.
+ */
+static inline bool keyring_match_is_exact(key_match_func_t match)
+{
+	return match == user_match || match == keyring_match;
+}
+
 /**
  * keyring_search_aux - Search a keyring tree for a key matching some criteria
  * @keyring_ref: A pointer to the keyring with possession indicator.
@@ -319,11 +473,13 @@ key_ref_t keyring_search_aux(key_ref_t keyring_ref,
 	struct key *keyring, *key;
 	key_ref_t key_ref;
 	long err;
-	int sp, kix;
+	int sp, kix, kend;
+	bool indexed;
 
 	keyring = key_ref_to_ptr(keyring_ref);
 	possessed = is_key_possessed(keyring_ref);
 	key_check(keyring);
+	indexed = keyring_match_is_exact(match);
 
 	/* top keyring must have search permission to begin the search */
 	err = key_task_permission(keyring_ref, cred, KEY_SEARCH);
@@ -379,8 +535,20 @@ descend:
 	if (!keylist)
 		goto not_this_keyring;
 
-	/* iterate through the keys in this keyring first */
-	for (kix = 0; kix < keylist->nkeys; kix++) {
+	/* iterate through the keys in this keyring first - unless we only need
+	 * the one key with the exact description, which the index can give us
+	 * directly */
+	if (indexed) {
+		kix = keyring_index_lookup(keylist, type, description);
+		if (kix < 0)
+			goto search_nested;
+		kend = kix + 1;
+	} else {
+		kix = 0;
+		kend = keylist->nkeys;
+	}
+
+	for (; kix < kend; kix++) {
 		key = keylist->keys[kix];
 		kflags = key->flags;
 
@@ -419,6 +587,7 @@ descend:
 	}
 
 	/* search through the keyrings nested in this one */
+search_nested:
 	kix = 0;
 ascend:
 	for (; kix < keylist->nkeys; kix++) {
@@ -523,7 +692,16 @@ key_ref_t __keyring_search_one(key_ref_t keyring_ref,
 	rcu_read_lock();
 
 	klist = rcu_dereference(keyring->payload.subscriptions);
-	if (klist) {
+	if (klist && keyring_match_is_exact(ktype->match)) {
+		loop = keyring_index_lookup(klist, ktype, description);
+		if (loop >= 0) {
+			key = klist->keys[loop];
+			if (key_permission(make_key_ref(key, possessed),
+					   perm) == 0 &&
+			    !test_bit(KEY_FLAG_REVOKED, &key->flags))
+				goto found;
+		}
+	} else if (klist) {
 		for (loop = 0; loop < klist->nkeys; loop++) {
 			key = klist->keys[loop];
 
@@ -740,27 +918,22 @@ int __key_link_begin(struct key *keyring, const struct key_type *type,
 
 	/* see if there's a matching key we can displace */
 	if (klist && klist->nkeys > 0) {
-		for (loop = klist->nkeys - 1; loop >= 0; loop--) {
-			if (klist->keys[loop]->type == type &&
-			    strcmp(klist->keys[loop]->description,
-				   description) == 0
-			    ) {
-				/* found a match - we'll replace this one with
-				 * the new key */
-				size = sizeof(struct key *) * klist->maxkeys;
-				size += sizeof(*klist);
-				BUG_ON(size > PAGE_SIZE);
-
-				ret = -ENOMEM;
-				nklist = kmemdup(klist, size, GFP_KERNEL);
-				if (!nklist)
-					goto error_sem;
-
-				/* note replacement slot */
-				klist->delkey = nklist->delkey = loop;
-				prealloc = (unsigned long)nklist;
-				goto done;
-			}
+		loop = keyring_index_lookup(klist, type, description);
+		if (loop >= 0) {
+			/* found a match - we'll replace this one with the new
+			 * key; it hashes the same, so the index carries over */
+			size = keyring_list_size(klist->maxkeys, NULL);
+			BUG_ON(size > KEYRING_LIST_MAX_SIZE);
+
+			ret = -ENOMEM;
+			nklist = kmemdup(klist, size, GFP_KERNEL);
+			if (!nklist)
+				goto error_sem;
+
+			/* note replacement slot */
+			klist->delkey = nklist->delkey = loop;
+			prealloc = (unsigned long)nklist;
+			goto done;
 		}
 	}
 
@@ -775,27 +948,33 @@ int __key_link_begin(struct key *keyring, const struct key_type *type,
 		nklist = NULL;
 		prealloc = KEY_LINK_FIXQUOTA;
 	} else {
-		/* grow the key list */
+		/* grow the key list by half again so that filling a large
+		 * keyring doesn't copy the list on every few links */
 		max = 4;
-		if (klist)
-			max += klist->maxkeys;
+		if (klist) {
+			max = klist->maxkeys +
+				max_t(unsigned, 4, klist->maxkeys / 2);
+			if (keyring_list_size(max, NULL) >
+			    KEYRING_LIST_MAX_SIZE)
+				max = klist->maxkeys + 1;
+		}
 
 		ret = -ENFILE;
 		if (max > USHRT_MAX - 1)
 			goto error_quota;
-		size = sizeof(*klist) + sizeof(struct key *) * max;
-		if (size > PAGE_SIZE)
+		if (keyring_list_size(max, NULL) > KEYRING_LIST_MAX_SIZE)
 			goto error_quota;
 
 		ret = -ENOMEM;
-		nklist = kmalloc(size, GFP_KERNEL);
+		nklist = keyring_list_alloc(max);
 		if (!nklist)
 			goto error_quota;
 
-		nklist->maxkeys = max;
 		if (klist) {
 			memcpy(nklist->keys, klist->keys,
 			       sizeof(struct key *) * klist->nkeys);
+			nklist->nkeys = klist->nkeys;
+			keyring_index_rebuild(nklist);
 			nklist->delkey = klist->nkeys;
 			nklist->nkeys = klist->nkeys + 1;
 			klist->delkey = USHRT_MAX;
@@ -806,6 +985,7 @@ int __key_link_begin(struct key *keyring, const struct key_type *type,
 
 		/* add the key into the new space */
 		nklist->keys[nklist->delkey] = NULL;
+		keyring_index_add(nklist, type, description, nklist->delkey);
 	}
 
 	prealloc = (unsigned long)nklist | KEY_LINK_FIXQUOTA;
@@ -885,6 +1065,8 @@ void __key_link(struct key *keyring, struct key *key,
 	} else {
 		/* there's sufficient slack space to append directly */
 		klist->keys[klist->nkeys] = key;
+		keyring_index_add(klist, key->type, key->description,
+				  klist->nkeys);
 		smp_wmb();
 		klist->nkeys++;
 	}
@@ -990,9 +1172,17 @@ int key_unlink(struct key *keyring, struct key *key)
 	klist = rcu_dereference_locked_keyring(keyring);
 	if (klist) {
 		/* search the keyring for the key */
-		for (loop = 0; loop < klist->nkeys; loop++)
-			if (klist->keys[loop] == key)
-				goto key_is_present;
+		loop = keyring_index_lookup(klist, key->type,
+					    key->description);
+		if (loop >= 0 && klist->keys[loop] == key)
+			goto key_is_present;
+
+		/* a key whose type has been unregistered since it was linked
+		 * is indexed under its old type */
+		if (test_bit(KEY_FLAG_DEAD, &key->flags))
+			for (loop = 0; loop < klist->nkeys; loop++)
+				if (klist->keys[loop] == key)
+					goto key_is_present;
 	}
 
 	up_write(&keyring->sem);
@@ -1001,12 +1191,9 @@ int key_unlink(struct key *keyring, struct key *key)
 
 key_is_present:
 	/* we need to copy the key list for RCU purposes */
-	nklist = kmalloc(sizeof(*klist) +
-			 sizeof(struct key *) * klist->maxkeys,
-			 GFP_KERNEL);
+	nklist = keyring_list_alloc(klist->maxkeys);
 	if (!nklist)
 		goto nomem;
-	nklist->maxkeys = klist->maxkeys;
 	nklist->nkeys = klist->nkeys - 1;
 
 	if (loop > 0)
@@ -1019,6 +1206,8 @@ key_is_present:
 		       &klist->keys[loop + 1],
 		       (nklist->nkeys - loop) * sizeof(struct key *));
 
+	keyring_index_rebuild(nklist);
+
 	/* adjust the user's quota */
 	key_payload_reserve(keyring,
 			    keyring->datalen - KEYQUOTA_LINK_BYTES);
@@ -1162,13 +1351,9 @@ void keyring_gc(struct key *keyring, time_t limit)
 
 	/* allocate a new keyring payload */
 	max = roundup(keep, 4);
-	new = kmalloc(sizeof(struct keyring_list) + max * sizeof(struct key *),
-		      GFP_KERNEL);
+	new = keyring_list_alloc(max);
 	if (!new)
 		goto nomem;
-	new->maxkeys = max;
-	new->nkeys = 0;
-	new->delkey = 0;
 
 	/* install the live keys
 	 * - must take care as expired keys may be updated back to life
@@ -1183,6 +1368,7 @@ void keyring_gc(struct key *keyring, time_t limit)
 		}
 	}
 	new->nkeys = keep;
+	keyring_index_rebuild(new);
 
 	/* adjust the quota */
 	key_payload_reserve(keyring,
@@ -22,6 +22,10 @@
 #include <linux/init.h>
 #include <linux/skbuff.h>
 #include <linux/percpu.h>
+#include <linux/vmalloc.h>
+#include <linux/mutex.h>
+#include <linux/log2.h>
+#include <linux/sched.h>
 #include <net/sock.h>
 #include <linux/un.h>
 #include <net/af_unix.h>
@@ -34,13 +38,19 @@
 #include "classmap.h"
 
 #define AVC_CACHE_SLOTS			512
+#define AVC_CACHE_MAX_SLOTS		65536
 #define AVC_DEF_CACHE_THRESHOLD		512
 #define AVC_CACHE_RECLAIM		16
+#define AVC_FRONT_SLOTS			32
 
 #ifdef CONFIG_SECURITY_SELINUX_AVC_STATS
 #define avc_cache_stats_incr(field)	this_cpu_inc(avc_cache_stats.field)
+#define avc_cache_stats_add(field, val)	this_cpu_add(avc_cache_stats.field, val)
+#define avc_cache_stats_clock()		local_clock()
 #else
 #define avc_cache_stats_incr(field)	do {} while (0)
+#define avc_cache_stats_add(field, val)	do { (void)(val); } while (0)
+#define avc_cache_stats_clock()		0
 #endif
 
 struct avc_entry {
@@ -56,14 +66,37 @@ struct avc_node {
 	struct rcu_head		rhead;
 };
 
+struct avc_slot {
+	struct hlist_head	head;	/* head for avc_node->list */
+	spinlock_t		lock;	/* lock for writes */
+};
+
+struct avc_table {
+	unsigned int		size;	/* number of slots, a power of two */
+	struct avc_slot		slots[0];
+};
+
 struct avc_cache {
-	struct hlist_head	slots[AVC_CACHE_SLOTS]; /* head for avc_node->list */
-	spinlock_t		slots_lock[AVC_CACHE_SLOTS]; /* lock for writes */
+	struct avc_table __rcu	*table;
 	atomic_t		lru_hint;	/* LRU hint for reclaim scan */
 	atomic_t		active_nodes;
+	atomic_t		front_gen;	/* validates avc_front entries */
 	u32			latest_notif;	/* latest revocation notification */
 };
 
+/*
+ * Per-cpu copies of recent decisions, checked before the shared hash
+ * table. An entry is only valid while its gen matches front_gen, which
+ * is bumped whenever a cached decision is changed or dropped.
+ */
+struct avc_front_entry {
+	u32			ssid;
+	u32			tsid;
+	u16			tclass;
+	u32			gen;
+	struct av_decision	avd;
+};
+
 struct avc_callback_node {
 	int (*callback) (u32 event, u32 ssid, u32 tsid,
 			 u16 tclass, u32 perms,
@@ -86,10 +119,24 @@ DEFINE_PER_CPU(struct avc_cache_stats, avc_cache_stats) = { 0 };
 static struct avc_cache avc_cache;
 static struct avc_callback_node *avc_callbacks;
 static struct kmem_cache *avc_node_cachep;
+static DEFINE_PER_CPU(struct avc_front_entry [AVC_FRONT_SLOTS], avc_front);
+static DEFINE_MUTEX(avc_resize_mutex);
+
+static inline u32 avc_hash(u32 ssid, u32 tsid, u16 tclass)
+{
+	return ssid ^ (tsid<<2) ^ (tclass<<4);
+}
 
-static inline int avc_hash(u32 ssid, u32 tsid, u16 tclass)
+static inline struct avc_slot *avc_get_slot(struct avc_table *table,
+					    u32 ssid, u32 tsid, u16 tclass)
 {
-	return (ssid ^ (tsid<<2) ^ (tclass<<4)) & (AVC_CACHE_SLOTS - 1);
+	return &table->slots[avc_hash(ssid, tsid, tclass) & (table->size - 1)];
+}
+
+/* Must be called under rcu_read_lock() */
+static inline struct avc_table *avc_get_table(void)
+{
+	return rcu_dereference(avc_cache.table);
 }
 
 /**
@@ -164,16 +211,34 @@ static void avc_dump_query(struct audit_buffer *ab, u32 ssid, u32 tsid, u16 tcla
  *
  * Initialize the access vector cache.
  */
-void __init avc_init(void)
+static struct avc_table *avc_alloc_table(unsigned int size)
 {
-	int i;
+	struct avc_table *table;
+	unsigned int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		INIT_HLIST_HEAD(&avc_cache.slots[i]);
-		spin_lock_init(&avc_cache.slots_lock[i]);
+	table = vmalloc(sizeof(*table) + size * sizeof(struct avc_slot));
+	if (!table)
+		return NULL;
+
+	table->size = size;
+	for (i = 0; i < size; i++) {
+		INIT_HLIST_HEAD(&table->slots[i].head);
+		spin_lock_init(&table->slots[i].lock);
 	}
+	return table;
+}
+
+void __init avc_init(void)
+{
+	struct avc_table *table;
+
+	table = avc_alloc_table(AVC_CACHE_SLOTS);
+	if (!table)
+		panic("SELinux: Unable to allocate the AVC hash table\n");
+	RCU_INIT_POINTER(avc_cache.table, table);
 	atomic_set(&avc_cache.active_nodes, 0);
 	atomic_set(&avc_cache.lru_hint, 0);
+	atomic_set(&avc_cache.front_gen, 1);
 
 	avc_node_cachep = kmem_cache_create("avc_node", sizeof(struct avc_node),
 					     0, SLAB_PANIC, NULL);
@@ -183,16 +248,19 @@ void __init avc_init(void)
 
 int avc_get_hash_stats(char *page)
 {
-	int i, chain_len, max_chain_len, slots_used;
+	int i, chain_len, max_chain_len, slots_used, size;
 	struct avc_node *node;
 	struct hlist_head *head;
+	struct avc_table *table;
 
 	rcu_read_lock();
 
+	table = avc_get_table();
+	size = table->size;
 	slots_used = 0;
 	max_chain_len = 0;
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
+	for (i = 0; i < size; i++) {
+		head = &table->slots[i].head;
 		if (!hlist_empty(head)) {
 			struct hlist_node *next;
 
@@ -210,7 +278,7 @@ int avc_get_hash_stats(char *page)
 	return scnprintf(page, PAGE_SIZE, "entries: %d\nbuckets used: %d/%d\n"
 			 "longest chain: %d\n",
 			 atomic_read(&avc_cache.active_nodes),
-			 slots_used, AVC_CACHE_SLOTS, max_chain_len);
+			 slots_used, size, max_chain_len);
 }
 
 static void avc_node_free(struct rcu_head *rhead)
@@ -241,6 +309,68 @@ static void avc_node_replace(struct avc_node *new, struct avc_node *old)
 	atomic_dec(&avc_cache.active_nodes);
 }
 
+static inline void avc_front_invalidate(void)
+{
+	/* order the node updates before the new generation */
+	smp_mb__before_atomic_inc();
+	atomic_inc(&avc_cache.front_gen);
+}
+
+static inline u32 avc_front_gen(void)
+{
+	u32 gen = atomic_read(&avc_cache.front_gen);
+
+	/* pairs with avc_front_invalidate() */
+	smp_rmb();
+	return gen;
+}
+
+static inline struct avc_front_entry *avc_front_slot(u32 ssid, u32 tsid,
+						     u16 tclass)
+{
+	u32 hvalue = avc_hash(ssid, tsid, tclass) & (AVC_FRONT_SLOTS - 1);
+
+	return &__get_cpu_var(avc_front)[hvalue];
+}
+
+static inline int avc_front_lookup(u32 ssid, u32 tsid, u16 tclass, u32 gen,
+				   struct av_decision *avd)
+{
+	struct avc_front_entry *fe;
+	unsigned long flags;
+	int hit = 0;
+
+	local_irq_save(flags);
+	fe = avc_front_slot(ssid, tsid, tclass);
+	if (fe->gen == gen && fe->ssid == ssid &&
+	    fe->tsid == tsid && fe->tclass == tclass) {
+		memcpy(avd, &fe->avd, sizeof(*avd));
+		hit = 1;
+	}
+	local_irq_restore(flags);
+	return hit;
+}
+
+/*
+ * @gen must have been read before @avd was looked up, so that a change
+ * racing with the lookup leaves an entry that never validates.
+ */
+static inline void avc_front_fill(u32 ssid, u32 tsid, u16 tclass, u32 gen,
+				  struct av_decision *avd)
+{
+	struct avc_front_entry *fe;
+	unsigned long flags;
+
+	local_irq_save(flags);
+	fe = avc_front_slot(ssid, tsid, tclass);
+	fe->ssid = ssid;
+	fe->tsid = tsid;
+	fe->tclass = tclass;
+	fe->gen = gen;
+	memcpy(&fe->avd, avd, sizeof(fe->avd));
+	local_irq_restore(flags);
+}
+
 static inline int avc_reclaim_node(void)
 {
 	struct avc_node *node;
@@ -249,11 +379,13 @@ static inline int avc_reclaim_node(void)
 	struct hlist_head *head;
 	struct hlist_node *next;
 	spinlock_t *lock;
+	struct avc_table *table = avc_get_table();
+	u64 start = avc_cache_stats_clock();
 
-	for (try = 0, ecx = 0; try < AVC_CACHE_SLOTS; try++) {
-		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (AVC_CACHE_SLOTS - 1);
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+	for (try = 0, ecx = 0; try < table->size; try++) {
+		hvalue = atomic_inc_return(&avc_cache.lru_hint) & (table->size - 1);
+		head = &table->slots[hvalue].head;
+		lock = &table->slots[hvalue].lock;
 
 		if (!spin_trylock_irqsave(lock, flags))
 			continue;
@@ -273,9 +405,58 @@ static inline int avc_reclaim_node(void)
 		spin_unlock_irqrestore(lock, flags);
 	}
 out:
+	avc_cache_stats_add(reclaim_ns, avc_cache_stats_clock() - start);
 	return ecx;
 }
 
+/**
+ * avc_set_cache_threshold - Set the AVC cache threshold
+ * @threshold: the number of entries to keep before reclaiming
+ *
+ * The hash table is resized to about one slot per entry. The new table
+ * starts out empty and is refilled on demand, just like after a policy
+ * reload; decisions kept in the per-cpu front caches stay valid.
+ */
+int avc_set_cache_threshold(unsigned int threshold)
+{
+	struct avc_table *table, *old;
+	struct avc_node *node;
+	struct hlist_node *next, *tmp;
+	unsigned int size, i;
+
+	size = clamp_t(unsigned int, threshold,
+		       AVC_CACHE_SLOTS, AVC_CACHE_MAX_SLOTS);
+	size = roundup_pow_of_two(size);
+
+	mutex_lock(&avc_resize_mutex);
+	avc_cache_threshold = threshold;
+	old = rcu_dereference_protected(avc_cache.table,
+					lockdep_is_held(&avc_resize_mutex));
+	if (old->size == size)
+		goto out;
+
+	table = avc_alloc_table(size);
+	if (!table) {
+		mutex_unlock(&avc_resize_mutex);
+		return -ENOMEM;
+	}
+	rcu_assign_pointer(avc_cache.table, table);
+
+	/*
+	 * Every lookup, insert and reclaim runs under rcu_read_lock(), so
+	 * once the grace period ends nobody can see the old table anymore.
+	 */
+	synchronize_rcu();
+	for (i = 0; i < old->size; i++)
+		hlist_for_each_entry_safe(node, next, tmp,
+					  &old->slots[i].head, list)
+			avc_node_kill(node);
+	vfree(old);
+out:
+	mutex_unlock(&avc_resize_mutex);
+	return 0;
+}
+
 static struct avc_node *avc_alloc_node(void)
 {
 	struct avc_node *node;
@@ -305,12 +486,10 @@ static void avc_node_populate(struct avc_node *node, u32 ssid, u32 tsid, u16 tcl
 static inline struct avc_node *avc_search_node(u32 ssid, u32 tsid, u16 tclass)
 {
 	struct avc_node *node, *ret = NULL;
-	int hvalue;
 	struct hlist_head *head;
 	struct hlist_node *next;
 
-	hvalue = avc_hash(ssid, tsid, tclass);
-	head = &avc_cache.slots[hvalue];
+	head = &avc_get_slot(avc_get_table(), ssid, tsid, tclass)->head;
 	hlist_for_each_entry_rcu(node, next, head, list) {
 		if (ssid == node->ae.ssid &&
 		    tclass == node->ae.tclass &&
@@ -391,7 +570,6 @@ static int avc_latest_notif_update(int seqno, int is_insert)
 static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass, struct av_decision *avd)
 {
 	struct avc_node *pos, *node = NULL;
-	int hvalue;
 	unsigned long flag;
 
 	if (avc_latest_notif_update(avd->seqno, 1))
@@ -399,15 +577,16 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass, struct av_dec
 
 	node = avc_alloc_node();
 	if (node) {
+		struct avc_slot *slot;
 		struct hlist_head *head;
 		struct hlist_node *next;
 		spinlock_t *lock;
 
-		hvalue = avc_hash(ssid, tsid, tclass);
 		avc_node_populate(node, ssid, tsid, tclass, avd);
 
-		head = &avc_cache.slots[hvalue];
-		lock = &avc_cache.slots_lock[hvalue];
+		slot = avc_get_slot(avc_get_table(), ssid, tsid, tclass);
+		head = &slot->head;
+		lock = &slot->lock;
 
 		spin_lock_irqsave(lock, flag);
 		hlist_for_each_entry(pos, next, head, list) {
@@ -415,11 +594,12 @@ static struct avc_node *avc_insert(u32 ssid, u32 tsid, u16 tclass, struct av_dec
 			    pos->ae.tsid == tsid &&
 			    pos->ae.tclass == tclass) {
 				avc_node_replace(node, pos);
-				goto found;
+				spin_unlock_irqrestore(lock, flag);
+				avc_front_invalidate();
+				goto out;
 			}
 		}
 		hlist_add_head_rcu(&node->list, head);
-found:
 		spin_unlock_irqrestore(lock, flag);
 	}
 out:
@@ -603,9 +783,10 @@ static inline int avc_sidcmp(u32 x, u32 y)
 static int avc_update_node(u32 event, u32 perms, u32 ssid, u32 tsid, u16 tclass,
 			   u32 seqno)
 {
-	int hvalue, rc = 0;
+	int rc = 0;
 	unsigned long flag;
 	struct avc_node *pos, *node, *orig = NULL;
+	struct avc_slot *slot;
 	struct hlist_head *head;
 	struct hlist_node *next;
 	spinlock_t *lock;
@@ -617,10 +798,9 @@ static int avc_update_node(u32 event, u32 perms, u32 ssid, u32 tsid, u16 tclass,
 	}
 
 	/* Lock the target slot */
-	hvalue = avc_hash(ssid, tsid, tclass);
-
-	head = &avc_cache.slots[hvalue];
-	lock = &avc_cache.slots_lock[hvalue];
+	slot = avc_get_slot(avc_get_table(), ssid, tsid, tclass);
+	head = &slot->head;
+	lock = &slot->lock;
 
 	spin_lock_irqsave(lock, flag);
 
@@ -668,6 +848,9 @@ static int avc_update_node(u32 event, u32 perms, u32 ssid, u32 tsid, u16 tclass,
 		break;
 	}
 	avc_node_replace(node, orig);
+	spin_unlock_irqrestore(lock, flag);
+	avc_front_invalidate();
+	goto out;
 out_unlock:
 	spin_unlock_irqrestore(lock, flag);
 out:
@@ -682,25 +865,24 @@ static void avc_flush(void)
 	struct hlist_head *head;
 	struct hlist_node *next;
 	struct avc_node *node;
+	struct avc_table *table;
 	spinlock_t *lock;
 	unsigned long flag;
 	int i;
 
-	for (i = 0; i < AVC_CACHE_SLOTS; i++) {
-		head = &avc_cache.slots[i];
-		lock = &avc_cache.slots_lock[i];
+	rcu_read_lock();
+	table = avc_get_table();
+	for (i = 0; i < table->size; i++) {
+		head = &table->slots[i].head;
+		lock = &table->slots[i].lock;
 
 		spin_lock_irqsave(lock, flag);
-		/*
-		 * With preemptable RCU, the outer spinlock does not
-		 * prevent RCU grace periods from ending.
-		 */
-		rcu_read_lock();
 		hlist_for_each_entry(node, next, head, list)
 			avc_node_delete(node);
-		rcu_read_unlock();
 		spin_unlock_irqrestore(lock, flag);
 	}
+	rcu_read_unlock();
+	avc_front_invalidate();
 }
 
 /**
@@ -756,23 +938,36 @@ int avc_has_perm_noaudit(u32 ssid, u32 tsid,
 {
 	struct avc_node *node;
 	int rc = 0;
-	u32 denied;
+	u32 denied, gen;
+	u64 start;
 
 	BUG_ON(!requested);
 
 	rcu_read_lock();
 
+	gen = avc_front_gen();
+	if (avc_front_lookup(ssid, tsid, tclass, gen, avd)) {
+		avc_cache_stats_incr(lookups);
+		avc_cache_stats_incr(front_hits);
+		goto check;
+	}
+
 	node = avc_lookup(ssid, tsid, tclass);
 	if (unlikely(!node)) {
 		rcu_read_unlock();
+		start = avc_cache_stats_clock();
 		security_compute_av(ssid, tsid, tclass, avd);
+		avc_cache_stats_add(miss_ns, avc_cache_stats_clock() - start);
 		rcu_read_lock();
 		node = avc_insert(ssid, tsid, tclass, avd);
 	} else {
 		memcpy(avd, &node->ae.avd, sizeof(*avd));
 		avd = &node->ae.avd;
 	}
+	if (node)
+		avc_front_fill(ssid, tsid, tclass, gen, avd);
 
+check:
 	denied = requested & ~(avd->allowed);
 
 	if (denied) {
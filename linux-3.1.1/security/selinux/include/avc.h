@@ -45,6 +45,9 @@ struct avc_cache_stats {
 	unsigned int allocations;
 	unsigned int reclaims;
 	unsigned int frees;
+	unsigned int front_hits;	/* lookups served by the per-cpu cache */
+	unsigned long long miss_ns;	/* time spent computing missed decisions */
+	unsigned long long reclaim_ns;	/* time spent reclaiming nodes */
 };
 
 /*
@@ -96,6 +99,7 @@ int avc_add_callback(int (*callback)(u32 event, u32 ssid, u32 tsid,
 
 /* Exported to selinuxfs */
 int avc_get_hash_stats(char *page);
+int avc_set_cache_threshold(unsigned int threshold);
 extern unsigned int avc_cache_threshold;
 
 /* Attempt to free avc node cache */
@@ -19,16 +19,24 @@
 
 #include <linux/kernel.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/mm.h>
+#include <linux/jhash.h>
 #include <linux/errno.h>
 #include "avtab.h"
 #include "policydb.h"
 
 static struct kmem_cache *avtab_node_cachep;
 
-static inline int avtab_hash(struct avtab_key *keyp, u16 mask)
+/*
+ * Types and classes are small dense integers, so mix all three key
+ * fields instead of shifting them together; the old shift-and-add hash
+ * left most slots of a large table empty.
+ */
+static inline int avtab_hash(struct avtab_key *keyp, u32 mask)
 {
-	return ((keyp->target_class + (keyp->target_type << 2) +
-		 (keyp->source_type << 9)) & mask);
+	return jhash_3words(keyp->source_type, keyp->target_type,
+			    keyp->target_class, 0) & mask;
 }
 
 static struct avtab_node*
@@ -236,7 +244,10 @@ void avtab_destroy(struct avtab *h)
 		}
 		h->htable[i] = NULL;
 	}
-	kfree(h->htable);
+	if (is_vmalloc_addr(h->htable))
+		vfree(h->htable);
+	else
+		kfree(h->htable);
 	h->htable = NULL;
 	h->nslot = 0;
 	h->mask = 0;
@@ -251,7 +262,7 @@ int avtab_init(struct avtab *h)
 
 int avtab_alloc(struct avtab *h, u32 nrules)
 {
-	u16 mask = 0;
+	u32 mask = 0;
 	u32 shift = 0;
 	u32 work = nrules;
 	u32 nslot = 0;
@@ -263,14 +274,18 @@ int avtab_alloc(struct avtab *h, u32 nrules)
 		work  = work >> 1;
 		shift++;
 	}
-	if (shift > 2)
-		shift = shift - 2;
+	if (shift > 1)
+		shift = shift - 1;
 	nslot = 1 << shift;
 	if (nslot > MAX_AVTAB_HASH_BUCKETS)
 		nslot = MAX_AVTAB_HASH_BUCKETS;
 	mask = nslot - 1;
 
-	h->htable = kcalloc(nslot, sizeof(*(h->htable)), GFP_KERNEL);
+	/* large tables may not find enough contiguous pages */
+	h->htable = kcalloc(nslot, sizeof(*(h->htable)),
+			    GFP_KERNEL | __GFP_NOWARN);
+	if (!h->htable)
+		h->htable = vzalloc(nslot * sizeof(*(h->htable)));
 	if (!h->htable)
 		return -ENOMEM;
 
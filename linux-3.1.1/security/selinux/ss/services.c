@@ -1896,13 +1896,14 @@ int security_load_policy(void *data, size_t len)
 	 */
 	args.oldp = &policydb;
 	args.newp = &newpolicydb;
-	rc = sidtab_map(&newsidtab, convert_context, &args);
+	rc = sidtab_map_parallel(&newsidtab, convert_context, &args);
 	if (rc) {
 		printk(KERN_ERR "SELinux:  unable to convert the internal"
 			" representation of contexts in the new SID"
 			" table\n");
 		goto err;
 	}
+	sidtab_reindex(&newsidtab);
 
 	/* Save the old policydb and SID table to free later. */
 	memcpy(&oldpolicydb, &policydb, sizeof policydb);
@@ -7,6 +7,9 @@
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/errno.h>
+#include <linux/jhash.h>
+#include <linux/workqueue.h>
+#include <linux/cpumask.h>
 #include "flask.h"
 #include "security.h"
 #include "sidtab.h"
@@ -14,6 +17,38 @@
 #define SIDTAB_HASH(sid) \
 (sid & SIDTAB_HASH_MASK)
 
+/* below this many entries sidtab_map_parallel() is not worth it */
+#define SIDTAB_PARALLEL_MIN	1024
+
+/*
+ * Must agree with context_cmp(): equal contexts hash equal. Contexts
+ * only carry an MLS range when the policy is MLS enabled, so hashing
+ * the range is safe either way.
+ */
+static u32 sidtab_context_hash(struct context *c)
+{
+	struct ebitmap_node *node;
+	u32 hash;
+	int l;
+
+	if (c->len)
+		return jhash(c->str, c->len, 0);
+
+	hash = jhash_3words(c->user, c->role, c->type, 0);
+	for (l = 0; l < 2; l++) {
+		hash = jhash_1word(c->range.level[l].sens, hash);
+		for (node = c->range.level[l].cat.node; node;
+		     node = node->next) {
+			hash = jhash_1word(node->startbit, hash);
+			hash = jhash(node->maps, sizeof(node->maps), hash);
+		}
+	}
+	return hash;
+}
+
+#define SIDTAB_CTX_HASH(context) \
+(sidtab_context_hash(context) & SIDTAB_HASH_MASK)
+
 int sidtab_init(struct sidtab *s)
 {
 	int i;
@@ -21,8 +56,17 @@ int sidtab_init(struct sidtab *s)
 	s->htable = kmalloc(sizeof(*(s->htable)) * SIDTAB_SIZE, GFP_ATOMIC);
 	if (!s->htable)
 		return -ENOMEM;
-	for (i = 0; i < SIDTAB_SIZE; i++)
+	s->ctx_htable = kmalloc(sizeof(*(s->ctx_htable)) * SIDTAB_SIZE,
+				GFP_ATOMIC);
+	if (!s->ctx_htable) {
+		kfree(s->htable);
+		s->htable = NULL;
+		return -ENOMEM;
+	}
+	for (i = 0; i < SIDTAB_SIZE; i++) {
 		s->htable[i] = NULL;
+		s->ctx_htable[i] = NULL;
+	}
 	s->nel = 0;
 	s->next_sid = 1;
 	s->shutdown = 0;
@@ -32,7 +76,7 @@ int sidtab_init(struct sidtab *s)
 
 int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 {
-	int hvalue, rc = 0;
+	int hvalue, cvalue, rc = 0;
 	struct sidtab_node *prev, *cur, *newnode;
 
 	if (!s) {
@@ -65,6 +109,9 @@ int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 		goto out;
 	}
 
+	cvalue = SIDTAB_CTX_HASH(&newnode->context);
+	newnode->ctx_next = s->ctx_htable[cvalue];
+
 	if (prev) {
 		newnode->next = prev->next;
 		wmb();
@@ -74,6 +121,7 @@ int sidtab_insert(struct sidtab *s, u32 sid, struct context *context)
 		wmb();
 		s->htable[hvalue] = newnode;
 	}
+	s->ctx_htable[cvalue] = newnode;
 
 	s->nel++;
 	if (sid >= s->next_sid)
@@ -147,49 +195,103 @@ out:
 	return rc;
 }
 
-static void sidtab_update_cache(struct sidtab *s, struct sidtab_node *n, int loc)
+struct sidtab_map_work {
+	struct work_struct work;
+	struct sidtab *s;
+	int (*apply) (u32 sid, struct context *context, void *args);
+	void *args;
+	int first, last;	/* range of htable slots to walk */
+	int rc;
+};
+
+static void sidtab_map_work_fn(struct work_struct *work)
 {
-	BUG_ON(loc >= SIDTAB_CACHE_LEN);
+	struct sidtab_map_work *w;
+	struct sidtab_node *cur;
+	int i;
 
-	while (loc > 0) {
-		s->cache[loc] = s->cache[loc - 1];
-		loc--;
+	w = container_of(work, struct sidtab_map_work, work);
+	for (i = w->first; i < w->last; i++) {
+		for (cur = w->s->htable[i]; cur; cur = cur->next) {
+			w->rc = w->apply(cur->sid, &cur->context, w->args);
+			if (w->rc)
+				return;
+		}
 	}
-	s->cache[0] = n;
 }
 
-static inline u32 sidtab_search_context(struct sidtab *s,
-						  struct context *context)
+/*
+ * Like sidtab_map(), but @apply is run on several CPUs at once, so it
+ * must only touch the context it is passed. Used to convert the SID
+ * table on policy reload, which is slow for large tables.
+ */
+int sidtab_map_parallel(struct sidtab *s,
+			int (*apply) (u32 sid,
+				      struct context *context,
+				      void *args),
+			void *args)
+{
+	struct sidtab_map_work *works;
+	int i, nr, chunk, rc = 0;
+
+	nr = num_online_cpus();
+	if (!s || nr < 2 || s->nel < SIDTAB_PARALLEL_MIN)
+		return sidtab_map(s, apply, args);
+
+	works = kcalloc(nr, sizeof(*works), GFP_KERNEL);
+	if (!works)
+		return sidtab_map(s, apply, args);
+
+	chunk = DIV_ROUND_UP(SIDTAB_SIZE, nr);
+	for (i = 0; i < nr; i++) {
+		INIT_WORK(&works[i].work, sidtab_map_work_fn);
+		works[i].s = s;
+		works[i].apply = apply;
+		works[i].args = args;
+		works[i].first = min(i * chunk, SIDTAB_SIZE);
+		works[i].last = min((i + 1) * chunk, SIDTAB_SIZE);
+		queue_work(system_unbound_wq, &works[i].work);
+	}
+	for (i = 0; i < nr; i++) {
+		flush_work(&works[i].work);
+		if (!rc)
+			rc = works[i].rc;
+	}
+	kfree(works);
+	return rc;
+}
+
+/*
+ * Rebuild the context index after the contexts were changed in place,
+ * as sidtab_map() callers converting to a new policy do. There must be
+ * no concurrent users of @s.
+ */
+void sidtab_reindex(struct sidtab *s)
 {
-	int i;
 	struct sidtab_node *cur;
+	int i, cvalue;
 
+	for (i = 0; i < SIDTAB_SIZE; i++)
+		s->ctx_htable[i] = NULL;
 	for (i = 0; i < SIDTAB_SIZE; i++) {
-		cur = s->htable[i];
-		while (cur) {
-			if (context_cmp(&cur->context, context)) {
-				sidtab_update_cache(s, cur, SIDTAB_CACHE_LEN - 1);
-				return cur->sid;
-			}
-			cur = cur->next;
+		for (cur = s->htable[i]; cur; cur = cur->next) {
+			cvalue = SIDTAB_CTX_HASH(&cur->context);
+			cur->ctx_next = s->ctx_htable[cvalue];
+			s->ctx_htable[cvalue] = cur;
 		}
 	}
-	return 0;
 }
 
-static inline u32 sidtab_search_cache(struct sidtab *s, struct context *context)
+static inline u32 sidtab_search_context(struct sidtab *s,
+						  struct context *context)
 {
-	int i;
-	struct sidtab_node *node;
-
-	for (i = 0; i < SIDTAB_CACHE_LEN; i++) {
-		node = s->cache[i];
-		if (unlikely(!node))
-			return 0;
-		if (context_cmp(&node->context, context)) {
-			sidtab_update_cache(s, node, i);
-			return node->sid;
-		}
+	struct sidtab_node *cur;
+
+	cur = s->ctx_htable[SIDTAB_CTX_HASH(context)];
+	while (cur) {
+		if (context_cmp(&cur->context, context))
+			return cur->sid;
+		cur = cur->ctx_next;
 	}
 	return 0;
 }
@@ -204,9 +306,7 @@ int sidtab_context_to_sid(struct sidtab *s,
 
 	*out_sid = SECSID_NULL;
 
-	sid  = sidtab_search_cache(s, context);
-	if (!sid)
-		sid = sidtab_search_context(s, context);
+	sid = sidtab_search_context(s, context);
 	if (!sid) {
 		spin_lock_irqsave(&s->lock, flags);
 		/* Rescan now that we hold the lock. */
@@ -283,7 +383,9 @@ void sidtab_destroy(struct sidtab *s)
 		s->htable[i] = NULL;
 	}
 	kfree(s->htable);
+	kfree(s->ctx_htable);
 	s->htable = NULL;
+	s->ctx_htable = NULL;
 	s->nel = 0;
 	s->next_sid = 1;
 }
@@ -291,15 +393,13 @@ void sidtab_destroy(struct sidtab *s)
 void sidtab_set(struct sidtab *dst, struct sidtab *src)
 {
 	unsigned long flags;
-	int i;
 
 	spin_lock_irqsave(&src->lock, flags);
 	dst->htable = src->htable;
+	dst->ctx_htable = src->ctx_htable;
 	dst->nel = src->nel;
 	dst->next_sid = src->next_sid;
 	dst->shutdown = 0;
-	for (i = 0; i < SIDTAB_CACHE_LEN; i++)
-		dst->cache[i] = NULL;
 	spin_unlock_irqrestore(&src->lock, flags);
 }
 
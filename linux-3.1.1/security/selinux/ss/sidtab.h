@@ -13,9 +13,10 @@ struct sidtab_node {
 	u32 sid;		/* security identifier */
 	struct context context;	/* security context structure */
 	struct sidtab_node *next;
+	struct sidtab_node *ctx_next;	/* chain in the context index */
 };
 
-#define SIDTAB_HASH_BITS 7
+#define SIDTAB_HASH_BITS 9
 #define SIDTAB_HASH_BUCKETS (1 << SIDTAB_HASH_BITS)
 #define SIDTAB_HASH_MASK (SIDTAB_HASH_BUCKETS-1)
 
@@ -23,11 +24,10 @@ struct sidtab_node {
 
 struct sidtab {
 	struct sidtab_node **htable;
+	struct sidtab_node **ctx_htable;	/* index by context hash */
 	unsigned int nel;	/* number of elements */
 	unsigned int next_sid;	/* next SID to allocate */
 	unsigned char shutdown;
-#define SIDTAB_CACHE_LEN	3
-	struct sidtab_node *cache[SIDTAB_CACHE_LEN];
 	spinlock_t lock;
 };
 
@@ -41,6 +41,12 @@ int sidtab_map(struct sidtab *s,
 			     struct context *context,
 			     void *args),
 	       void *args);
+int sidtab_map_parallel(struct sidtab *s,
+			int (*apply) (u32 sid,
+				      struct context *context,
+				      void *args),
+			void *args);
+void sidtab_reindex(struct sidtab *s);
 
 int sidtab_context_to_sid(struct sidtab *s,
 			  struct context *context,
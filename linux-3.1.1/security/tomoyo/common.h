@@ -417,6 +417,7 @@ struct tomoyo_path_info {
 	const char *name;
 	u32 hash;          /* = full_name_hash(name, strlen(name)) */
 	u16 const_len;     /* = tomoyo_const_part_length(name)     */
+	u16 tail_len;      /* = tomoyo_tail_part_length(name)      */
 	bool is_dir;       /* = tomoyo_strendswith(name, "/")      */
 	bool is_patterned; /* = tomoyo_path_contains_pattern(name) */
 };
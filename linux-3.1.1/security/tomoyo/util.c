@@ -593,6 +593,52 @@ static int tomoyo_const_part_length(const char *filename)
 	return len;
 }
 
+/**
+ * tomoyo_tail_part_length - Evaluate the trailing length without a pattern in a token.
+ *
+ * @filename: The string to evaluate.
+ *
+ * Returns the length of the part of @filename after its last wildcard, which
+ * any matching pathname must end with. Returns 0 if @filename contains "\-"
+ * or "\{" patterns, for the trailing part is not mandatory then.
+ */
+static int tomoyo_tail_part_length(const char *filename)
+{
+	const char *start = filename;
+	const char *tail = filename;
+	char c;
+
+	while ((c = *filename++) != '\0') {
+		if (c != '\\')
+			continue;
+		c = *filename++;
+		switch (c) {
+		case '\\':  /* "\\" */
+			continue;
+		case '0':   /* "\ooo" */
+		case '1':
+		case '2':
+		case '3':
+			if (*filename >= '0' && *filename <= '7' &&
+			    filename[1] >= '0' && filename[1] <= '7') {
+				filename += 2;
+				continue;
+			}
+			break;
+		case '-':
+		case '{':
+			return 0;
+		case '\0':
+			return 0; /* Bad pattern. */
+		}
+		tail = filename;
+	}
+	/* No wildcard at all means nothing needs matching at the end. */
+	if (tail == start)
+		return 0;
+	return filename - 1 - tail;
+}
+
 /**
  * tomoyo_fill_path_info - Fill in "struct tomoyo_path_info" members.
  *
@@ -608,6 +654,7 @@ void tomoyo_fill_path_info(struct tomoyo_path_info *ptr)
 	ptr->const_len = tomoyo_const_part_length(name);
 	ptr->is_dir = len && (name[len - 1] == '/');
 	ptr->is_patterned = (ptr->const_len < len);
+	ptr->tail_len = ptr->is_patterned ? tomoyo_tail_part_length(name) : 0;
 	ptr->hash = full_name_hash(name, len);
 }
 
@@ -877,6 +924,15 @@ bool tomoyo_path_matches_pattern(const struct tomoyo_path_info *filename,
 		return false;
 	f += len;
 	p += len;
+	/* Compare the trailing length without patterns. */
+	if (pattern->tail_len) {
+		const int tail = pattern->tail_len;
+		const int f_len = strlen(f);
+
+		if (f_len < tail ||
+		    memcmp(f + f_len - tail, p + strlen(p) - tail, tail))
+			return false;
+	}
 	return tomoyo_path_matches_pattern2(f, p);
 }
 
@@ -4,6 +4,32 @@
 extern int bench_sched_messaging(int argc, const char **argv, const char *prefix);
 extern int bench_sched_pipe(int argc, const char **argv, const char *prefix);
 extern int bench_mem_memcpy(int argc, const char **argv, const char *prefix __used);
+extern int bench_mem_memset(int argc, const char **argv, const char *prefix __used);
+extern int bench_mem_copy_user(int argc, const char **argv, const char *prefix __used);
+
+extern int bench_futex_hash(int argc, const char **argv, const char *prefix);
+extern int bench_futex_requeue(int argc, const char **argv, const char *prefix);
+extern int bench_epoll_wait(int argc, const char **argv, const char *prefix);
+extern int bench_epoll_ctl(int argc, const char **argv, const char *prefix);
+extern int bench_ipc_sem(int argc, const char **argv, const char *prefix);
+extern int bench_ipc_msg(int argc, const char **argv, const char *prefix);
+extern int bench_ipc_mq(int argc, const char **argv, const char *prefix);
+extern int bench_net_udp(int argc, const char **argv, const char *prefix);
+extern int bench_net_tcp(int argc, const char **argv, const char *prefix);
+extern int bench_net_unix(int argc, const char **argv, const char *prefix);
+
+extern void bench_mem_evict_cache(void);
+
+/* thread-count sweeps and reporting, see bench/sweep.c */
+struct timeval;
+extern int bench_sweep_first(bool sweep, int max);
+extern int bench_sweep_next(int nr, int max);
+extern int bench_nr_cpus(void);
+extern void bench_runtime_wait(unsigned int runtime, volatile int *done,
+			       struct timeval *elapsed);
+extern void bench_sweep_header(const char *what, const char *unit);
+extern void bench_sweep_report(int nr, int busy, u64 ops,
+			       const struct timeval *elapsed);
 
 #define BENCH_FORMAT_DEFAULT_STR	"default"
 #define BENCH_FORMAT_DEFAULT		0
@@ -0,0 +1,179 @@
+/*
+ * epoll-ctl.c
+ *
+ * ctl: epoll_ctl() scaling. Every thread keeps adding, modifying and
+ * removing its own set of eventfds on an epoll instance shared with the
+ * other threads, which is what connection churn on a server looks like.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+static unsigned int	nthreads;
+static unsigned int	nfds		= 64;
+static unsigned int	runtime		= 5;
+static bool		multiq;
+static bool		sweep;
+
+static volatile int	done;
+static pthread_mutex_t	start_mtx	= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	start_cond	= PTHREAD_COND_INITIALIZER;
+static int		started;
+
+struct worker {
+	pthread_t	thread;
+	int		epfd;
+	int		*fds;
+	u64		ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: online CPUs)"),
+	OPT_UINTEGER('f', "nfds", &nfds,
+		     "Specify number of eventfds per thread"),
+	OPT_UINTEGER('r', "runtime", &runtime,
+		     "Specify runtime in seconds for each thread count"),
+	OPT_BOOLEAN('m', "multiq", &multiq,
+		    "One epoll instance per thread instead of a shared one"),
+	OPT_BOOLEAN('S', "sweep", &sweep,
+		    "Run 1, 2, 4, ... up to --threads threads"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_ctl_usage[] = {
+	"perf bench epoll ctl <options>",
+	NULL
+};
+
+static void do_ctl(int epfd, int op, int fd, u32 events)
+{
+	struct epoll_event ev;
+
+	ev.events = events;
+	ev.data.fd = fd;
+	if (epoll_ctl(epfd, op, fd, &ev))
+		die("epoll_ctl: %s\n", strerror(errno));
+}
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int i;
+
+	pthread_mutex_lock(&start_mtx);
+	while (!started)
+		pthread_cond_wait(&start_cond, &start_mtx);
+	pthread_mutex_unlock(&start_mtx);
+
+	while (!done) {
+		for (i = 0; i < nfds; i++) {
+			do_ctl(w->epfd, EPOLL_CTL_ADD, w->fds[i], EPOLLIN);
+			do_ctl(w->epfd, EPOLL_CTL_MOD, w->fds[i],
+			       EPOLLIN | EPOLLOUT);
+			do_ctl(w->epfd, EPOLL_CTL_DEL, w->fds[i], 0);
+		}
+		w->ops += 3 * nfds;
+	}
+
+	return NULL;
+}
+
+static void run_one(int nr)
+{
+	struct worker *workers;
+	struct timeval elapsed;
+	unsigned int i, j;
+	u64 ops = 0;
+	int epfd = -1;
+
+	workers = zalloc(nr * sizeof(*workers));
+	if (!workers)
+		die("memory allocation failed\n");
+
+	for (i = 0; i < (unsigned int)nr; i++) {
+		if (multiq || epfd < 0) {
+			epfd = epoll_create(nfds);
+			if (epfd < 0)
+				die("epoll_create: %s\n", strerror(errno));
+		}
+		workers[i].epfd = epfd;
+
+		workers[i].fds = zalloc(nfds * sizeof(int));
+		if (!workers[i].fds)
+			die("memory allocation failed\n");
+		for (j = 0; j < nfds; j++) {
+			workers[i].fds[j] = eventfd(0, EFD_NONBLOCK);
+			if (workers[i].fds[j] < 0)
+				die("eventfd: %s\n", strerror(errno));
+		}
+	}
+
+	done = 0;
+	started = 0;
+	for (i = 0; i < (unsigned int)nr; i++) {
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i]))
+			die("pthread_create failed\n");
+	}
+
+	pthread_mutex_lock(&start_mtx);
+	started = 1;
+	pthread_cond_broadcast(&start_cond);
+	pthread_mutex_unlock(&start_mtx);
+
+	bench_runtime_wait(runtime, &done, &elapsed);
+
+	for (i = 0; i < (unsigned int)nr; i++) {
+		pthread_join(workers[i].thread, NULL);
+		ops += workers[i].ops;
+	}
+
+	/* The shared epoll fd is only safe to close once nobody uses it */
+	for (i = 0; i < (unsigned int)nr; i++) {
+		for (j = 0; j < nfds; j++)
+			close(workers[i].fds[j]);
+		free(workers[i].fds);
+		if (multiq || !i)
+			close(workers[i].epfd);
+	}
+	free(workers);
+
+	bench_sweep_report(nr, nr, ops, &elapsed);
+}
+
+int bench_epoll_ctl(int argc, const char **argv,
+		    const char *prefix __used)
+{
+	int nr;
+
+	argc = parse_options(argc, argv, options,
+			     bench_epoll_ctl_usage, 0);
+
+	if (!nthreads)
+		nthreads = bench_nr_cpus();
+	if (!nfds || !runtime)
+		usage_with_options(bench_epoll_ctl_usage, options);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %u eventfds per thread, %s epoll instance, %u seconds per run\n\n",
+		       nfds, multiq ? "per-thread" : "shared", runtime);
+	bench_sweep_header("epoll ctl", "ctls/sec");
+
+	for (nr = bench_sweep_first(sweep, nthreads); nr <= (int)nthreads;
+	     nr = bench_sweep_next(nr, nthreads))
+		run_one(nr);
+
+	return 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * epoll-wait.c
+ *
+ * wait: epoll_wait() wakeup and ready list scaling. Worker threads wait
+ * on epoll for a pool of eventfds; whoever gets an event consumes it
+ * and immediately re-signals the eventfd, so the events keep bouncing
+ * between the threads for the whole run.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+static unsigned int	nthreads;
+static unsigned int	nfds		= 64;
+static unsigned int	runtime		= 5;
+static bool		edge;
+static bool		oneshot;
+static bool		multiq;
+static bool		sweep;
+
+static volatile int	done;
+static pthread_mutex_t	start_mtx	= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	start_cond	= PTHREAD_COND_INITIALIZER;
+static int		started;
+
+struct worker {
+	pthread_t	thread;
+	int		epfd;
+	int		*fds;
+	unsigned int	nfds;
+	u64		ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of waiting threads (default: online CPUs)"),
+	OPT_UINTEGER('f', "nfds", &nfds,
+		     "Specify number of eventfds per epoll instance"),
+	OPT_UINTEGER('r', "runtime", &runtime,
+		     "Specify runtime in seconds for each thread count"),
+	OPT_BOOLEAN('E', "edge", &edge,
+		    "Use edge-triggered instead of level-triggered events"),
+	OPT_BOOLEAN('o', "oneshot", &oneshot,
+		    "Use EPOLLONESHOT, re-arming with EPOLL_CTL_MOD"),
+	OPT_BOOLEAN('m', "multiq", &multiq,
+		    "One epoll instance per thread instead of a shared one"),
+	OPT_BOOLEAN('S', "sweep", &sweep,
+		    "Run 1, 2, 4, ... up to --threads threads"),
+	OPT_END()
+};
+
+static const char * const bench_epoll_wait_usage[] = {
+	"perf bench epoll wait <options>",
+	NULL
+};
+
+static const u64 one = 1;
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	struct epoll_event ev;
+	u64 val;
+	int ret;
+
+	pthread_mutex_lock(&start_mtx);
+	while (!started)
+		pthread_cond_wait(&start_cond, &start_mtx);
+	pthread_mutex_unlock(&start_mtx);
+
+	while (!done) {
+		ret = epoll_wait(w->epfd, &ev, 1, 100);
+		if (ret < 0 && errno != EINTR)
+			die("epoll_wait: %s\n", strerror(errno));
+		if (ret <= 0)
+			continue;
+
+		/* level-triggered: somebody else may have beaten us to it */
+		if (read(ev.data.fd, &val, sizeof(val)) != sizeof(val))
+			continue;
+		if (write(ev.data.fd, &one, sizeof(one)) != sizeof(one))
+			die("eventfd write: %s\n", strerror(errno));
+		if (oneshot) {
+			ev.events = EPOLLIN | EPOLLONESHOT |
+				    (edge ? EPOLLET : 0);
+			if (epoll_ctl(w->epfd, EPOLL_CTL_MOD, ev.data.fd, &ev))
+				die("epoll_ctl: %s\n", strerror(errno));
+		}
+		w->ops++;
+	}
+
+	return NULL;
+}
+
+static int setup_epoll(int *fds, unsigned int n)
+{
+	struct epoll_event ev;
+	unsigned int i;
+	int epfd;
+
+	epfd = epoll_create(n);
+	if (epfd < 0)
+		die("epoll_create: %s\n", strerror(errno));
+
+	for (i = 0; i < n; i++) {
+		fds[i] = eventfd(0, EFD_NONBLOCK);
+		if (fds[i] < 0)
+			die("eventfd: %s\n", strerror(errno));
+		ev.events = EPOLLIN | (edge ? EPOLLET : 0) |
+			    (oneshot ? EPOLLONESHOT : 0);
+		ev.data.fd = fds[i];
+		if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i], &ev))
+			die("epoll_ctl: %s\n", strerror(errno));
+		if (write(fds[i], &one, sizeof(one)) != sizeof(one))
+			die("eventfd write: %s\n", strerror(errno));
+	}
+
+	return epfd;
+}
+
+static void run_one(int nr)
+{
+	struct worker *workers;
+	struct timeval elapsed;
+	unsigned int i, j, ninst = multiq ? nr : 1;
+	u64 ops = 0;
+
+	workers = zalloc(nr * sizeof(*workers));
+	if (!workers)
+		die("memory allocation failed\n");
+
+	for (i = 0; i < ninst; i++) {
+		workers[i].nfds = nfds;
+		workers[i].fds = zalloc(nfds * sizeof(int));
+		if (!workers[i].fds)
+			die("memory allocation failed\n");
+		workers[i].epfd = setup_epoll(workers[i].fds, nfds);
+	}
+	for (i = ninst; i < (unsigned int)nr; i++)
+		workers[i].epfd = workers[0].epfd;
+
+	done = 0;
+	started = 0;
+	for (i = 0; i < (unsigned int)nr; i++) {
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i]))
+			die("pthread_create failed\n");
+	}
+
+	pthread_mutex_lock(&start_mtx);
+	started = 1;
+	pthread_cond_broadcast(&start_cond);
+	pthread_mutex_unlock(&start_mtx);
+
+	bench_runtime_wait(runtime, &done, &elapsed);
+
+	for (i = 0; i < (unsigned int)nr; i++) {
+		pthread_join(workers[i].thread, NULL);
+		ops += workers[i].ops;
+	}
+	for (i = 0; i < ninst; i++) {
+		for (j = 0; j < workers[i].nfds; j++)
+			close(workers[i].fds[j]);
+		free(workers[i].fds);
+		close(workers[i].epfd);
+	}
+	free(workers);
+
+	bench_sweep_report(nr, nr, ops, &elapsed);
+}
+
+int bench_epoll_wait(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	int nr;
+
+	argc = parse_options(argc, argv, options,
+			     bench_epoll_wait_usage, 0);
+
+	if (!nthreads)
+		nthreads = bench_nr_cpus();
+	if (!nfds || !runtime)
+		usage_with_options(bench_epoll_wait_usage, options);
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %u eventfds per %s epoll instance, %s%s, %u seconds per run\n\n",
+		       nfds, multiq ? "per-thread" : "shared",
+		       edge ? "edge-triggered" : "level-triggered",
+		       oneshot ? " oneshot" : "", runtime);
+	bench_sweep_header("epoll wait", "events/sec");
+
+	for (nr = bench_sweep_first(sweep, nthreads); nr <= (int)nthreads;
+	     nr = bench_sweep_next(nr, nthreads))
+		run_one(nr);
+
+	return 0;
+}
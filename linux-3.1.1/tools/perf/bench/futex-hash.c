@@ -0,0 +1,142 @@
+/*
+ * futex-hash.c
+ *
+ * hash: futex hash bucket contention. Every thread repeatedly issues
+ * FUTEX_WAKE on its own set of futexes nobody waits on, so each op is
+ * a key lookup, a hash and a bucket lock round trip and nothing else.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static unsigned int	nthreads;
+static unsigned int	nfutexes	= 1024;
+static unsigned int	runtime		= 5;
+static bool		shared;
+static bool		sweep;
+
+static volatile int	done;
+static int		futex_flag;
+static pthread_mutex_t	start_mtx	= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	start_cond	= PTHREAD_COND_INITIALIZER;
+static int		started;
+
+struct worker {
+	pthread_t	thread;
+	u_int32_t	*futex;
+	u64		ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of threads (default: online CPUs)"),
+	OPT_UINTEGER('f', "futexes", &nfutexes,
+		     "Specify number of futexes per thread"),
+	OPT_UINTEGER('r', "runtime", &runtime,
+		     "Specify runtime in seconds for each thread count"),
+	OPT_BOOLEAN('s', "shared", &shared,
+		    "Use shared futexes instead of private ones"),
+	OPT_BOOLEAN('S', "sweep", &sweep,
+		    "Run 1, 2, 4, ... up to --threads threads"),
+	OPT_END()
+};
+
+static const char * const bench_futex_hash_usage[] = {
+	"perf bench futex hash <options>",
+	NULL
+};
+
+static void *worker_fn(void *arg)
+{
+	struct worker *w = arg;
+	unsigned int i;
+
+	pthread_mutex_lock(&start_mtx);
+	while (!started)
+		pthread_cond_wait(&start_cond, &start_mtx);
+	pthread_mutex_unlock(&start_mtx);
+
+	while (!done) {
+		for (i = 0; i < nfutexes; i++) {
+			if (futex_wake(&w->futex[i], 1, futex_flag) < 0)
+				die("futex_wake: %s\n", strerror(errno));
+		}
+		w->ops += nfutexes;
+	}
+
+	return NULL;
+}
+
+static void run_one(int nr)
+{
+	struct worker *workers;
+	struct timeval elapsed;
+	u64 ops = 0;
+	int i;
+
+	workers = zalloc(nr * sizeof(*workers));
+	if (!workers)
+		die("memory allocation failed\n");
+
+	done = 0;
+	started = 0;
+	for (i = 0; i < nr; i++) {
+		workers[i].futex = zalloc(nfutexes * sizeof(u_int32_t));
+		if (!workers[i].futex)
+			die("memory allocation failed\n");
+		if (pthread_create(&workers[i].thread, NULL, worker_fn,
+				   &workers[i]))
+			die("pthread_create failed\n");
+	}
+
+	pthread_mutex_lock(&start_mtx);
+	started = 1;
+	pthread_cond_broadcast(&start_cond);
+	pthread_mutex_unlock(&start_mtx);
+
+	bench_runtime_wait(runtime, &done, &elapsed);
+
+	for (i = 0; i < nr; i++) {
+		pthread_join(workers[i].thread, NULL);
+		ops += workers[i].ops;
+		free(workers[i].futex);
+	}
+	free(workers);
+
+	bench_sweep_report(nr, nr, ops, &elapsed);
+}
+
+int bench_futex_hash(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	int nr;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_hash_usage, 0);
+
+	if (!nthreads)
+		nthreads = bench_nr_cpus();
+	if (!nfutexes || !runtime)
+		usage_with_options(bench_futex_hash_usage, options);
+	futex_flag = shared ? 0 : FUTEX_PRIVATE_FLAG;
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %u %s futexes per thread, %u seconds per run\n\n",
+		       nfutexes, shared ? "shared" : "private", runtime);
+	bench_sweep_header("futex hash", "ops/sec");
+
+	for (nr = bench_sweep_first(sweep, nthreads); nr <= (int)nthreads;
+	     nr = bench_sweep_next(nr, nthreads))
+		run_one(nr);
+
+	return 0;
+}
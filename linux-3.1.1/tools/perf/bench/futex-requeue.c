@@ -0,0 +1,152 @@
+/*
+ * futex-requeue.c
+ *
+ * requeue: FUTEX_CMP_REQUEUE cost. A set of threads blocks on one
+ * futex and the main thread moves all of them over to a second one,
+ * @nrequeue at a time, the way condition variables hand waiters over
+ * to the mutex on broadcast. Only the requeueing is timed.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+#include "futex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sys/time.h>
+
+static unsigned int	nthreads;
+static unsigned int	nrequeue	= 1;
+static unsigned int	iterations	= 10;
+static bool		shared;
+static bool		sweep;
+
+static u_int32_t	futex1, futex2;
+static int		futex_flag;
+static pthread_mutex_t	ready_mtx	= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	ready_cond	= PTHREAD_COND_INITIALIZER;
+static unsigned int	ready, nwaiters;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads,
+		     "Specify number of waiters (default: online CPUs)"),
+	OPT_UINTEGER('q', "nrequeue", &nrequeue,
+		     "Specify number of waiters to requeue per call"),
+	OPT_UINTEGER('i', "iterations", &iterations,
+		     "Specify number of iterations for each thread count"),
+	OPT_BOOLEAN('s', "shared", &shared,
+		    "Use shared futexes instead of private ones"),
+	OPT_BOOLEAN('S', "sweep", &sweep,
+		    "Run 1, 2, 4, ... up to --threads waiters"),
+	OPT_END()
+};
+
+static const char * const bench_futex_requeue_usage[] = {
+	"perf bench futex requeue <options>",
+	NULL
+};
+
+static void *waiter_fn(void *arg __used)
+{
+	pthread_mutex_lock(&ready_mtx);
+	if (++ready == nwaiters)
+		pthread_cond_signal(&ready_cond);
+	pthread_mutex_unlock(&ready_mtx);
+
+	/* futex1 turns non-zero once the main thread lets everybody go */
+	while (!*(volatile u_int32_t *)&futex1)
+		futex_wait(&futex1, 0, futex_flag);
+
+	return NULL;
+}
+
+static void run_one(int nr)
+{
+	pthread_t *threads;
+	struct timeval start, end, diff, elapsed;
+	u64 ops = 0;
+	unsigned int it;
+	int i, ret, requeued;
+
+	threads = zalloc(nr * sizeof(*threads));
+	if (!threads)
+		die("memory allocation failed\n");
+	timerclear(&elapsed);
+
+	for (it = 0; it < iterations; it++) {
+		futex1 = futex2 = 0;
+		ready = 0;
+		nwaiters = nr;
+
+		for (i = 0; i < nr; i++) {
+			if (pthread_create(&threads[i], NULL, waiter_fn, NULL))
+				die("pthread_create failed\n");
+		}
+
+		pthread_mutex_lock(&ready_mtx);
+		while (ready < (unsigned int)nr)
+			pthread_cond_wait(&ready_cond, &ready_mtx);
+		pthread_mutex_unlock(&ready_mtx);
+		/* give the last ones a chance to actually block */
+		usleep(10000);
+
+		/*
+		 * A waiter that is not asleep yet is simply picked up by
+		 * one of the following calls.
+		 */
+		BUG_ON(gettimeofday(&start, NULL));
+		for (requeued = 0; requeued < nr; requeued += ret) {
+			ret = futex_cmp_requeue(&futex1, 0, &futex2, 0,
+						nrequeue, futex_flag);
+			if (ret < 0)
+				die("futex_cmp_requeue: %s\n",
+				    strerror(errno));
+		}
+		BUG_ON(gettimeofday(&end, NULL));
+		timersub(&end, &start, &diff);
+		timeradd(&elapsed, &diff, &elapsed);
+		ops += requeued;
+
+		futex1 = 1;
+		futex_wake(&futex2, INT_MAX, futex_flag);
+		futex_wake(&futex1, INT_MAX, futex_flag);
+		for (i = 0; i < nr; i++)
+			pthread_join(threads[i], NULL);
+	}
+	free(threads);
+
+	bench_sweep_report(nr, 1, ops, &elapsed);
+}
+
+int bench_futex_requeue(int argc, const char **argv,
+			const char *prefix __used)
+{
+	unsigned int max;
+	int nr;
+
+	argc = parse_options(argc, argv, options,
+			     bench_futex_requeue_usage, 0);
+
+	if (!nthreads)
+		nthreads = bench_nr_cpus();
+	if (!nrequeue || !iterations)
+		usage_with_options(bench_futex_requeue_usage, options);
+	futex_flag = shared ? 0 : FUTEX_PRIVATE_FLAG;
+	max = nthreads;
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# requeueing %u %s waiters per call, %u iterations\n\n",
+		       nrequeue, shared ? "shared" : "private", iterations);
+	bench_sweep_header("futex requeue", "requeues/sec");
+
+	for (nr = bench_sweep_first(sweep, max); nr <= (int)max;
+	     nr = bench_sweep_next(nr, max))
+		run_one(nr);
+
+	return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * futex.h
+ *
+ * Thin wrappers around the futex syscall for the futex benchmarks,
+ * glibc does not provide any.
+ */
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <linux/futex.h>
+
+/*
+ * The private flag skips the mm lookup when hashing the futex key;
+ * benchmarks that want the shared path pass 0.
+ */
+static inline int
+futex_wait(u_int32_t *uaddr, u_int32_t val, int private_flag)
+{
+	return syscall(SYS_futex, uaddr, FUTEX_WAIT | private_flag, val,
+		       NULL, NULL, 0);
+}
+
+static inline int
+futex_wake(u_int32_t *uaddr, int nr_wake, int private_flag)
+{
+	return syscall(SYS_futex, uaddr, FUTEX_WAKE | private_flag, nr_wake,
+		       NULL, NULL, 0);
+}
+
+/*
+ * Wake up to @nr_wake waiters of @uaddr and move up to @nr_requeue
+ * others over to @uaddr2, provided *@uaddr still equals @val.
+ */
+static inline int
+futex_cmp_requeue(u_int32_t *uaddr, u_int32_t val, u_int32_t *uaddr2,
+		  int nr_wake, int nr_requeue, int private_flag)
+{
+	return syscall(SYS_futex, uaddr, FUTEX_CMP_REQUEUE | private_flag,
+		       nr_wake, (unsigned long)nr_requeue, uaddr2, val);
+}
+
+#endif /* _FUTEX_H */
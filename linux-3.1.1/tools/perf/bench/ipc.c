@@ -0,0 +1,363 @@
+/*
+ * ipc.c
+ *
+ * sem, msg, mq: SysV semaphore, SysV message queue and POSIX message
+ * queue round trips. Like sched pipe, but with any number of thread
+ * pairs ping-ponging at the same time, each pair over its own IPC
+ * objects or, with --shared, all of them over the same one.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <mqueue.h>
+#include <sys/time.h>
+#include <sys/ipc.h>
+#include <sys/sem.h>
+#include <sys/msg.h>
+
+#define LOOPS_DEFAULT 100000
+
+static unsigned int	npairs;
+static unsigned int	loops		= LOOPS_DEFAULT;
+static unsigned int	msgsize		= 64;
+static bool		shared;
+static bool		sweep;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &npairs,
+		     "Specify number of ping-pong thread pairs (default: online CPUs / 2)"),
+	OPT_UINTEGER('l', "loop", &loops,
+		     "Specify number of round trips per pair"),
+	OPT_UINTEGER('b', "size", &msgsize,
+		     "Specify message size in bytes (msg, mq)"),
+	OPT_BOOLEAN('s', "shared", &shared,
+		    "All pairs share one semaphore set or message queue (sem, msg)"),
+	OPT_BOOLEAN('S', "sweep", &sweep,
+		    "Run 1, 2, 4, ... up to --threads pairs"),
+	OPT_END()
+};
+
+struct pair {
+	pthread_t	ping, pong;
+	int		idx;
+	int		id;		/* semid or msqid */
+	mqd_t		mq[2];
+	void		*buf;
+};
+
+/*
+ * Direction 0 is ping to pong, direction 1 the reply. Each IPC flavour
+ * provides a way to post one message in a given direction and to wait
+ * for one.
+ */
+struct ipc_ops {
+	const char	*name;
+	void		(*setup)(struct pair *p, struct pair *first);
+	void		(*post)(struct pair *p, int dir);
+	void		(*wait)(struct pair *p, int dir);
+	void		(*teardown)(struct pair *p);
+};
+
+static pthread_mutex_t	start_mtx	= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	start_cond	= PTHREAD_COND_INITIALIZER;
+static int		started;
+static const struct ipc_ops *ops;
+
+static void sem_setup(struct pair *p, struct pair *first)
+{
+	if (shared && first != p) {
+		p->id = first->id;
+		return;
+	}
+	p->id = semget(IPC_PRIVATE, shared ? 2 * npairs : 2, IPC_CREAT | 0600);
+	if (p->id < 0)
+		die("semget: %s\n", strerror(errno));
+}
+
+static void sysv_sem_do(struct pair *p, int dir, int delta)
+{
+	struct sembuf sop;
+
+	sop.sem_num = (shared ? 2 * p->idx : 0) + dir;
+	sop.sem_op = delta;
+	sop.sem_flg = 0;
+	if (semop(p->id, &sop, 1))
+		die("semop: %s\n", strerror(errno));
+}
+
+static void sysv_sem_post(struct pair *p, int dir)
+{
+	sysv_sem_do(p, dir, 1);
+}
+
+static void sysv_sem_wait(struct pair *p, int dir)
+{
+	sysv_sem_do(p, dir, -1);
+}
+
+static void sem_teardown(struct pair *p)
+{
+	if (!shared || !p->idx)
+		semctl(p->id, 0, IPC_RMID);
+}
+
+struct bench_msgbuf {
+	long	mtype;
+	char	mtext[];
+};
+
+static void msg_setup(struct pair *p, struct pair *first)
+{
+	p->buf = zalloc(sizeof(struct bench_msgbuf) + msgsize);
+	if (!p->buf)
+		die("memory allocation failed\n");
+
+	if (shared && first != p) {
+		p->id = first->id;
+		return;
+	}
+	p->id = msgget(IPC_PRIVATE, IPC_CREAT | 0600);
+	if (p->id < 0)
+		die("msgget: %s\n", strerror(errno));
+}
+
+/* message types must be positive, pairs use 2 * idx + 1 and + 2 */
+static long msg_type(struct pair *p, int dir)
+{
+	return (shared ? 2 * p->idx : 0) + dir + 1;
+}
+
+static void msg_post(struct pair *p, int dir)
+{
+	struct bench_msgbuf *mb = p->buf;
+
+	mb->mtype = msg_type(p, dir);
+	if (msgsnd(p->id, mb, msgsize, 0))
+		die("msgsnd: %s\n", strerror(errno));
+}
+
+static void msg_wait(struct pair *p, int dir)
+{
+	if (msgrcv(p->id, p->buf, msgsize, msg_type(p, dir), 0) < 0)
+		die("msgrcv: %s\n", strerror(errno));
+}
+
+static void msg_teardown(struct pair *p)
+{
+	if (!shared || !p->idx)
+		msgctl(p->id, IPC_RMID, NULL);
+	free(p->buf);
+}
+
+static void mq_setup(struct pair *p, struct pair *first __used)
+{
+	struct mq_attr attr;
+	char name[64];
+	int dir;
+
+	p->buf = zalloc(msgsize);
+	if (!p->buf)
+		die("memory allocation failed\n");
+
+	memset(&attr, 0, sizeof(attr));
+	attr.mq_maxmsg = 1;
+	attr.mq_msgsize = msgsize;
+	for (dir = 0; dir < 2; dir++) {
+		snprintf(name, sizeof(name), "/perf-bench-mq-%d-%d-%d",
+			 getpid(), p->idx, dir);
+		p->mq[dir] = mq_open(name, O_RDWR | O_CREAT | O_EXCL, 0600,
+				     &attr);
+		if (p->mq[dir] == (mqd_t)-1)
+			die("mq_open: %s\n", strerror(errno));
+		mq_unlink(name);
+	}
+}
+
+static void mq_post(struct pair *p, int dir)
+{
+	if (mq_send(p->mq[dir], p->buf, msgsize, 0))
+		die("mq_send: %s\n", strerror(errno));
+}
+
+static void mq_wait(struct pair *p, int dir)
+{
+	if (mq_receive(p->mq[dir], p->buf, msgsize, NULL) < 0)
+		die("mq_receive: %s\n", strerror(errno));
+}
+
+static void mq_teardown(struct pair *p)
+{
+	mq_close(p->mq[0]);
+	mq_close(p->mq[1]);
+	free(p->buf);
+}
+
+static const struct ipc_ops sem_ops = {
+	.name		= "sem",
+	.setup		= sem_setup,
+	.post		= sysv_sem_post,
+	.wait		= sysv_sem_wait,
+	.teardown	= sem_teardown,
+};
+
+static const struct ipc_ops msg_ops = {
+	.name		= "msg",
+	.setup		= msg_setup,
+	.post		= msg_post,
+	.wait		= msg_wait,
+	.teardown	= msg_teardown,
+};
+
+static const struct ipc_ops mq_ops = {
+	.name		= "mq",
+	.setup		= mq_setup,
+	.post		= mq_post,
+	.wait		= mq_wait,
+	.teardown	= mq_teardown,
+};
+
+static void wait_for_start(void)
+{
+	pthread_mutex_lock(&start_mtx);
+	while (!started)
+		pthread_cond_wait(&start_cond, &start_mtx);
+	pthread_mutex_unlock(&start_mtx);
+}
+
+static void *ping_fn(void *arg)
+{
+	struct pair *p = arg;
+	unsigned int i;
+
+	wait_for_start();
+	for (i = 0; i < loops; i++) {
+		ops->post(p, 0);
+		ops->wait(p, 1);
+	}
+	return NULL;
+}
+
+static void *pong_fn(void *arg)
+{
+	struct pair *p = arg;
+	unsigned int i;
+
+	wait_for_start();
+	for (i = 0; i < loops; i++) {
+		ops->wait(p, 0);
+		ops->post(p, 1);
+	}
+	return NULL;
+}
+
+static void run_one(int nr)
+{
+	struct pair *pairs;
+	struct timeval start, end, elapsed;
+	int i;
+
+	pairs = zalloc(nr * sizeof(*pairs));
+	if (!pairs)
+		die("memory allocation failed\n");
+
+	started = 0;
+	for (i = 0; i < nr; i++) {
+		pairs[i].idx = i;
+		ops->setup(&pairs[i], &pairs[0]);
+		if (pthread_create(&pairs[i].ping, NULL, ping_fn, &pairs[i]) ||
+		    pthread_create(&pairs[i].pong, NULL, pong_fn, &pairs[i]))
+			die("pthread_create failed\n");
+	}
+
+	BUG_ON(gettimeofday(&start, NULL));
+	pthread_mutex_lock(&start_mtx);
+	started = 1;
+	pthread_cond_broadcast(&start_cond);
+	pthread_mutex_unlock(&start_mtx);
+
+	for (i = 0; i < nr; i++) {
+		pthread_join(pairs[i].ping, NULL);
+		pthread_join(pairs[i].pong, NULL);
+	}
+	BUG_ON(gettimeofday(&end, NULL));
+	timersub(&end, &start, &elapsed);
+
+	for (i = nr - 1; i >= 0; i--)
+		ops->teardown(&pairs[i]);
+	free(pairs);
+
+	bench_sweep_report(nr, nr, (u64)nr * loops, &elapsed);
+}
+
+static int bench_ipc(const struct ipc_ops *ipc_ops, int argc,
+		     const char **argv, const char * const *usage)
+{
+	unsigned int limit;
+	int nr;
+
+	argc = parse_options(argc, argv, options, usage, 0);
+
+	if (!npairs)
+		npairs = max(bench_nr_cpus() / 2, 1);
+	if (!loops || !msgsize)
+		usage_with_options(usage, options);
+	if (shared && ipc_ops == &mq_ops) {
+		fprintf(stderr, "POSIX message queues cannot be shared\n");
+		return 1;
+	}
+	ops = ipc_ops;
+	limit = npairs;
+
+	if (bench_format == BENCH_FORMAT_DEFAULT) {
+		printf("# %u round trips per pair", loops);
+		if (ops != &sem_ops)
+			printf(", %u byte messages", msgsize);
+		printf(", %s\n\n", shared ? "shared" : "private per pair");
+	}
+	bench_sweep_header(ops->name, "roundtrips/sec");
+
+	for (nr = bench_sweep_first(sweep, limit); nr <= (int)limit;
+	     nr = bench_sweep_next(nr, limit))
+		run_one(nr);
+
+	return 0;
+}
+
+static const char * const bench_ipc_sem_usage[] = {
+	"perf bench ipc sem <options>",
+	NULL
+};
+
+static const char * const bench_ipc_msg_usage[] = {
+	"perf bench ipc msg <options>",
+	NULL
+};
+
+static const char * const bench_ipc_mq_usage[] = {
+	"perf bench ipc mq <options>",
+	NULL
+};
+
+int bench_ipc_sem(int argc, const char **argv, const char *prefix __used)
+{
+	return bench_ipc(&sem_ops, argc, argv, bench_ipc_sem_usage);
+}
+
+int bench_ipc_msg(int argc, const char **argv, const char *prefix __used)
+{
+	return bench_ipc(&msg_ops, argc, argv, bench_ipc_msg_usage);
+}
+
+int bench_ipc_mq(int argc, const char **argv, const char *prefix __used)
+{
+	return bench_ipc(&mq_ops, argc, argv, bench_ipc_mq_usage);
+}
@@ -0,0 +1,247 @@
+/*
+ * mem-common.c
+ *
+ * Option parsing, timing and reporting shared by the mem benchmarks
+ *
+ * Based on mem-memcpy.c by Hitoshi Mitake <mitake@dcl.info.waseda.ac.jp>
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "../util/header.h"
+#include "bench.h"
+#include "mem-common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <errno.h>
+
+#define K 1024
+
+/* comfortably larger than the last level cache of current machines */
+#define EVICT_SIZE	(64 * 1024 * 1024)
+
+static unsigned char	*evict_buf;
+static unsigned char	evict_seq;
+
+/*
+ * Write a buffer several times the size of the LLC, so that whatever the
+ * benchmark touched before has been pushed out to memory.
+ */
+void bench_mem_evict_cache(void)
+{
+	size_t i;
+
+	if (!evict_buf) {
+		evict_buf = malloc(EVICT_SIZE);
+		if (!evict_buf)
+			die("memory allocation failed for cache eviction\n");
+	}
+
+	evict_seq++;
+	for (i = 0; i < EVICT_SIZE; i += 64)
+		evict_buf[i] = evict_seq;
+}
+
+void bench_mem_print_bps(double bps)
+{
+	if (bps < K)
+		printf(" %14lf B/Sec", bps);
+	else if (bps < K * K)
+		printf(" %14lf KB/Sec", bps / K);
+	else if (bps < K * K * K)
+		printf(" %14lf MB/Sec", bps / K / K);
+	else
+		printf(" %14lf GB/Sec", bps / K / K / K);
+}
+
+static const char	*length_str	= "1MB";
+static const char	*routine	= "default";
+static bool		use_clock;
+static int		clock_fd;
+static bool		only_prefault;
+static bool		no_prefault;
+static bool		cold;
+
+static const struct option options[] = {
+	OPT_STRING('l', "length", &length_str, "1MB",
+		    "Specify length of memory to operate on. "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_STRING('r', "routine", &routine, "default",
+		    "Specify routine to use"),
+	OPT_BOOLEAN('c', "clock", &use_clock,
+		    "Use CPU clock for measuring"),
+	OPT_BOOLEAN('o', "only-prefault", &only_prefault,
+		    "Show only the result with page faults before the run"),
+	OPT_BOOLEAN('n', "no-prefault", &no_prefault,
+		    "Show only the result without page faults before the run"),
+	OPT_BOOLEAN('C', "cold", &cold,
+		    "Evict the buffers from the CPU caches first"),
+	OPT_END()
+};
+
+static struct perf_event_attr clock_attr = {
+	.type		= PERF_TYPE_HARDWARE,
+	.config		= PERF_COUNT_HW_CPU_CYCLES
+};
+
+static void init_clock(void)
+{
+	clock_fd = sys_perf_event_open(&clock_attr, getpid(), -1, -1, 0);
+
+	if (clock_fd < 0 && errno == ENOSYS)
+		die("No CONFIG_PERF_EVENTS=y kernel support configured?\n");
+	else
+		BUG_ON(clock_fd < 0);
+}
+
+static u64 get_clock(void)
+{
+	int ret;
+	u64 clk;
+
+	ret = read(clock_fd, &clk, sizeof(u64));
+	BUG_ON(ret != sizeof(u64));
+
+	return clk;
+}
+
+static double timeval2double(struct timeval *ts)
+{
+	return (double)ts->tv_sec +
+		(double)ts->tv_usec / (double)1000000;
+}
+
+static void *alloc_mem(size_t length)
+{
+	void *p = zalloc(length);
+
+	if (!p)
+		die("memory allocation failed - maybe length is too large?\n");
+	return p;
+}
+
+/*
+ * Time one run of routine @r over @len bytes: in CPU cycles per byte if
+ * @use_clock, otherwise as bytes per second.
+ */
+static double do_run(const struct bench_mem_info *info,
+		     const struct bench_mem_routine *r, size_t len,
+		     bool prefault)
+{
+	struct timeval tv_start, tv_end, tv_diff;
+	u64 clock_start, clock_end;
+	void *dst, *src = NULL;
+	double result;
+
+	dst = alloc_mem(len);
+	if (info->need_src)
+		src = alloc_mem(len);
+
+	if (prefault)
+		info->run(r, dst, src, len);
+	if (cold)
+		bench_mem_evict_cache();
+
+	if (use_clock) {
+		clock_start = get_clock();
+		info->run(r, dst, src, len);
+		clock_end = get_clock();
+		result = (double)(clock_end - clock_start) / (double)len;
+	} else {
+		BUG_ON(gettimeofday(&tv_start, NULL));
+		info->run(r, dst, src, len);
+		BUG_ON(gettimeofday(&tv_end, NULL));
+		timersub(&tv_end, &tv_start, &tv_diff);
+		result = (double)len / timeval2double(&tv_diff);
+	}
+
+	free(src);
+	free(dst);
+	return result;
+}
+
+static void print_result(double result)
+{
+	if (use_clock)
+		printf(" %14lf Clock/Byte", result);
+	else
+		bench_mem_print_bps(result);
+}
+
+#define pf (no_prefault ? 0 : 1)
+
+int bench_mem_common(int argc, const char **argv,
+		     const struct bench_mem_info *info)
+{
+	const struct bench_mem_routine *r;
+	double result[2] = { 0.0, 0.0 };
+	size_t len;
+
+	argc = parse_options(argc, argv, options, info->usage, 0);
+
+	if (use_clock)
+		init_clock();
+
+	len = (size_t)perf_atoll((char *)length_str);
+
+	if ((s64)len <= 0) {
+		fprintf(stderr, "Invalid length:%s\n", length_str);
+		return 1;
+	}
+
+	/* same to without specifying either of prefault and no-prefault */
+	if (only_prefault && no_prefault)
+		only_prefault = no_prefault = false;
+
+	for (r = info->routines; r->name; r++) {
+		if (!strcmp(r->name, routine))
+			break;
+	}
+	if (!r->name) {
+		printf("Unknown routine:%s\n", routine);
+		printf("Available routines...\n");
+		for (r = info->routines; r->name; r++)
+			printf("\t%s ... %s\n", r->name, r->desc);
+		return 1;
+	}
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %s %s Bytes ...\n\n", info->what, length_str);
+
+	if (!only_prefault && !no_prefault) {
+		/* show both of results */
+		result[0] = do_run(info, r, len, false);
+		result[1] = do_run(info, r, len, true);
+	} else {
+		result[pf] = do_run(info, r, len, only_prefault);
+	}
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		if (!only_prefault && !no_prefault) {
+			print_result(result[0]);
+			printf("\n");
+			print_result(result[1]);
+			printf(" (with prefault)\n");
+		} else {
+			print_result(result[pf]);
+			printf("%s\n", only_prefault ? " (with prefault)" : "");
+		}
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		if (!only_prefault && !no_prefault)
+			printf("%lf %lf\n", result[0], result[1]);
+		else
+			printf("%lf\n", result[pf]);
+		break;
+	default:
+		/* reaching this means there's some disaster: */
+		die("unknown format: %d\n", bench_format);
+		break;
+	}
+
+	return 0;
+}
@@ -0,0 +1,34 @@
+#ifndef BENCH_MEM_COMMON_H
+#define BENCH_MEM_COMMON_H
+
+/*
+ * Harness shared by the memcpy and memset benchmarks, see mem-common.c
+ */
+
+typedef void *(*memcpy_t)(void *, const void *, size_t);
+typedef void *(*memset_t)(void *, int, size_t);
+
+struct bench_mem_routine {
+	const char *name;
+	const char *desc;
+	union {
+		memcpy_t memcpy;
+		memset_t memset;
+	} fn;
+};
+
+struct bench_mem_info {
+	const struct bench_mem_routine *routines;
+	const char * const *usage;
+	const char *what;		/* "Copying", "Filling", ... */
+	bool need_src;			/* allocate a source buffer too */
+	/* run routine @r once over @len bytes */
+	void (*run)(const struct bench_mem_routine *r, void *dst, void *src,
+		    size_t len);
+};
+
+extern int bench_mem_common(int argc, const char **argv,
+			    const struct bench_mem_info *info);
+extern void bench_mem_print_bps(double bps);
+
+#endif
@@ -0,0 +1,167 @@
+/*
+ * mem-copy-user.c
+ *
+ * copy-user: copy_from_user()/copy_to_user() throughput, measured
+ * through pwrite()/pread() on a file that lives in the page cache
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+#include "mem-common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <errno.h>
+
+static const char	*length_str	= "1MB";
+static const char	*chunk_str	= "64KB";
+static const char	*direction	= "from";
+static const char	*dir_path	= "/dev/shm";
+static int		iterations	= 16;
+static bool		cold;
+
+static const struct option options[] = {
+	OPT_STRING('l', "length", &length_str, "1MB",
+		    "Specify length of memory to copy per iteration. "
+		    "available unit: B, MB, GB (upper and lower)"),
+	OPT_STRING('s', "chunk", &chunk_str, "64KB",
+		    "Specify size of a single read()/write() call"),
+	OPT_STRING('d', "direction", &direction, "from",
+		    "Copy \"from\" user (write) or \"to\" user (read)"),
+	OPT_STRING('p', "path", &dir_path, "/dev/shm",
+		    "Directory for the page cache backed file, tmpfs preferred"),
+	OPT_INTEGER('i', "iterations", &iterations,
+		    "Specify number of iterations"),
+	OPT_BOOLEAN('C', "cold", &cold,
+		    "Evict the user buffer from the CPU caches first"),
+	OPT_END()
+};
+
+static const char * const bench_mem_copy_user_usage[] = {
+	"perf bench mem copy-user <options>",
+	NULL
+};
+
+static int open_backing_file(size_t len)
+{
+	char path[PATH_MAX];
+	char *buf;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/perf-bench-copy-user-XXXXXX",
+		 dir_path);
+	fd = mkstemp(path);
+	if (fd < 0)
+		die("cannot create file in %s: %s\n", dir_path,
+		    strerror(errno));
+	unlink(path);
+
+	/* populate the page cache, so only the copy gets measured */
+	buf = zalloc(len);
+	if (!buf)
+		die("memory allocation failed - maybe length is too large?\n");
+	if (pwrite(fd, buf, len, 0) != (ssize_t)len)
+		die("cannot populate %s: %s\n", dir_path, strerror(errno));
+	free(buf);
+
+	return fd;
+}
+
+static double do_copy_user(int fd, char *buf, size_t len, size_t chunk,
+			   bool to_user)
+{
+	struct timeval tv_start, tv_end, tv_diff;
+	size_t off;
+	ssize_t ret;
+
+	if (cold)
+		bench_mem_evict_cache();
+
+	BUG_ON(gettimeofday(&tv_start, NULL));
+	for (off = 0; off < len; off += chunk) {
+		size_t n = min(chunk, len - off);
+
+		if (to_user)
+			ret = pread(fd, buf + off, n, off);
+		else
+			ret = pwrite(fd, buf + off, n, off);
+		if (ret != (ssize_t)n)
+			die("%s failed: %s\n", to_user ? "pread" : "pwrite",
+			    strerror(errno));
+	}
+	BUG_ON(gettimeofday(&tv_end, NULL));
+
+	timersub(&tv_end, &tv_start, &tv_diff);
+	return (double)tv_diff.tv_sec + (double)tv_diff.tv_usec / 1000000;
+}
+
+int bench_mem_copy_user(int argc, const char **argv,
+			const char *prefix __used)
+{
+	size_t len, chunk;
+	double secs = 0.0, bps;
+	bool to_user;
+	char *buf;
+	int fd, i;
+
+	argc = parse_options(argc, argv, options,
+			     bench_mem_copy_user_usage, 0);
+
+	len = (size_t)perf_atoll((char *)length_str);
+	chunk = (size_t)perf_atoll((char *)chunk_str);
+	if ((s64)len <= 0 || (s64)chunk <= 0 || iterations <= 0) {
+		fprintf(stderr, "Invalid length:%s, chunk:%s or iterations:%d\n",
+			length_str, chunk_str, iterations);
+		return 1;
+	}
+
+	if (!strcmp(direction, "to"))
+		to_user = true;
+	else if (!strcmp(direction, "from"))
+		to_user = false;
+	else {
+		fprintf(stderr, "Invalid direction:%s\n", direction);
+		return 1;
+	}
+
+	fd = open_backing_file(len);
+	buf = zalloc(len);
+	if (!buf)
+		die("memory allocation failed - maybe length is too large?\n");
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# Copying %s Bytes %s user space in %s chunks, %d times ...\n\n",
+		       length_str, to_user ? "to" : "from", chunk_str,
+		       iterations);
+
+	/* the first round faults in buf and is not counted */
+	do_copy_user(fd, buf, len, chunk, to_user);
+	for (i = 0; i < iterations; i++)
+		secs += do_copy_user(fd, buf, len, chunk, to_user);
+
+	free(buf);
+	close(fd);
+
+	bps = (double)len * iterations / secs;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		bench_mem_print_bps(bps);
+		printf("\n");
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n", bps);
+		break;
+	default:
+		/* reaching this means there's some disaster: */
+		die("unknown format: %d\n", bench_format);
+		break;
+	}
+
+	return 0;
+}
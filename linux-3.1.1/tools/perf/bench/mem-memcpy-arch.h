@@ -5,6 +5,7 @@
 	extern void *fn(void *, const void *, size_t);
 
 #include "mem-memcpy-x86-64-asm-def.h"
+#include "mem-memcpy-x86-64-tier-def.h"
 
 #undef MEMCPY_FN
 
@@ -0,0 +1,12 @@
+
+MEMCPY_FN(memcpy_x86_64_movsq,
+	"x86-64-movsq",
+	"rep movsq based memcpy()")
+
+MEMCPY_FN(memcpy_x86_64_movnt,
+	"x86-64-movnt",
+	"memcpy() with non-temporal stores bypassing the cache")
+
+MEMCPY_FN(memcpy_x86_64_tiered,
+	"x86-64-tiered",
+	"word loop, rep movsq or non-temporal stores depending on size")
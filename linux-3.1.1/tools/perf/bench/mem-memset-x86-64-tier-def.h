@@ -0,0 +1,8 @@
+
+MEMSET_FN(memset_x86_64_stosq,
+	"x86-64-stosq",
+	"rep stosq based memset()")
+
+MEMSET_FN(memset_x86_64_movnt,
+	"x86-64-movnt",
+	"memset() with non-temporal stores bypassing the cache")
@@ -0,0 +1,55 @@
+/*
+ * mem-memset.c
+ *
+ * memset: Simple memory fill in various ways
+ *
+ * Based on mem-memcpy.c by Hitoshi Mitake <mitake@dcl.info.waseda.ac.jp>
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "bench.h"
+#include "mem-common.h"
+#include "mem-memset-arch.h"
+
+#include <string.h>
+
+static const struct bench_mem_routine routines[] = {
+	{ "default",
+	  "Default memset() provided by glibc",
+	  { .memset = memset } },
+#ifdef ARCH_X86_64
+
+#define MEMSET_FN(fn, name, desc) { name, desc, { .memset = fn } },
+#include "mem-memset-x86-64-tier-def.h"
+#undef MEMSET_FN
+
+#endif
+
+	{ NULL,
+	  NULL,
+	  { NULL } }
+};
+
+static const char * const bench_mem_memset_usage[] = {
+	"perf bench mem memset <options>",
+	NULL
+};
+
+static void run_memset(const struct bench_mem_routine *r, void *dst,
+		       void *src __used, size_t len)
+{
+	r->fn.memset(dst, 0, len);
+}
+
+int bench_mem_memset(int argc, const char **argv,
+		     const char *prefix __used)
+{
+	static const struct bench_mem_info info = {
+		.routines	= routines,
+		.usage		= bench_mem_memset_usage,
+		.what		= "Filling",
+		.run		= run_memset,
+	};
+
+	return bench_mem_common(argc, argv, &info);
+}
@@ -0,0 +1,112 @@
+/*
+ * mem-x86-64-tier.c
+ *
+ * Copy and fill strategies the size-tiered kernel copy routines choose
+ * between: string instructions for medium sizes, non-temporal stores
+ * for large copies whose destination is not read back soon, and plain
+ * word loops for small sizes.
+ */
+#include "../perf.h"
+#include "mem-memcpy-arch.h"
+#include "mem-memset-arch.h"
+
+#include <string.h>
+
+/* below this a string instruction's startup cost dominates */
+#define TIER_SMALL	64
+/* above this a copy no longer fits comfortably in the LLC */
+#define TIER_LARGE	(256 * 1024)
+
+void *memcpy_x86_64_movsq(void *dst, const void *src, size_t len)
+{
+	void *d = dst;
+	size_t qwords = len >> 3, bytes = len & 7;
+
+	asm volatile("rep movsq"
+		     : "+D" (d), "+S" (src), "+c" (qwords) : : "memory");
+	asm volatile("rep movsb"
+		     : "+D" (d), "+S" (src), "+c" (bytes) : : "memory");
+	return dst;
+}
+
+void *memcpy_x86_64_movnt(void *dst, const void *src, size_t len)
+{
+	char *d = dst;
+	const char *s = src;
+
+	/* movnti needs an aligned destination to combine whole lines */
+	while (len && ((unsigned long)d & 7)) {
+		*d++ = *s++;
+		len--;
+	}
+	for (; len >= 32; len -= 32, d += 32, s += 32) {
+		const unsigned long *sq = (const unsigned long *)s;
+		unsigned long *dq = (unsigned long *)d;
+
+		asm volatile("movnti %1, %0" : "=m" (dq[0]) : "r" (sq[0]));
+		asm volatile("movnti %1, %0" : "=m" (dq[1]) : "r" (sq[1]));
+		asm volatile("movnti %1, %0" : "=m" (dq[2]) : "r" (sq[2]));
+		asm volatile("movnti %1, %0" : "=m" (dq[3]) : "r" (sq[3]));
+	}
+	asm volatile("sfence" : : : "memory");
+	while (len--)
+		*d++ = *s++;
+	return dst;
+}
+
+static void *memcpy_small(void *dst, const void *src, size_t len)
+{
+	char *d = dst;
+	const char *s = src;
+
+	for (; len >= 8; len -= 8, d += 8, s += 8)
+		*(unsigned long *)d = *(const unsigned long *)s;
+	while (len--)
+		*d++ = *s++;
+	return dst;
+}
+
+void *memcpy_x86_64_tiered(void *dst, const void *src, size_t len)
+{
+	if (len < TIER_SMALL)
+		return memcpy_small(dst, src, len);
+	if (len < TIER_LARGE)
+		return memcpy_x86_64_movsq(dst, src, len);
+	return memcpy_x86_64_movnt(dst, src, len);
+}
+
+void *memset_x86_64_stosq(void *dst, int c, size_t len)
+{
+	void *d = dst;
+	unsigned long pattern = 0x0101010101010101UL * (unsigned char)c;
+	size_t qwords = len >> 3, bytes = len & 7;
+
+	asm volatile("rep stosq"
+		     : "+D" (d), "+c" (qwords) : "a" (pattern) : "memory");
+	asm volatile("rep stosb"
+		     : "+D" (d), "+c" (bytes) : "a" (pattern) : "memory");
+	return dst;
+}
+
+void *memset_x86_64_movnt(void *dst, int c, size_t len)
+{
+	char *d = dst;
+	unsigned long pattern = 0x0101010101010101UL * (unsigned char)c;
+
+	while (len && ((unsigned long)d & 7)) {
+		*d++ = c;
+		len--;
+	}
+	for (; len >= 32; len -= 32, d += 32) {
+		unsigned long *dq = (unsigned long *)d;
+
+		asm volatile("movnti %1, %0" : "=m" (dq[0]) : "r" (pattern));
+		asm volatile("movnti %1, %0" : "=m" (dq[1]) : "r" (pattern));
+		asm volatile("movnti %1, %0" : "=m" (dq[2]) : "r" (pattern));
+		asm volatile("movnti %1, %0" : "=m" (dq[3]) : "r" (pattern));
+	}
+	asm volatile("sfence" : : : "memory");
+	while (len--)
+		*d++ = c;
+	return dst;
+}
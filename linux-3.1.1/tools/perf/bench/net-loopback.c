@@ -0,0 +1,372 @@
+/*
+ * net-loopback.c
+ *
+ * udp, tcp, unix: socket round trip latency and streaming throughput
+ * over loopback. Every pair of threads gets its own connection; in
+ * request-response mode the client waits for each reply before sending
+ * the next request, in stream mode it just keeps sending.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "../util/parse-options.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define LOOPS_DEFAULT 100000
+
+static unsigned int	npairs;
+static unsigned int	loops		= LOOPS_DEFAULT;
+static unsigned int	msgsize		= 64;
+static const char	*mode_str	= "rr";
+static bool		dgram;
+static bool		sweep;
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &npairs,
+		     "Specify number of client/server thread pairs (default: online CPUs / 2)"),
+	OPT_UINTEGER('l', "loop", &loops,
+		     "Specify number of messages per pair"),
+	OPT_UINTEGER('b', "size", &msgsize,
+		     "Specify message size in bytes"),
+	OPT_STRING('m', "mode", &mode_str, "rr",
+		   "rr: request-response, stream: one way bulk transfer"),
+	OPT_BOOLEAN('D', "dgram", &dgram,
+		    "Use SOCK_DGRAM instead of SOCK_STREAM (unix)"),
+	OPT_BOOLEAN('S', "sweep", &sweep,
+		    "Run 1, 2, 4, ... up to --threads pairs"),
+	OPT_END()
+};
+
+enum net_proto {
+	NET_UDP,
+	NET_TCP,
+	NET_UNIX,
+};
+
+struct pair {
+	pthread_t	client, server;
+	int		fd[2];		/* client, server */
+	bool		connless;
+	volatile int	done;
+	u64		received;
+	char		*buf[2];
+	struct timeval	last[2];	/* connless: last message handled */
+};
+
+static pthread_mutex_t	start_mtx	= PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	start_cond	= PTHREAD_COND_INITIALIZER;
+static int		started;
+static bool		stream;
+
+static void wait_for_start(void)
+{
+	pthread_mutex_lock(&start_mtx);
+	while (!started)
+		pthread_cond_wait(&start_cond, &start_mtx);
+	pthread_mutex_unlock(&start_mtx);
+}
+
+/*
+ * Connectionless sockets never see EOF, so their receivers poll with a
+ * timeout and give up once the sender is done.
+ */
+static void set_rcvtimeo(int fd)
+{
+	struct timeval tv = { .tv_sec = 0, .tv_usec = 100000 };
+
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)))
+		die("setsockopt: %s\n", strerror(errno));
+}
+
+static void inet_pair(struct pair *p, int type)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int one = 1, lfd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	lfd = socket(AF_INET, type, 0);
+	p->fd[0] = socket(AF_INET, type, 0);
+	if (lfd < 0 || p->fd[0] < 0)
+		die("socket: %s\n", strerror(errno));
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(lfd, (struct sockaddr *)&addr, &len))
+		die("bind: %s\n", strerror(errno));
+
+	if (type == SOCK_DGRAM) {
+		p->fd[1] = lfd;
+		if (connect(p->fd[0], (struct sockaddr *)&addr, len))
+			die("connect: %s\n", strerror(errno));
+		/* so the server can send() its replies */
+		if (getsockname(p->fd[0], (struct sockaddr *)&addr, &len) ||
+		    connect(p->fd[1], (struct sockaddr *)&addr, len))
+			die("connect: %s\n", strerror(errno));
+		return;
+	}
+
+	if (listen(lfd, 1) ||
+	    connect(p->fd[0], (struct sockaddr *)&addr, len))
+		die("connect: %s\n", strerror(errno));
+	p->fd[1] = accept(lfd, NULL, NULL);
+	if (p->fd[1] < 0)
+		die("accept: %s\n", strerror(errno));
+	close(lfd);
+
+	if (!stream &&
+	    (setsockopt(p->fd[0], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) ||
+	     setsockopt(p->fd[1], IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one))))
+		die("setsockopt: %s\n", strerror(errno));
+}
+
+static void setup_pair(struct pair *p, enum net_proto proto)
+{
+	switch (proto) {
+	case NET_UDP:
+		inet_pair(p, SOCK_DGRAM);
+		p->connless = true;
+		break;
+	case NET_TCP:
+		inet_pair(p, SOCK_STREAM);
+		break;
+	case NET_UNIX:
+		if (socketpair(AF_UNIX, dgram ? SOCK_DGRAM : SOCK_STREAM, 0,
+			       p->fd))
+			die("socketpair: %s\n", strerror(errno));
+		p->connless = dgram;
+		break;
+	default:
+		BUG_ON(1);
+	}
+
+	if (p->connless) {
+		set_rcvtimeo(p->fd[0]);
+		set_rcvtimeo(p->fd[1]);
+	}
+
+	p->buf[0] = zalloc(msgsize);
+	p->buf[1] = zalloc(msgsize);
+	if (!p->buf[0] || !p->buf[1])
+		die("memory allocation failed\n");
+}
+
+static void send_msg(int fd, char *buf)
+{
+	size_t off = 0;
+	ssize_t ret;
+
+	while (off < msgsize) {
+		ret = send(fd, buf + off, msgsize - off, 0);
+		if (ret < 0)
+			die("send: %s\n", strerror(errno));
+		off += ret;
+	}
+}
+
+/*
+ * Returns the number of bytes read, 0 on EOF or, for connectionless
+ * sockets, on timeout. Stream sockets are read until a whole message
+ * has arrived.
+ */
+static ssize_t recv_msg(struct pair *p, int fd, char *buf)
+{
+	size_t off = 0;
+	ssize_t ret;
+
+	do {
+		ret = recv(fd, buf + off, msgsize - off, 0);
+		if (ret < 0) {
+			if (p->connless && (errno == EAGAIN || errno == EINTR))
+				return 0;
+			die("recv: %s\n", strerror(errno));
+		}
+		if (!ret)
+			return 0;
+		off += ret;
+	} while (!p->connless && off < msgsize);
+
+	return off;
+}
+
+static void *client_fn(void *arg)
+{
+	struct pair *p = arg;
+	unsigned int i;
+
+	wait_for_start();
+	for (i = 0; i < loops; i++) {
+		send_msg(p->fd[0], p->buf[0]);
+		/* a lost datagram just costs the timeout */
+		if (!stream)
+			recv_msg(p, p->fd[0], p->buf[0]);
+	}
+
+	if (p->connless)
+		BUG_ON(gettimeofday(&p->last[0], NULL));
+	p->done = 1;
+	if (!p->connless)
+		shutdown(p->fd[0], SHUT_WR);
+	return NULL;
+}
+
+static void *server_fn(void *arg)
+{
+	struct pair *p = arg;
+	ssize_t ret;
+
+	wait_for_start();
+	for (;;) {
+		ret = recv_msg(p, p->fd[1], p->buf[1]);
+		if (!ret) {
+			if (!p->connless || p->done)
+				break;
+			continue;
+		}
+		p->received += ret;
+		if (p->connless)
+			BUG_ON(gettimeofday(&p->last[1], NULL));
+		if (!stream)
+			send_msg(p->fd[1], p->buf[1]);
+	}
+	return NULL;
+}
+
+static void run_one(int nr, enum net_proto proto)
+{
+	struct pair *pairs;
+	struct timeval start, end, elapsed;
+	u64 received = 0;
+	int i;
+
+	pairs = zalloc(nr * sizeof(*pairs));
+	if (!pairs)
+		die("memory allocation failed\n");
+
+	started = 0;
+	for (i = 0; i < nr; i++) {
+		setup_pair(&pairs[i], proto);
+		if (pthread_create(&pairs[i].client, NULL, client_fn, &pairs[i]) ||
+		    pthread_create(&pairs[i].server, NULL, server_fn, &pairs[i]))
+			die("pthread_create failed\n");
+	}
+
+	BUG_ON(gettimeofday(&start, NULL));
+	pthread_mutex_lock(&start_mtx);
+	started = 1;
+	pthread_cond_broadcast(&start_cond);
+	pthread_mutex_unlock(&start_mtx);
+
+	for (i = 0; i < nr; i++) {
+		pthread_join(pairs[i].client, NULL);
+		pthread_join(pairs[i].server, NULL);
+	}
+	BUG_ON(gettimeofday(&end, NULL));
+
+	/*
+	 * Connectionless servers only notice the end through the receive
+	 * timeout, so stop the clock at the last message instead.
+	 */
+	if (pairs[0].connless) {
+		timerclear(&end);
+		for (i = 0; i < nr; i++) {
+			if (timercmp(&pairs[i].last[0], &end, >))
+				end = pairs[i].last[0];
+			if (timercmp(&pairs[i].last[1], &end, >))
+				end = pairs[i].last[1];
+		}
+	}
+	timersub(&end, &start, &elapsed);
+
+	for (i = 0; i < nr; i++) {
+		received += pairs[i].received;
+		close(pairs[i].fd[0]);
+		close(pairs[i].fd[1]);
+		free(pairs[i].buf[0]);
+		free(pairs[i].buf[1]);
+	}
+	free(pairs);
+
+	/* messages that actually made it, datagrams can get dropped */
+	bench_sweep_report(nr, nr, received / msgsize, &elapsed);
+}
+
+static int bench_net(enum net_proto proto, const char *name, int argc,
+		     const char **argv, const char * const *usage)
+{
+	unsigned int limit;
+	int nr;
+
+	argc = parse_options(argc, argv, options, usage, 0);
+
+	if (!npairs)
+		npairs = max(bench_nr_cpus() / 2, 1);
+	if (!strcmp(mode_str, "rr"))
+		stream = false;
+	else if (!strcmp(mode_str, "stream"))
+		stream = true;
+	else
+		usage_with_options(usage, options);
+	if (!loops || !msgsize)
+		usage_with_options(usage, options);
+	if (dgram && proto != NET_UNIX) {
+		fprintf(stderr, "--dgram only applies to unix sockets\n");
+		return 1;
+	}
+	limit = npairs;
+
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %s %s, %u messages of %u bytes per pair\n\n",
+		       name, stream ? "stream" : "request-response",
+		       loops, msgsize);
+	bench_sweep_header(name, stream ? "msgs/sec" : "transactions/sec");
+
+	for (nr = bench_sweep_first(sweep, limit); nr <= (int)limit;
+	     nr = bench_sweep_next(nr, limit))
+		run_one(nr, proto);
+
+	return 0;
+}
+
+static const char * const bench_net_udp_usage[] = {
+	"perf bench net udp <options>",
+	NULL
+};
+
+static const char * const bench_net_tcp_usage[] = {
+	"perf bench net tcp <options>",
+	NULL
+};
+
+static const char * const bench_net_unix_usage[] = {
+	"perf bench net unix <options>",
+	NULL
+};
+
+int bench_net_udp(int argc, const char **argv, const char *prefix __used)
+{
+	return bench_net(NET_UDP, "udp", argc, argv, bench_net_udp_usage);
+}
+
+int bench_net_tcp(int argc, const char **argv, const char *prefix __used)
+{
+	return bench_net(NET_TCP, "tcp", argc, argv, bench_net_tcp_usage);
+}
+
+int bench_net_unix(int argc, const char **argv, const char *prefix __used)
+{
+	return bench_net(NET_UNIX, "unix", argc, argv, bench_net_unix_usage);
+}
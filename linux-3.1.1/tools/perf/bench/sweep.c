@@ -0,0 +1,88 @@
+/*
+ * sweep.c
+ *
+ * Thread-count sweeps and result reporting shared by the futex, epoll,
+ * ipc and net benchmark suites.
+ */
+#include "../perf.h"
+#include "../util/util.h"
+#include "bench.h"
+
+#include <linux/kernel.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+/*
+ * Without --sweep only @max is run, otherwise every power of two below
+ * it and @max itself. Returns a value above @max when done.
+ */
+int bench_sweep_first(bool sweep, int max)
+{
+	return sweep ? 1 : max;
+}
+
+int bench_sweep_next(int nr, int max)
+{
+	if (nr == max)
+		return max + 1;
+	return min(nr * 2, max);
+}
+
+int bench_nr_cpus(void)
+{
+	long nr = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return nr > 0 ? (int)nr : 1;
+}
+
+/*
+ * Run for @runtime seconds, measured from the call, then raise @done.
+ */
+void bench_runtime_wait(unsigned int runtime, volatile int *done,
+			struct timeval *elapsed)
+{
+	struct timeval start, end;
+
+	BUG_ON(gettimeofday(&start, NULL));
+	sleep(runtime);
+	*done = 1;
+	BUG_ON(gettimeofday(&end, NULL));
+	timersub(&end, &start, elapsed);
+}
+
+void bench_sweep_header(const char *what, const char *unit)
+{
+	if (bench_format == BENCH_FORMAT_DEFAULT)
+		printf("# %s\n# %8s %16s %14s\n", what, "threads",
+		       unit, "usecs/op");
+	else if (bench_format == BENCH_FORMAT_SIMPLE)
+		printf("# threads %s usecs/op\n", unit);
+}
+
+/*
+ * One line per thread count: aggregate rate of @ops over @elapsed and
+ * the average time one of the @busy threads issuing them took per op.
+ */
+void bench_sweep_report(int nr, int busy, u64 ops,
+			const struct timeval *elapsed)
+{
+	double secs = elapsed->tv_sec + elapsed->tv_usec / 1000000.0;
+	double rate = secs ? ops / secs : 0.0;
+	double usecs = ops ? secs * 1000000.0 * busy / ops : 0.0;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("  %8d %16.0f %14.3f\n", nr, rate, usecs);
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%d %.0f %.3f\n", nr, rate, usecs);
+		break;
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+}
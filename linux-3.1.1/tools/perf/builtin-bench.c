@@ -13,6 +13,10 @@
  * Available subsystem list:
  *  sched ... scheduler and IPC mechanism
  *  mem   ... memory access performance
+ *  futex ... futex hashing and requeueing
+ *  epoll ... epoll wakeup and control scaling
+ *  ipc   ... SysV and POSIX IPC round trips
+ *  net   ... loopback socket latency and throughput
  *
  */
 
@@ -52,6 +56,70 @@ static struct bench_suite mem_suites[] = {
 	{ "memcpy",
 	  "Simple memory copy in various ways",
 	  bench_mem_memcpy },
+	{ "memset",
+	  "Simple memory fill in various ways",
+	  bench_mem_memset },
+	{ "copy-user",
+	  "copy_to_user()/copy_from_user() through read and write",
+	  bench_mem_copy_user },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite futex_suites[] = {
+	{ "hash",
+	  "Futex hash bucket contention from concurrent wakes",
+	  bench_futex_hash },
+	{ "requeue",
+	  "Requeueing of blocked waiters to a second futex",
+	  bench_futex_requeue },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite epoll_suites[] = {
+	{ "wait",
+	  "Event delivery to threads blocked in epoll_wait()",
+	  bench_epoll_wait },
+	{ "ctl",
+	  "Concurrent epoll_ctl() add/mod/del",
+	  bench_epoll_ctl },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite ipc_suites[] = {
+	{ "sem",
+	  "SysV semaphore ping-pong between thread pairs",
+	  bench_ipc_sem },
+	{ "msg",
+	  "SysV message queue ping-pong between thread pairs",
+	  bench_ipc_msg },
+	{ "mq",
+	  "POSIX message queue ping-pong between thread pairs",
+	  bench_ipc_mq },
+	suite_all,
+	{ NULL,
+	  NULL,
+	  NULL             }
+};
+
+static struct bench_suite net_suites[] = {
+	{ "udp",
+	  "UDP loopback request-response or stream",
+	  bench_net_udp },
+	{ "tcp",
+	  "TCP loopback request-response or stream",
+	  bench_net_tcp },
+	{ "unix",
+	  "Unix domain socket request-response or stream",
+	  bench_net_unix },
 	suite_all,
 	{ NULL,
 	  NULL,
@@ -71,6 +139,18 @@ static struct bench_subsys subsystems[] = {
 	{ "mem",
 	  "memory access performance",
 	  mem_suites },
+	{ "futex",
+	  "futex hashing and requeueing",
+	  futex_suites },
+	{ "epoll",
+	  "epoll wakeup and control scaling",
+	  epoll_suites },
+	{ "ipc",
+	  "SysV and POSIX IPC round trips",
+	  ipc_suites },
+	{ "net",
+	  "loopback socket latency and throughput",
+	  net_suites },
 	{ "all",		/* sentinel: easy for help */
 	  "test all subsystem (pseudo subsystem)",
 	  NULL },